@@ -0,0 +1,677 @@
+#include "RunConvert.h"
+
+/**
+ * Prints the command-line usage instructions for the convert command
+ */
+void RunConvert::printUsage() {
+  printf("\n");
+  printf("Usage: ./rmtgnet convert [options]\n");
+  printf("The list of required options:\n");
+  printf("  --ematrix|-e     The file name that contains the expression matrix.\n");
+  printf("                   The rows must be genes or probe sets and columns are samples\n");
+  printf("  --rows|-r        The number of lines in the ematrix file including the header\n");
+  printf("                   row if it exists\n");
+  printf("  --cols|-c        The number of columns in the input file\n");
+  printf("  --method|-m      The correlation method used. Supported methods include\n");
+  printf("                   Pearson's correlation ('pc'), Spearman's rank ('sc'),\n");
+  printf("                   Kendall's tau ('kc'), biweight midcorrelation ('bc')\n");
+  printf("                   and Mutual Information ('mi').\n");
+  printf("\n");
+  printf("Optional expression matrix arguments:\n");
+  printf("  --omit_na         Provide this flag to ignore missing values. Use this option for\n");
+  printf("                    RNA-seq expression matricies where counts are zero.\n");
+  printf("  --na_val|-n      A string representing the missing values in the input file\n");
+  printf("                   (e.g. NA or 0.000)\n");
+  printf("  --func|-f        A transformation function to apply to elements of the ematrix.\n");
+  printf("                   Values include: log, log2 or log10. Default is to not perform\n");
+  printf("                   any transformation.\n");
+  printf("  --headers        Provide this flag if the first line of the matrix contains\n");
+  printf("                   headers.\n");
+  printf("  --group|-G       The sample group of the similarity matrix when it was created\n");
+  printf("                   with the --groups option of the similarity command.\n");
+  printf("\n");
+  printf("Optional conversion arguments:\n");
+  printf("  --input|-i       What to read: 'matrix' for the similarity matrix, in .sim or\n");
+  printf("                   .bin files, or 'edges' for its sorted edge index. The default\n");
+  printf("                   is 'matrix'.\n");
+  printf("  --format|-z      What to write: 'sim' for a single .sim file, 'bin' for the\n");
+  printf("                   original .bin files or 'edges' for a sorted edge index. The\n");
+  printf("                   default is 'sim'.\n");
+  printf("  --dtype|-y       The data type of the values in a 'sim' file: 'float32', or\n");
+  printf("                   the 2-byte 'float16' or 'int16' (fixed point). The default is\n");
+  printf("                   'float32'.\n");
+  printf("  --compress       Provide this flag to store a 'sim' file as compressed tiles.\n");
+  printf("  --th|-t          Leave out the pairs whose absolute similarity is below this\n");
+  printf("                   value. They are NaN in a matrix. Required for 'edges', where\n");
+  printf("                   it is the floor of the index.\n");
+  printf("  --outdir|-o      The directory to write to. The default is the directory of\n");
+  printf("                   the input.\n");
+  printf("\n");
+  printf("For Help:\n");
+  printf("  --help|-h        Print these usage instructions\n");
+  printf("\n");
+}
+
+/**
+ *
+ */
+RunConvert::RunConvert(int argc, char *argv[]) {
+
+  // Set some default values;
+  ematrix = NULL;
+  cmethod = NULL;
+  group = NULL;
+  in_dir = NULL;
+  from_edges = 0;
+  to_edges = 0;
+  format = SIMMATRIX_FORMAT_SIM;
+  dtype = SIMMATRIX_DTYPE_FLOAT32;
+  compress = 0;
+  th = 0;
+  outdir = NULL;
+  headers = 0;
+  infilename = NULL;
+  rows = 0;
+  cols = 0;
+  omit_na = 0;
+  na_val = NULL;
+  strcpy(func, "none");
+  edge_starts = NULL;
+  edge_cols = NULL;
+  edge_scores = NULL;
+
+  // The value returned by getopt_long
+  int c;
+
+  // loop through the incoming arguments until the
+  // getopt_long function returns -1. Then we break out of the loop
+  while(1) {
+    int option_index = 0;
+
+    // specify the long options. The values returned are specified to be the
+    // short options which are then handled by the case statement below
+    static struct option long_options[] = {
+      {"method",       required_argument, 0,  'm' },
+      {"help",         no_argument,       0,  'h' },
+      // Expression matrix options.
+      {"rows",         required_argument, 0,  'r' },
+      {"cols",         required_argument, 0,  'c' },
+      {"headers",      no_argument,       &headers,  1 },
+      {"omit_na",      no_argument,       &omit_na,  1 },
+      {"func",         required_argument, 0,  'f' },
+      {"na_val",       required_argument, 0,  'n' },
+      {"ematrix",      required_argument, 0,  'e' },
+      {"group",        required_argument, 0,  'G' },
+      // Conversion options.
+      {"input",        required_argument, 0,  'i' },
+      {"format",       required_argument, 0,  'z' },
+      {"dtype",        required_argument, 0,  'y' },
+      {"compress",     no_argument,       &compress,  1 },
+      {"th",           required_argument, 0,  't' },
+      {"outdir",       required_argument, 0,  'o' },
+
+      // Last element required to be all zeros.
+      {0, 0, 0, 0}
+    };
+
+    // get the next option
+    c = getopt_long(argc, argv, "m:r:c:f:n:e:G:i:z:y:t:o:h", long_options, &option_index);
+
+    // if the index is -1 then we have reached the end of the options list
+    // and we break out of the while loop
+    if (c == -1) {
+      break;
+    }
+
+    // handle the options
+    switch (c) {
+      case 0:
+        break;
+      case 'm':
+        cmethod = optarg;
+        break;
+      case 'G':
+        group = optarg;
+        break;
+      // Conversion options.
+      case 'i':
+        if (strcmp(optarg, "matrix") == 0) {
+          from_edges = 0;
+        }
+        else if (strcmp(optarg, "edges") == 0) {
+          from_edges = 1;
+        }
+        else {
+          fprintf(stderr, "Error: The input (--input option) must be 'matrix' or 'edges'.\n");
+          exit(-1);
+        }
+        break;
+      case 'z':
+        to_edges = 0;
+        if (strcmp(optarg, "sim") == 0) {
+          format = SIMMATRIX_FORMAT_SIM;
+        }
+        else if (strcmp(optarg, "bin") == 0) {
+          format = SIMMATRIX_FORMAT_BIN;
+        }
+        else if (strcmp(optarg, "edges") == 0) {
+          to_edges = 1;
+        }
+        else {
+          fprintf(stderr, "Error: The output format (--format option) must be 'sim', 'bin' or 'edges'.\n");
+          exit(-1);
+        }
+        break;
+      case 'y':
+        dtype = simmatrix_dtype_parse(optarg);
+        if (dtype == -1) {
+          fprintf(stderr, "Error: The data type (--dtype option) must be 'float32', 'float16' or 'int16'.\n");
+          exit(-1);
+        }
+        break;
+      case 't':
+        th = atof(optarg);
+        break;
+      case 'o':
+        outdir = optarg;
+        break;
+      // Expression matrix options.
+      case 'e':
+        infilename = optarg;
+        break;
+      case 'r':
+        rows = atoi(optarg);
+        break;
+      case 'c':
+        cols = atoi(optarg);
+        break;
+      case 'n':
+        na_val = optarg;
+        break;
+      case 'f':
+        strcpy(func, optarg);
+        break;
+      case 'h':
+        printUsage();
+        exit(-1);
+        break;
+      case '?':
+        exit(-1);
+        break;
+      case ':':
+        printUsage();
+        exit(-1);
+        break;
+      default:
+        printUsage();
+    }
+  }
+
+  // Make sure the similarity method is valid.
+  if (!cmethod) {
+    fprintf(stderr,"Please provide the method (--method option).\n");
+    exit(-1);
+  }
+  if (strcmp(cmethod, "pc") != 0 && strcmp(cmethod, "sc") != 0 && strcmp(cmethod, "mi") != 0 &&
+      strcmp(cmethod, "kc") != 0 && strcmp(cmethod, "bc") != 0) {
+    fprintf(stderr,"Error: The method (--method option) must be 'pc', 'sc', 'kc', 'bc' or 'mi'.\n");
+    exit(-1);
+  }
+
+  // make sure we have a positive integer for the rows and columns of the matrix
+  if (rows < 0 || rows == 0) {
+    fprintf(stderr, "Please provide a positive integer value for the number of rows in the \n");
+    fprintf(stderr, "expression matrix (--rows option).\n");
+    exit(-1);
+  }
+  if (cols < 0 || cols == 0) {
+    fprintf(stderr, "Please provide a positive integer value for the number of columns in\n");
+    fprintf(stderr, "the expression matrix (--cols option).\n");
+    exit(-1);
+  }
+  if (omit_na && !na_val) {
+    fprintf(stderr, "Error: The missing value string should be provided (--na_val option).\n");
+    exit(-1);
+  }
+  if (!infilename) {
+    fprintf(stderr,"Please provide an expression matrix (--ematrix option).\n");
+    exit(-1);
+  }
+
+  // Make sure the output can be written as requested.
+  if (from_edges && to_edges) {
+    fprintf(stderr, "Error: An edge index (--input option) can only be converted to a matrix (--format option).\n");
+    exit(-1);
+  }
+  if (to_edges && th <= 0) {
+    fprintf(stderr, "Error: Please provide the floor of the edge index (--th option).\n");
+    exit(-1);
+  }
+  if (th < 0) {
+    fprintf(stderr, "Error: The threshold (--th option) must not be negative.\n");
+    exit(-1);
+  }
+  if (format == SIMMATRIX_FORMAT_BIN && dtype != SIMMATRIX_DTYPE_FLOAT32) {
+    fprintf(stderr, "Error: The 'bin' format (--format option) only stores 'float32' values (--dtype option).\n");
+    exit(-1);
+  }
+  if ((format == SIMMATRIX_FORMAT_BIN || to_edges) && compress) {
+    fprintf(stderr, "Error: Only the 'sim' format (--format option) can be compressed (--compress option).\n");
+    exit(-1);
+  }
+  // The fixed point scale of mutual information is only known once all of
+  // the matrix is written.
+  if (compress && dtype == SIMMATRIX_DTYPE_INT16 && strcmp(cmethod, "mi") == 0) {
+    fprintf(stderr, "Error: The 'mi' method cannot be compressed (--compress option) with the 'int16' type.\n");
+    exit(-1);
+  }
+
+  // Load the input expression matrix.
+  ematrix = new EMatrix(infilename, rows, cols, headers, omit_na, na_val, func);
+
+  // The matrix of a sample group is in a subdirectory named after the group.
+  in_dir = (char *) malloc(sizeof(char) * (1024 + (group ? strlen(group) : 0)));
+  RunSimilarity::getOutputDir(cmethod, in_dir);
+  if (group) {
+    strcat(in_dir, "/");
+    strcat(in_dir, group);
+  }
+  if (!outdir) {
+    outdir = in_dir;
+  }
+}
+
+/**
+ *
+ */
+RunConvert::~RunConvert() {
+  delete ematrix;
+  free(in_dir);
+  free(edge_starts);
+  free(edge_cols);
+  free(edge_scores);
+}
+
+/**
+ * Makes sure the output does not replace the input and is not hidden by
+ * another matrix in the output directory.
+ */
+void RunConvert::checkOutput() {
+  char * prefix = ematrix->getFilePrefix();
+  char in_file[1024];
+  char out_file[1024];
+  struct stat in_st;
+  struct stat out_st;
+
+  if (from_edges) {
+    EdgeIndex::getFileName(in_dir, prefix, cmethod, in_file);
+  }
+  else {
+    SimMatrixReader::getFileName(in_dir, prefix, cmethod, in_file);
+  }
+
+  if (to_edges) {
+    EdgeIndex::getFileName(outdir, prefix, cmethod, out_file);
+  }
+  else if (format == SIMMATRIX_FORMAT_SIM) {
+    SimMatrixWriter::getSimFileName(outdir, prefix, cmethod, out_file);
+  }
+  else {
+    sprintf(out_file, "%s/%s.%s%d.bin", outdir, prefix, cmethod, 0);
+  }
+
+  if (stat(in_file, &in_st) == 0 && stat(out_file, &out_st) == 0 &&
+      in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+    fprintf(stderr, "Error: The output would replace the input '%s'. Please choose another\n", in_file);
+    fprintf(stderr, "directory (--outdir option).\n");
+    exit(-1);
+  }
+
+  // A .sim file is read instead of .bin files in the same directory.
+  if (!to_edges && format == SIMMATRIX_FORMAT_BIN &&
+      SimMatrixReader::exists(outdir, prefix, cmethod) == SIMMATRIX_FORMAT_SIM) {
+    SimMatrixWriter::getSimFileName(outdir, prefix, cmethod, out_file);
+    fprintf(stderr, "Error: The .bin files would be hidden by '%s'. Please choose another\n", out_file);
+    fprintf(stderr, "directory (--outdir option).\n");
+    exit(-1);
+  }
+}
+
+/**
+ * Groups the pairs of an input edge index by row.
+ *
+ * @param EdgeIndex * index
+ */
+void RunConvert::loadEdges(EdgeIndex * index) {
+  int num_genes = ematrix->getNumGenes();
+  edge_index_edge_t * edges;
+  long long int num_edges = index->getAllEdges(&edges);
+
+  edge_starts = (long long int *) calloc(num_genes + 1, sizeof(long long int));
+  edge_cols = (int *) malloc(sizeof(int) * (num_edges > 0 ? num_edges : 1));
+  edge_scores = (float *) malloc(sizeof(float) * (num_edges > 0 ? num_edges : 1));
+
+  for (long long int e = 0; e < num_edges; e++) {
+    if (edges[e].i < 0 || edges[e].i >= num_genes || edges[e].j < 0 || edges[e].j >= edges[e].i) {
+      fprintf(stderr, "ERROR: The edge index holds an invalid pair (%d, %d).\n", edges[e].i, edges[e].j);
+      exit(-1);
+    }
+    edge_starts[edges[e].i + 1]++;
+  }
+  for (int j = 0; j < num_genes; j++) {
+    edge_starts[j + 1] += edge_starts[j];
+  }
+
+  long long int * next = (long long int *) malloc(sizeof(long long int) * (num_genes > 0 ? num_genes : 1));
+  memcpy(next, edge_starts, sizeof(long long int) * num_genes);
+  for (long long int e = 0; e < num_edges; e++) {
+    long long int k = next[edges[e].i]++;
+    edge_cols[k] = edges[e].j;
+    edge_scores[k] = edges[e].score;
+  }
+  free(next);
+}
+
+/**
+ * Reads a row of the lower triangle from the pairs of an input edge index.
+ * Pairs that are not in the index are NaN.  The diagonal is 1, as the
+ * similarity command writes it.
+ *
+ * @param int j
+ *   The row.
+ * @param float * row
+ *   An array of at least j + 1 floats.
+ */
+void RunConvert::readEdgeRow(int j, float * row) {
+  for (int k = 0; k < j; k++) {
+    row[k] = NAN;
+  }
+  row[j] = 1;
+  for (long long int e = edge_starts[j]; e < edge_starts[j + 1]; e++) {
+    row[edge_cols[e]] = edge_scores[e];
+  }
+}
+
+/**
+ * Writes the output matrix row by row.  The .bin or .sim writer compresses
+ * the tiles of a band with several threads and writes in the background.
+ *
+ * @param SimMatrixReader * reader
+ *   The input matrix, or NULL if the input is an edge index.
+ */
+void RunConvert::writeMatrix(SimMatrixReader * reader) {
+  int num_genes = ematrix->getNumGenes();
+  int layout = compress ? SIMMATRIX_LAYOUT_TILES : SIMMATRIX_LAYOUT_ROWS;
+  float * row = (float *) malloc(sizeof(float) * num_genes);
+
+  SimMatrixWriter * writer = new SimMatrixWriter(outdir, ematrix->getFilePrefix(), cmethod, num_genes,
+      ematrix->getGenes(), format, dtype, layout);
+  for (int j = 0; j < num_genes; j++) {
+    if (j % 1000 == 0) {
+      printf("  Converting row %d of %d...\n", j + 1, num_genes);
+    }
+    if (reader) {
+      reader->readRow(j, row);
+    }
+    else {
+      readEdgeRow(j, row);
+    }
+    for (int k = 0; k < j; k++) {
+      writer->write(fabsf(row[k]) >= th ? row[k] : NAN);
+    }
+    writer->write(row[j]);
+  }
+  delete writer;
+  free(row);
+
+  if (format == SIMMATRIX_FORMAT_BIN) {
+    writeGeneIndex();
+  }
+}
+
+/**
+ * Writes the list of genes next to the .bin files, as the similarity
+ * command does.
+ */
+void RunConvert::writeGeneIndex() {
+  char indexfilename[1024];
+  char ** genes = ematrix->getGenes();
+
+  SimMatrixWriter::getGeneIndexFileName(outdir, ematrix->getFilePrefix(), cmethod, indexfilename);
+  FILE * fh = fopen(indexfilename, "w");
+  if (!fh) {
+    fprintf(stderr, "ERROR: could not open the gene index: '%s'\n", indexfilename);
+    exit(-1);
+  }
+  for (int i = 0; i < ematrix->getNumGenes(); i++) {
+    fprintf(fh, "%s\n", genes[i]);
+  }
+  fclose(fh);
+}
+
+/**
+ * Mixes the bits of a 64-bit number.
+ */
+static unsigned long long convert_mix(unsigned long long x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * The checksum of a single value of the matrix.  The checksum of a row is
+ * the sum of those of its values, so it does not depend on the order in
+ * which they are visited.
+ */
+static unsigned long long convert_hash(int j, int k, float value) {
+  unsigned int bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  return convert_mix((((unsigned long long) j << 32) | (unsigned int) k) ^ convert_mix(bits));
+}
+
+// What the checksums of the rows are calculated from.
+typedef struct {
+  // Set to 1 to apply the conversion to the values first: the threshold
+  // and the data type and scale of the output.
+  int convert;
+  float th;
+  int dtype;
+  float scale;
+  // Set to 1 to leave out the diagonal and the pairs below th, as an edge
+  // index does.
+  int edges;
+  // The checksum of each row.
+  unsigned long long * sums;
+} convert_check_t;
+
+/**
+ * Converts an input value as it is stored in the output.
+ *
+ * @return float
+ *   The value, or NaN if it is left out.
+ */
+static float convert_value(convert_check_t * c, int j, int k, float value) {
+  unsigned char stored[sizeof(float)];
+
+  if (k < j && !(fabsf(value) >= c->th)) {
+    return NAN;
+  }
+  if (c->edges) {
+    return value;
+  }
+  simmatrix_encode(&value, 1, c->dtype, c->scale, stored);
+  simmatrix_decode(stored, 1, c->dtype, c->scale, &value);
+  return value;
+}
+
+/**
+ * Calculates the checksum of a row.  Called by SimMatrixReader::scanRows().
+ * NaN values are left out.
+ */
+static void check_row(int j, float * row, int thread, void * arg) {
+  convert_check_t * c = (convert_check_t *) arg;
+  int n = c->edges ? j : j + 1;
+  unsigned long long sum = 0;
+
+  for (int k = 0; k < n; k++) {
+    float value = c->convert ? convert_value(c, j, k, row[k]) : row[k];
+    if (!isnan(value)) {
+      sum += convert_hash(j, k, value);
+    }
+  }
+  c->sums[j] = sum;
+}
+
+/**
+ * Reads the output back and compares the checksum of every block of
+ * CONVERT_BLOCK_ROWS rows with that of the input.
+ *
+ * @param SimMatrixReader * reader
+ *   The input matrix, or NULL if the input is an edge index.
+ * @param EdgeIndex * index
+ *   The output edge index, or NULL if the output is a matrix.
+ */
+void RunConvert::verify(SimMatrixReader * reader, EdgeIndex * index) {
+  int num_genes = ematrix->getNumGenes();
+  char * prefix = ematrix->getFilePrefix();
+  convert_check_t in;
+  convert_check_t out;
+
+  printf("  Checking the conversion...\n");
+  in.convert = 1;
+  in.th = th;
+  in.dtype = SIMMATRIX_DTYPE_FLOAT32;
+  in.scale = 1;
+  in.edges = to_edges;
+  in.sums = (unsigned long long *) calloc(num_genes, sizeof(unsigned long long));
+  out = in;
+  out.convert = 0;
+  out.sums = (unsigned long long *) calloc(num_genes, sizeof(unsigned long long));
+
+  // The output. A matrix also sets the data type and scale the input
+  // values are converted to.
+  if (index) {
+    edge_index_edge_t * edges;
+    long long int num_edges = index->getAllEdges(&edges);
+    for (long long int e = 0; e < num_edges; e++) {
+      out.sums[edges[e].i] += convert_hash(edges[e].i, edges[e].j, edges[e].score);
+    }
+  }
+  else {
+    SimMatrixReader * out_reader = new SimMatrixReader(outdir, prefix, cmethod);
+    out_reader->checkGenes(ematrix->getGenes(), num_genes);
+    in.dtype = out_reader->getDtype();
+    in.scale = out_reader->getScale();
+    out_reader->scanRows(0, check_row, &out);
+    delete out_reader;
+  }
+
+  // The input.
+  if (reader) {
+    reader->scanRows(0, check_row, &in);
+  }
+  else {
+    for (int j = 0; j < num_genes; j++) {
+      // A matrix holds the diagonal, which readEdgeRow() sets to 1.
+      if (!in.edges) {
+        in.sums[j] += convert_hash(j, j, convert_value(&in, j, j, 1));
+      }
+      for (long long int e = edge_starts[j]; e < edge_starts[j + 1]; e++) {
+        float value = convert_value(&in, j, edge_cols[e], edge_scores[e]);
+        if (!isnan(value)) {
+          in.sums[j] += convert_hash(j, edge_cols[e], value);
+        }
+      }
+    }
+  }
+
+  // Compare the blocks.
+  int num_blocks = (num_genes + CONVERT_BLOCK_ROWS - 1) / CONVERT_BLOCK_ROWS;
+  int num_bad = 0;
+  for (int b = 0; b < num_blocks; b++) {
+    int first = b * CONVERT_BLOCK_ROWS;
+    int last = first + CONVERT_BLOCK_ROWS < num_genes ? first + CONVERT_BLOCK_ROWS : num_genes;
+    unsigned long long in_sum = 0;
+    unsigned long long out_sum = 0;
+    for (int j = first; j < last; j++) {
+      in_sum += in.sums[j];
+      out_sum += out.sums[j];
+    }
+    if (in_sum != out_sum) {
+      if (num_bad < 10) {
+        fprintf(stderr, "ERROR: The checksum of rows %d to %d does not match: %016llx instead of %016llx.\n",
+            first + 1, last, out_sum, in_sum);
+      }
+      num_bad++;
+    }
+  }
+  free(in.sums);
+  free(out.sums);
+
+  if (num_bad > 0) {
+    fprintf(stderr, "ERROR: %d of the %d blocks were not converted correctly.\n", num_bad, num_blocks);
+    exit(-1);
+  }
+  printf("  The checksums of all %d blocks of %d rows match.\n", num_blocks, CONVERT_BLOCK_ROWS);
+}
+
+/**
+ *
+ */
+void RunConvert::execute() {
+  char * prefix = ematrix->getFilePrefix();
+  int num_genes = ematrix->getNumGenes();
+  SimMatrixReader * reader = NULL;
+  EdgeIndex * in_index = NULL;
+  EdgeIndex * out_index = NULL;
+  char filename[1024];
+
+  // Open the input.
+  if (from_edges) {
+    in_index = new EdgeIndex(in_dir, prefix, cmethod);
+    if (in_index->getNumGenes() != num_genes) {
+      fprintf(stderr, "ERROR: The edge index has %d genes but the expression matrix has %d.\n",
+          in_index->getNumGenes(), num_genes);
+      exit(-1);
+    }
+    if (th < in_index->getFloor()) {
+      printf("  The pairs below the floor of the edge index (%f) are NaN.\n", in_index->getFloor());
+    }
+    loadEdges(in_index);
+    delete in_index;
+  }
+  else {
+    if (SimMatrixReader::exists(in_dir, prefix, cmethod) == -1) {
+      fprintf(stderr, "ERROR: There is no similarity matrix for '%s' in '%s'.\n", prefix, in_dir);
+      exit(-1);
+    }
+    reader = new SimMatrixReader(in_dir, prefix, cmethod);
+    reader->checkGenes(ematrix->getGenes(), num_genes);
+  }
+
+  struct stat st = {0};
+  if (stat(outdir, &st) == -1) {
+    mkdir(outdir, 0700);
+  }
+  checkOutput();
+
+  // Write the output. An existing edge index is built again, so that it has
+  // exactly the requested floor.
+  printf("  Converting the similarity matrix in '%s' to '%s'...\n", in_dir, outdir);
+  if (to_edges) {
+    EdgeIndex::getFileName(outdir, prefix, cmethod, filename);
+    unlink(filename);
+    out_index = new EdgeIndex(outdir, prefix, cmethod, reader, th);
+  }
+  else {
+    writeMatrix(reader);
+  }
+
+  verify(reader, out_index);
+  delete out_index;
+  delete reader;
+}
@@ -0,0 +1,96 @@
+#ifndef _RUNCONVERT_
+#define _RUNCONVERT_
+
+#include <getopt.h>
+#include <sys/stat.h>
+#include "../ematrix/EMatrix.h"
+#include "../similarity/SimMatrixFormat.h"
+#include "../similarity/SimMatrixWriter.h"
+#include "../similarity/SimMatrixReader.h"
+#include "../similarity/EdgeIndex.h"
+#include "../similarity/RunSimilarity.h"
+
+// The number of rows covered by each checksum of the conversion check.
+#define CONVERT_BLOCK_ROWS SIMMATRIX_TILE_SIZE
+
+/**
+ * Converts a similarity matrix from one file format to another without
+ * calculating it again.
+ *
+ * The input is the similarity matrix of a method, in .bin files or a .sim
+ * file, or its sorted edge index.  The output is a .sim file, with any data
+ * type and optionally compressed, .bin files, or a sorted edge index.  Pairs
+ * whose absolute similarity is below a threshold can be left out, which
+ * stores them as NaN in a matrix.  Values missing from an edge index are NaN
+ * as well.
+ *
+ * Once written, the output is read back and compared with the input: a
+ * checksum of every block of CONVERT_BLOCK_ROWS rows is calculated from
+ * both, with the input values converted to the output data type first.
+ * The rows of both are read with several threads.
+ */
+class RunConvert {
+  private:
+    // The expression matrix object.
+    EMatrix * ematrix;
+    // The similarity method.
+    char * cmethod;
+    // The sample group of the similarity matrix or NULL.
+    char * group;
+    // The directory of the input matrix.
+    char * in_dir;
+
+    // Conversion options
+    // ------------------
+    // Set to 1 to read the sorted edge index instead of the matrix.
+    int from_edges;
+    // Set to 1 to write a sorted edge index instead of a matrix.
+    int to_edges;
+    // The file format, data type and compression of an output matrix.
+    int format;
+    int dtype;
+    int compress;
+    // Pairs whose absolute similarity is below the threshold are left out.
+    float th;
+    // The directory of the output.
+    char * outdir;
+
+    // Variables for the expression matrix
+    // -----------------------------------
+    // Indicates if the expression matrix has headers.
+    int headers;
+    // The input file name
+    char *infilename;
+    // The number of rows in the input ematrix file (including the header)
+    int rows;
+    // The number of cols in the input ematrix file.
+    int cols;
+    // Indicates if missing values should be ignored in the EMatrix file.
+    int omit_na;
+    // Specifies the value that represents a missing value.
+    char *na_val;
+    // Specifies the transformation function: log2, none.
+    char func[10];
+
+    // The pairs of an input edge index, grouped by row: the pairs of row j
+    // are edge_starts[j] to edge_starts[j + 1] - 1.
+    long long int * edge_starts;
+    int * edge_cols;
+    float * edge_scores;
+
+    void checkOutput();
+    void loadEdges(EdgeIndex * index);
+    void readEdgeRow(int j, float * row);
+    void writeMatrix(SimMatrixReader * reader);
+    void writeGeneIndex();
+    void verify(SimMatrixReader * reader, EdgeIndex * index);
+
+  public:
+    RunConvert(int argc, char *argv[]);
+    ~RunConvert();
+
+    static void printUsage();
+    void execute();
+};
+
+#endif
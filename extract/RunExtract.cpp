@@ -14,7 +14,8 @@ void RunExtract::printUsage() {
   printf("  --cols|-c        The number of columns in the input file\n");
   printf("  --th|-t          The threshold to cut the similarity matrix. Network files will be generated.\n");
   printf("  --method|-m      The correlation methods used. Supported methods include\n");
-  printf("                   Pearson's correlation ('pc'), Spearman's rank ('sc')\n");
+  printf("                   Pearson's correlation ('pc'), Spearman's rank ('sc'),\n");
+  printf("                   Kendall's tau ('kc'), biweight midcorrelation ('bc')\n");
   printf("                   and Mutual Information ('mi').");
   printf("\n");
   printf("Optional expression matrix arguments:\n");
@@ -36,6 +37,10 @@ void RunExtract::printUsage() {
   printf("  --gene1|-2       Extract a single similarity value: The name of the second gene in a singe\n");
   printf("                   pair-wise comparision.  Must be used with --gene1 option.\n");
   printf("\n");
+  printf("Optional sample group arguments:\n");
+  printf("  --group|-G       The sample group of the similarity matrix when it was created\n");
+  printf("                   with the --groups option of the similarity command.\n");
+  printf("\n");
   printf("For Help:\n");
   printf("  --help|-h        Print these usage instructions\n");
   printf("\n");
@@ -53,6 +58,7 @@ RunExtract::RunExtract(int argc, char *argv[]) {
   gene2 = NULL;
   th = 0;
   quiet = 0;
+  group = NULL;
 
    // The value returned by getopt_long
    int c;
@@ -83,6 +89,7 @@ RunExtract::RunExtract(int argc, char *argv[]) {
       {"gene2",        required_argument, 0,  '2' },
       {"x",            required_argument, 0,  'x' },
       {"y",            required_argument, 0,  'y' },
+      {"group",        required_argument, 0,  'G' },
 
       // Last element required to be all zeros.
       {0, 0, 0, 0}
@@ -90,7 +97,7 @@ RunExtract::RunExtract(int argc, char *argv[]) {
     delete ematrix;
 
     // get the next option
-    c = getopt_long(argc, argv, "m:r:c:f:n:e:t:1:2:x:y:g:d:z:l:h", long_options, &option_index);
+    c = getopt_long(argc, argv, "m:r:c:f:n:e:t:1:2:x:y:g:d:z:l:G:h", long_options, &option_index);
 
     // if the index is -1 then we have reached the end of the options list
     // and we break out of the while loop
@@ -121,6 +128,9 @@ RunExtract::RunExtract(int argc, char *argv[]) {
       case 'y':
         y_coord = atoi(optarg);
         break;
+      case 'G':
+        group = optarg;
+        break;
       // Expression matrix options.
       case 'e':
         infilename = optarg;
@@ -244,7 +254,7 @@ RunExtract::~RunExtract() {
  */
 void RunExtract::execute() {
 
-  SimMatrixBinary * smatrix = new SimMatrixBinary(ematrix, quiet, cmethod,
+  SimMatrixBinary * smatrix = new SimMatrixBinary(ematrix, quiet, cmethod, group,
     x_coord, y_coord, gene1, gene2, th);
 
   // If we have a threshold then we want to get the edges of the network.
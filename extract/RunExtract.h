@@ -25,6 +25,8 @@ class RunExtract {
     char * gene1;
     // the user-specified name of gene2
     char * gene2;
+    // The sample group of the similarity matrix or NULL.
+    char * group;
 
 
     // Variables for the expression matrix
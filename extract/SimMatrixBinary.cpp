@@ -4,19 +4,21 @@
  * Constructor
  */
 SimMatrixBinary::SimMatrixBinary(EMatrix *ematrix, int quiet,
-    char * cmethod, int x_coord, int y_coord, char * gene1, char * gene2, float th)
+    char * cmethod, char * group, int x_coord, int y_coord, char * gene1, char * gene2, float th)
   : SimilarityMatrix(ematrix, quiet, cmethod, x_coord, y_coord, gene1, gene2, th){
 
-  // Initialize some variables.
-  num_files = 0;
-
-  // Initialize the file pointer array.
-  for(int i = 0; i < 50; i++) {
-    files[i] = NULL;
+  // The matrix of a sample group is in a subdirectory named after the group
+  // and its network files are named after it as well.
+  int group_len = group ? strlen(group) : 0;
+  char * prefix = ematrix->getFilePrefix();
+  out_prefix = (char *) malloc(sizeof(char) * (strlen(prefix) + group_len + 2));
+  strcpy(out_prefix, prefix);
+  if (group) {
+    sprintf(out_prefix, "%s.%s", prefix, group);
   }
 
   // For the binary file format:
-  bin_dir = (char *) malloc(sizeof(char) * strlen(ematrix->getInfileName()));
+  bin_dir = (char *) malloc(sizeof(char) * (strlen("Spearman") + group_len + 2));
   if (strcmp(method, "mi") == 0) {
     strcpy(bin_dir, "MI");
   }
@@ -26,9 +28,19 @@ SimMatrixBinary::SimMatrixBinary(EMatrix *ematrix, int quiet,
   else if (strcmp(method, "sc") == 0) {
     strcpy(bin_dir, "Spearman");
   }
+  else if (strcmp(method, "kc") == 0) {
+    strcpy(bin_dir, "Kendall");
+  }
+  else if (strcmp(method, "bc") == 0) {
+    strcpy(bin_dir, "Bicor");
+  }
+  if (group) {
+    strcat(bin_dir, "/");
+    strcat(bin_dir, group);
+  }
 
-  // Open file handles to all of the binary files.
-  openBinFiles();
+  reader = new SimMatrixReader(bin_dir, prefix, method);
+  reader->checkGenes(ematrix->getGenes(), ematrix->getNumGenes());
 }
 
 /**
@@ -36,111 +48,18 @@ SimMatrixBinary::SimMatrixBinary(EMatrix *ematrix, int quiet,
  */
 SimMatrixBinary::~SimMatrixBinary(){
 
-  // Close all of the binary files.
-  closeBinFiles();
+  delete reader;
   free(bin_dir);
-}
-
-/**
- * Looks in the directory where the similarity matrix is kept and opens each
- * of the bin files for reading.
- */
-void SimMatrixBinary::openBinFiles() {
-  // A directory handle.
-  DIR * FD;
-  // A file structure for the file while looping.
-  struct dirent* curr_file;
-  // the position of the '.bin' extension in the file name.
-  char * bin_pos;
-  // The position of the .mi or .pc in the file name.
-  char * method_pos;
-  // The string representation of the number of the bin file.
-  char bin_num[5];
-  // The numerical bin number.
-  int bin_i;
-  // The number of genes in the file.
-  int num_genes;
-
-  // Scanning for the files of the similarity matrix
-  if (!quiet) {
-    printf("  Scanning %s directory for matrix .bin files...\n", bin_dir);
-  }
-  if (NULL == (FD = opendir(bin_dir))) {
-    fprintf(stderr, "Error : Failed to open input directory: '%s'\n", bin_dir);
-    exit(-1);
-  }
-  while ((curr_file = readdir(FD))) {
-    // skip the . and .. dirs
-    if (strcmp(curr_file->d_name, ".") == 0 || strcmp(curr_file->d_name, "..") == 0) {
-      continue;
-    }
-    // Make sure this file has a .bin extension.
-    bin_pos = strstr(curr_file->d_name, ".bin");
-    if(bin_pos) {
-      // Make sure the file has the prefix.
-      if(strstr(curr_file->d_name, ematrix->getFilePrefix()) != NULL) {
-
-        // Make sure that this file has the method name proceeded by a period.
-        char m[5];
-        sprintf(m, ".%s", method);
-        method_pos = strstr(curr_file->d_name, m);
-
-        if (method_pos) {
-
-          // Get the numerical value of this bin file.
-          int size = (bin_pos - (method_pos + 3)) * sizeof(char);
-          memcpy(bin_num, method_pos + (3 * sizeof(char)), size);
-          bin_num[size] = 0; // add a terminator to the size
-          bin_i = atoi(bin_num);
-
-          // Open the file and store the file handle for later use and store
-          // it in the files array using the bin_num as an index.
-          char filename[1024];
-          sprintf(filename, "%s/%s", bin_dir, curr_file->d_name);
-          if (!quiet) {
-            printf("  Found file: %s\n", filename);
-          }
-          FILE * fh = fopen(filename, "rb");
-          if (fh == NULL) {
-            fprintf(stderr, "ERROR: could not open bin file: '%s':\n", filename);
-            exit(-1);
-          }
-          files[bin_i] = fh;
-          num_files++;
-
-          // Read in the number of genes in the similarity matrix and the number
-          // of lines in the file.
-          fread(&num_genes, sizeof(int), 1, fh);
-          fread(&num_lines[bin_i], sizeof(int), 1, fh);
-        }
-      }
-    }
-  }
-  if (num_files == 0) {
-    fprintf(stderr, "ERROR: Could not find any matrix .bin files.\n");
-    exit(-1);
-  }
-}
-
-/**
- * Closes all of the file pointers opened by the open_bin_files
- */
-void SimMatrixBinary::closeBinFiles() {
-  int i;
-
-  for (i = 0; i < num_files; i++) {
-    fclose(files[i]);
-  }
+  free(out_prefix);
 }
 
 /**
  *
  */
 void SimMatrixBinary::writeNetwork() {
-   int bin_i = 0;
    int x,y;   // used for iterating through the n x n similarity matrix
-   int i;     // used for specifying the bin file to read
    float n;   // the cell value in the similarity matrix
+   float * row; // the lower triangle of row x of the similarity matrix
 
    // the three network output files for edges, negative correlated edges
    // and positive correlated edges
@@ -153,7 +72,7 @@ void SimMatrixBinary::writeNetwork() {
    char edgesN_file[1024];
    char edgesP_file[1024];
 
-   char * file_prefix = ematrix->getFilePrefix();
+   char * file_prefix = out_prefix;
    int num_genes = ematrix->getNumGenes();
    char ** genes = ematrix->getGenes();
 
@@ -165,10 +84,13 @@ void SimMatrixBinary::writeNetwork() {
    fprintf(edges, "gene1\tgene2\tsimilarity\tinteraction\n");
 
 
-   // The Spearman and Pearson correlation methods will have both negative and
-   // positive values, so we want to create separate files for each one.
+   // The Spearman, Pearson, Kendall and bicor correlation methods will have
+   // both negative and positive values, so we want to create separate files
+   // for each one.
    if (strcmp(method, "pc") == 0 ||
-       strcmp(method, "sc") == 0) {
+       strcmp(method, "sc") == 0 ||
+       strcmp(method, "kc") == 0 ||
+       strcmp(method, "bc") == 0) {
      sprintf(edgesN_file, "%s.%s.th%0.6f.neg.coexpnet.edges.txt", file_prefix, method, th);
      sprintf(edgesP_file, "%s.%s.th%0.6f.pos.coexpnet.edges.txt", file_prefix, method, th);
      edgesN = fopen(edgesN_file, "w");
@@ -177,28 +99,17 @@ void SimMatrixBinary::writeNetwork() {
      fprintf(edgesP, "gene1\tgene2\tsimilarity\tinteraction\n");
    }
 
-   // get the size of the matrix in one dimension (i.e. mxm)
-   i = 0;
+   // read the matrix row by row.  The matrix is symetrical so we don't
+   // need to look where y >= x
+   row = (float *) malloc(sizeof(float) * num_genes);
    for (x = 0; x < num_genes; x++) {
-      if (i >= num_lines[bin_i]) {
-         bin_i++;
-         i = 0;
-         // set the file position just past the row info
-         fseek(files[bin_i], sizeof(int) * 2, SEEK_SET);
+      // The zones of the row that have no value above the threshold are
+      // not read.
+      if (!reader->readRow(x, row, th)) {
+        continue;
       }
-      for (y = 0; y < num_genes; y++) {
-
-         // get the next float value for coordinate (x,y)
-         int num_read = fread(&n, sizeof(float), 1, files[bin_i]);
-         if(num_read != 1){
-            fprintf(stderr, "ERROR: cannot fetch from bin file %d\n", bin_i);
-            exit(-1);
-         }
-
-         // the matrix is symetrical so we don't need to look where y >= x
-         if(y >= x) {
-           break;
-         }
+      for (y = 0; y < x; y++) {
+         n = row[y];
 
          // write the simiarity value to the appopriate file
          if((n > 0 &&  n >= th) || (n < 0 && -n >= th)){
@@ -207,7 +118,9 @@ void SimMatrixBinary::writeNetwork() {
             // if the method id 'pc' (Pearson's correlation) then we will have
             // negative and positive values, and we'll write those to separate files
             if (strcmp(method, "pc") == 0 ||
-                strcmp(method, "sc") == 0) {
+                strcmp(method, "sc") == 0 ||
+                strcmp(method, "kc") == 0 ||
+                strcmp(method, "bc") == 0) {
               if(n >= 0){
                  fprintf(edgesP, "%s\t%s\t%0.8f\tco\n", genes[x], genes[y], n);
               }
@@ -217,8 +130,8 @@ void SimMatrixBinary::writeNetwork() {
             }
          }
       }
-      i++;
    }
+   free(row);
    fclose(edges);
    fclose(edgesN);
    fclose(edgesP);
@@ -236,14 +149,6 @@ void SimMatrixBinary::getPosition() {
   int x = x_coord - 1;
   // The y coordinate.
   int y = y_coord - 1;
-  // Holds the number of lines already visited.
-  int i = 0;
-  // Iterates through the columns.
-  int j;
-  // Used to store the position in the file for the (x,y) coordinate.
-  int pos;
-  // Indicates the bin file number currently being checked.
-  int bin_i;
 
   // if y > x then reverse the two as the sim matrix is symetrical and only
   // half is stored.
@@ -253,34 +158,11 @@ void SimMatrixBinary::getPosition() {
     y = temp;
   }
 
-  // iterate through the bin files until we find the one with the proper coordinates
-  pos = 0;
-  for (bin_i = 0; bin_i < num_files; bin_i++) {
-    // if the x coordinate falls within the rows stored in the bin file, then
-    // find the coordinate value
-    if (x >= i && x < i + num_lines[bin_i]) {
-
-      // calculate the coordinate value
-      for (j = 0; j < x - i; j++) {
-         pos = pos + i + 1 + j;
-      }
-      pos = (pos + y) * sizeof(float) + sizeof(int) * 2;
-
-      // set the file position to the calculated location of the (x,y) coordinate
-      fseek(files[bin_i], pos, SEEK_SET);
-      int num_bytes = fread(&n, sizeof(float), 1, files[bin_i]);
-      if(num_bytes != 1){
-        fprintf(stderr,"ERROR: cannot fetch from bin file %d\n", bin_i);
-        exit(-1);
-      }
-      if (!quiet) {
-        printf("similarity(%i,%i) = %0.8f, bin = %d, pos = %d\n", x + 1, y + 1, n, bin_i, pos);
-      }
-      else {
-        printf("%0.8f\n", n);
-      }
-      break;
-    }
-    i += num_lines[bin_i];
+  n = reader->getValue(x, y);
+  if (!quiet) {
+    printf("similarity(%i,%i) = %0.8f\n", x + 1, y + 1, n);
+  }
+  else {
+    printf("%0.8f\n", n);
   }
 }
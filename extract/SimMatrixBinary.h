@@ -2,31 +2,25 @@
 #define _EXTRACT_
 
 #include "SimilarityMatrix.h"
+#include "../similarity/SimMatrixReader.h"
 
 /**
- * Class for extracting a network from the original RMTGeneNet binary files.
+ * Class for extracting a network from the RMTGeneNet binary files: either
+ * a .sim file or the original .bin files.
  */
 class SimMatrixBinary : public SimilarityMatrix {
 
   private:
-    // Holds file handles for all of the binary files.
-    FILE * files[50];
-    // The number of lines per bin file.
-    int num_lines[50];
-    // Indicates the number of files in the files array.
-    int num_files;
+    // Reads the similarity matrix.
+    SimMatrixReader * reader;
     // The directory where the expression matrix is found
     char * bin_dir;
-
-
-    // Opens file handles to all of the binary files.
-    void openBinFiles();
-    // Closes all of the file handles for the binary files.
-    void closeBinFiles();
+    // The prefix for output files. It includes the sample group, if any.
+    char * out_prefix;
 
   public:
     // Constructur.
-    SimMatrixBinary(EMatrix *ematrix, int quiet, char * c_method,
+    SimMatrixBinary(EMatrix *ematrix, int quiet, char * c_method, char * group,
         int x_coord, int y_cood, char * gene1, char * gene2, float th);
     // Destructor.
     ~SimMatrixBinary();
@@ -21,7 +21,7 @@ class SimilarityMatrix {
     EMatrix * ematrix;
     // Set to 1 if nothing but the sim value is shown
     int quiet;
-    // Specifies the correlation method that was used: pc, mi, sc
+    // Specifies the correlation method that was used: pc, mi, sc, kc, bc
     char * method;
     // The user-specified x coordinate to retrieve
     int x_coord;
@@ -0,0 +1,232 @@
+#include "lz.h"
+
+// The number of bits of the match finder hash.
+#define LZ_HASH_BITS 14
+// The farthest distance a match can be found at.
+#define LZ_MAX_DISTANCE 65535
+
+/**
+ * Retrieves the largest possible compressed size of n bytes.
+ *
+ * @param int n
+ *
+ * @return int
+ */
+int lz_bound(int n) {
+  return n + n / 255 + 16;
+}
+
+/**
+ * Reads four bytes.
+ */
+static unsigned int lz_read32(unsigned char * p) {
+  unsigned int v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * Writes a length of at least 15 as a series of bytes.
+ *
+ * @param unsigned char * op
+ *   The output position.
+ * @param int len
+ *   The length minus 15.
+ *
+ * @return
+ *   The new output position.
+ */
+static unsigned char * lz_write_length(unsigned char * op, int len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (unsigned char) len;
+  return op;
+}
+
+/**
+ * Compresses a block of bytes.
+ *
+ * Matches are found with a hash table of the last position of every four
+ * byte sequence, which is fast and finds the long runs of repeated values
+ * typical for missing values and quantized scores.
+ *
+ * @param unsigned char * in
+ *   The bytes to compress.
+ * @param int n
+ *   The number of bytes.
+ * @param unsigned char * out
+ *   Receives the compressed bytes. It must hold lz_bound(n) bytes.
+ *
+ * @return int
+ *   The compressed size.
+ */
+int lz_compress(unsigned char * in, int n, unsigned char * out) {
+  int * table = (int *) malloc(sizeof(int) * (1 << LZ_HASH_BITS));
+  unsigned char * op = out;
+  int ip = 0;
+  int anchor = 0;
+
+  memset(table, -1, sizeof(int) * (1 << LZ_HASH_BITS));
+  while (ip + LZ_MIN_MATCH <= n) {
+    unsigned int seq = lz_read32(in + ip);
+    unsigned int h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+    int ref = table[h];
+    table[h] = ip;
+    if (ref < 0 || ip - ref > LZ_MAX_DISTANCE || lz_read32(in + ref) != seq) {
+      ip++;
+      continue;
+    }
+
+    // Extend the match as far as possible.
+    int len = LZ_MIN_MATCH;
+    while (ip + len < n && in[ref + len] == in[ip + len]) {
+      len++;
+    }
+
+    // Write the sequence: token, literals, distance and match length.
+    int lit = ip - anchor;
+    int mlen = len - LZ_MIN_MATCH;
+    *op++ = (unsigned char) (((lit < 15 ? lit : 15) << 4) | (mlen < 15 ? mlen : 15));
+    if (lit >= 15) {
+      op = lz_write_length(op, lit - 15);
+    }
+    memcpy(op, in + anchor, lit);
+    op += lit;
+    *op++ = (unsigned char) ((ip - ref) & 0xff);
+    *op++ = (unsigned char) ((ip - ref) >> 8);
+    if (mlen >= 15) {
+      op = lz_write_length(op, mlen - 15);
+    }
+
+    ip += len;
+    anchor = ip;
+  }
+
+  // The remaining bytes are literals.
+  int lit = n - anchor;
+  *op++ = (unsigned char) ((lit < 15 ? lit : 15) << 4);
+  if (lit >= 15) {
+    op = lz_write_length(op, lit - 15);
+  }
+  memcpy(op, in + anchor, lit);
+  op += lit;
+
+  free(table);
+  return op - out;
+}
+
+/**
+ * Decompresses a block compressed by lz_compress().
+ *
+ * @param unsigned char * in
+ *   The compressed bytes.
+ * @param int in_size
+ *   The number of compressed bytes.
+ * @param unsigned char * out
+ *   Receives the decompressed bytes.
+ * @param int out_size
+ *   The size of out.
+ *
+ * @return int
+ *   The decompressed size or -1 if the block is corrupt.
+ */
+int lz_decompress(unsigned char * in, int in_size, unsigned char * out, int out_size) {
+  int ip = 0;
+  int op = 0;
+
+  while (ip < in_size) {
+    int token = in[ip++];
+
+    // The literals.
+    int lit = token >> 4;
+    if (lit == 15) {
+      int b;
+      do {
+        if (ip >= in_size) {
+          return -1;
+        }
+        b = in[ip++];
+        lit += b;
+      } while (b == 255);
+    }
+    if (lit > in_size - ip || lit > out_size - op) {
+      return -1;
+    }
+    memcpy(out + op, in + ip, lit);
+    ip += lit;
+    op += lit;
+
+    // The last sequence has no match.
+    if (ip >= in_size) {
+      break;
+    }
+
+    // The match.
+    if (in_size - ip < 2) {
+      return -1;
+    }
+    int dist = in[ip] | (in[ip + 1] << 8);
+    ip += 2;
+    int len = token & 15;
+    if (len == 15) {
+      int b;
+      do {
+        if (ip >= in_size) {
+          return -1;
+        }
+        b = in[ip++];
+        len += b;
+      } while (b == 255);
+    }
+    len += LZ_MIN_MATCH;
+    if (dist == 0 || dist > op || len > out_size - op) {
+      return -1;
+    }
+    // The match may overlap the bytes it produces, so copy byte by byte.
+    unsigned char * src = out + op - dist;
+    for (int i = 0; i < len; i++) {
+      out[op + i] = src[i];
+    }
+    op += len;
+  }
+  return op;
+}
+
+/**
+ * Groups the i-th byte of every value together.  The high bytes of similar
+ * numbers repeat and are then found as matches by the codec.
+ *
+ * @param unsigned char * in
+ *   n values of size bytes each.
+ * @param int n
+ *   The number of values.
+ * @param int size
+ *   The size of each value in bytes.
+ * @param unsigned char * out
+ *   Receives the shuffled bytes.
+ */
+void byte_shuffle(unsigned char * in, int n, int size, unsigned char * out) {
+  for (int i = 0; i < n; i++) {
+    for (int b = 0; b < size; b++) {
+      out[b * n + i] = in[i * size + b];
+    }
+  }
+}
+
+/**
+ * Reverses byte_shuffle().
+ *
+ * @param unsigned char * in
+ * @param int n
+ * @param int size
+ * @param unsigned char * out
+ */
+void byte_unshuffle(unsigned char * in, int n, int size, unsigned char * out) {
+  for (int i = 0; i < n; i++) {
+    for (int b = 0; b < size; b++) {
+      out[i * size + b] = in[b * n + i];
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef _LZ_
+#define _LZ_
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A small LZ77 codec for compressing blocks of a similarity matrix.
+ *
+ * The compressed data is a series of sequences.  Each starts with a token
+ * byte whose high four bits are the number of literal bytes and whose low
+ * four bits are the match length minus LZ_MIN_MATCH.  A value of 15 is
+ * followed by more length bytes, each added to it, until a byte below 255.
+ * The literals come next, then the two-byte (little endian) distance back
+ * to the start of the match.  The last sequence has only literals.
+ */
+
+// The shortest match that is encoded.
+#define LZ_MIN_MATCH 4
+
+// Retrieves the largest possible compressed size of n bytes.
+int lz_bound(int n);
+// Compresses n bytes. Returns the compressed size.
+int lz_compress(unsigned char * in, int n, unsigned char * out);
+// Decompresses a block. Returns the decompressed size or -1 if the block
+// is corrupt or does not fit.
+int lz_decompress(unsigned char * in, int in_size, unsigned char * out, int out_size);
+
+// Groups the i-th byte of every value together, which makes arrays of
+// numbers easier to compress.
+void byte_shuffle(unsigned char * in, int n, int size, unsigned char * out);
+void byte_unshuffle(unsigned char * in, int n, int size, unsigned char * out);
+
+#endif
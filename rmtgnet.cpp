@@ -9,8 +9,10 @@ void print_usage() {
   printf("Usage: ./rmtgnet [command]\n");
   printf("Available commands:\n");
   printf("  similarity  Performs pair-wise similarity calculations using an input expression matrix.\n");
+  printf("  update      Adds new samples to a Pearson similarity matrix.\n");
   printf("  threshold   Identifies a threshold for cutting the similarity matrix\n");
   printf("  extract     Outputs the network edges file\n");
+  printf("  convert     Converts a similarity matrix to another file format\n");
   printf("  help        Prints these instructions. Include the command to print help\n");
   printf("              for a specific command (e.g. rmtgnet help similarity)\n");
   printf("\n");
@@ -39,6 +41,12 @@ int main(int argc, char *argv[]) {
     similarity->execute();
     delete similarity;
   }
+  // add new samples to an existing similarity matrix
+  else if (strcmp(argv[1], "update") == 0) {
+    RunUpdate * update = new RunUpdate(argc, argv);
+    update->execute();
+    delete update;
+  }
   // identify the threshold for cutting the similarity matrix
   else if (strcmp(argv[1], "threshold") == 0) {
     RunThreshold * threshold = new RunThreshold(argc, argv);
@@ -51,18 +59,30 @@ int main(int argc, char *argv[]) {
     extract->execute();
     delete extract;
   }
+  // convert a similarity matrix to another file format
+  else if (strcmp(argv[1], "convert") == 0) {
+    RunConvert * convert = new RunConvert(argc, argv);
+    convert->execute();
+    delete convert;
+  }
   // print help documentation
   else if (strcmp(argv[1], "help") == 0) {
     if (argc == 3) {
       if (strcmp(argv[2], "similarity") == 0) {
         RunSimilarity::printUsage();
       }
+      if (strcmp(argv[2], "update") == 0) {
+        RunUpdate::printUsage();
+      }
       if (strcmp(argv[2], "threshold") == 0) {
         RunThreshold::printUsage();
       }
       if (strcmp(argv[2], "extract") == 0) {
         RunExtract::printUsage();
       }
+      if (strcmp(argv[2], "convert") == 0) {
+        RunConvert::printUsage();
+      }
     }
     else {
       print_usage();
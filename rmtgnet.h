@@ -5,8 +5,10 @@
 #include <string.h>
 
 #include "similarity/RunSimilarity.h"
+#include "similarity/RunUpdate.h"
 #include "threshold/RunThreshold.h"
 #include "extract/RunExtract.h"
+#include "convert/RunConvert.h"
 
 /**
  * Function prototypes
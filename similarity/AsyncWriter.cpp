@@ -0,0 +1,182 @@
+#include "AsyncWriter.h"
+
+/**
+ * Constructor.  Starts the I/O thread.
+ *
+ * @param int fd
+ *   The file descriptor to write to.
+ * @param long long int offset
+ *   The file offset of the first byte.
+ * @param char * name
+ *   The name of the file, used in messages.
+ */
+AsyncWriter::AsyncWriter(int fd, long long int offset, char * name) {
+  this->fd = fd;
+  this->name = strdup(name);
+  this->offset = offset;
+  this->fill = 0;
+  this->fill_size = 0;
+  this->drain = 0;
+  this->done = 0;
+  this->num_bytes = 0;
+  this->write_time = 0;
+  this->num_waits = 0;
+  this->wait_time = 0;
+  this->start_time = now();
+
+  for (int i = 0; i < ASYNC_WRITER_NUM_BUFFERS; i++) {
+    void * buffer;
+    if (posix_memalign(&buffer, 4096, ASYNC_WRITER_BUFFER_SIZE) != 0) {
+      fprintf(stderr, "ERROR: cannot allocate the output buffers for '%s'.\n", name);
+      exit(-1);
+    }
+    buffers[i] = (unsigned char *) buffer;
+    pending[i] = 0;
+    offsets[i] = 0;
+  }
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&cond, NULL);
+  pthread_create(&thread, NULL, ioThread, this);
+}
+
+/**
+ * Destructor.
+ */
+AsyncWriter::~AsyncWriter() {
+  if (!done) {
+    close();
+  }
+  for (int i = 0; i < ASYNC_WRITER_NUM_BUFFERS; i++) {
+    free(buffers[i]);
+  }
+  pthread_mutex_destroy(&lock);
+  pthread_cond_destroy(&cond);
+  free(name);
+}
+
+/**
+ * Retrieves the current time in seconds.
+ *
+ * @return double
+ */
+double AsyncWriter::now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * Adds bytes to the end of the stream.
+ *
+ * @param void * data
+ * @param int size
+ */
+void AsyncWriter::write(void * data, int size) {
+  unsigned char * bytes = (unsigned char *) data;
+
+  while (size > 0) {
+    int n = ASYNC_WRITER_BUFFER_SIZE - fill_size;
+    if (n > size) {
+      n = size;
+    }
+    memcpy(buffers[fill] + fill_size, bytes, n);
+    fill_size += n;
+    bytes += n;
+    size -= n;
+    if (fill_size == ASYNC_WRITER_BUFFER_SIZE) {
+      handOver();
+    }
+  }
+}
+
+/**
+ * Hands the current buffer to the I/O thread and waits until the next
+ * buffer is free.
+ */
+void AsyncWriter::handOver() {
+  pthread_mutex_lock(&lock);
+  pending[fill] = fill_size;
+  offsets[fill] = offset;
+  offset += fill_size;
+  fill = (fill + 1) % ASYNC_WRITER_NUM_BUFFERS;
+  fill_size = 0;
+  pthread_cond_broadcast(&cond);
+
+  if (pending[fill] > 0) {
+    double start = now();
+    num_waits++;
+    while (pending[fill] > 0) {
+      pthread_cond_wait(&cond, &lock);
+    }
+    wait_time += now() - start;
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Writes the pending buffers, in order, until the writer is closed.
+ *
+ * @param void * arg
+ *   The AsyncWriter.
+ */
+void * AsyncWriter::ioThread(void * arg) {
+  AsyncWriter * w = (AsyncWriter *) arg;
+
+  pthread_mutex_lock(&w->lock);
+  while (1) {
+    while (w->pending[w->drain] == 0 && !w->done) {
+      pthread_cond_wait(&w->cond, &w->lock);
+    }
+    if (w->pending[w->drain] == 0) {
+      break;
+    }
+    unsigned char * buffer = w->buffers[w->drain];
+    long long int size = w->pending[w->drain];
+    long long int pos = w->offsets[w->drain];
+    pthread_mutex_unlock(&w->lock);
+
+    double start = now();
+    while (size > 0) {
+      ssize_t n = pwrite(w->fd, buffer, size, pos);
+      if (n <= 0) {
+        fprintf(stderr, "ERROR: could not write to '%s'.\n", w->name);
+        exit(-1);
+      }
+      buffer += n;
+      size -= n;
+      pos += n;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->write_time += now() - start;
+    w->num_bytes += w->pending[w->drain];
+    w->pending[w->drain] = 0;
+    w->drain = (w->drain + 1) % ASYNC_WRITER_NUM_BUFFERS;
+    pthread_cond_broadcast(&w->cond);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+/**
+ * Writes the remaining bytes, waits for the I/O thread to finish and
+ * reports the statistics of the writer.
+ */
+void AsyncWriter::close() {
+  if (fill_size > 0) {
+    handOver();
+  }
+  pthread_mutex_lock(&lock);
+  done = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+  pthread_join(thread, NULL);
+
+  double elapsed = now() - start_time;
+  double mb = num_bytes / (1024.0 * 1024.0);
+  printf("  Wrote %.1f MB to %s in %.2f s (%.1f MB/s while writing).\n", mb, name, elapsed,
+      write_time > 0 ? mb / write_time : 0);
+  if (num_waits > 0) {
+    printf("  The calculation waited %d times for the disk (%.2f s).\n", num_waits, wait_time);
+  }
+}
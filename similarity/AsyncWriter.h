@@ -0,0 +1,78 @@
+#ifndef _ASYNCWRITER_
+#define _ASYNCWRITER_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+// The size of each buffer and the number of buffers of a writer.
+#define ASYNC_WRITER_BUFFER_SIZE (4 * 1024 * 1024)
+#define ASYNC_WRITER_NUM_BUFFERS 4
+
+/**
+ * Writes a sequential stream of bytes to a file from a separate thread.
+ *
+ * The bytes are collected in large, page aligned buffers.  A full buffer is
+ * handed to the I/O thread, which writes it with pwrite() at its place in
+ * the file, while the calculation continues in the next buffer.  Only when
+ * every buffer is waiting to be written does the calculation wait for the
+ * disk.  The number of bytes, the write throughput and the time spent
+ * waiting are reported when the writer is closed.
+ *
+ * The file must not be written through other handles until the writer is
+ * closed.
+ */
+class AsyncWriter {
+
+  private:
+    // The file descriptor and its name, for messages.
+    int fd;
+    char * name;
+    // The buffers and the number of bytes of each that are waiting to be
+    // written, or 0 if the buffer is free.
+    unsigned char * buffers[ASYNC_WRITER_NUM_BUFFERS];
+    int pending[ASYNC_WRITER_NUM_BUFFERS];
+    // The file offset of each pending buffer.
+    long long int offsets[ASYNC_WRITER_NUM_BUFFERS];
+    // The buffer being filled and the number of bytes in it.
+    int fill;
+    int fill_size;
+    // The buffer the I/O thread writes next.
+    int drain;
+    // The file offset of the next byte.
+    long long int offset;
+    // Set once no more buffers will be handed over.
+    int done;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Statistics: the bytes written, the time the I/O thread spent writing,
+    // the number of times and the time the calculation waited for a free
+    // buffer, and the start time.
+    long long int num_bytes;
+    double write_time;
+    int num_waits;
+    double wait_time;
+    double start_time;
+
+    void handOver();
+    static void * ioThread(void * arg);
+    static double now();
+
+  public:
+    AsyncWriter(int fd, long long int offset, char * name);
+    ~AsyncWriter();
+
+    // Adds bytes to the end of the stream.
+    void write(void * data, int size);
+    // Writes the remaining bytes and waits for the I/O thread to finish.
+    void close();
+    // Retrieves the file offset of the next byte.
+    long long int getOffset() { return offset + fill_size; }
+};
+
+#endif
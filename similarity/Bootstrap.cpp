@@ -0,0 +1,248 @@
+#include "Bootstrap.h"
+
+/**
+ * Constructor.
+ *
+ * @param EMatrix * ematrix
+ *   The expression matrix.
+ * @param int num_reps
+ *   The number of bootstrap replicates.
+ * @param int min_obs
+ *   The minimum number of observations (counting repeated samples) that a
+ *   replicate must have.
+ * @param double cutoff
+ *   The absolute correlation at which a replicate includes the edge. Set
+ *   to NaN if the edge frequency is not needed.
+ */
+Bootstrap::Bootstrap(EMatrix * ematrix, int num_reps, int min_obs, double cutoff) {
+  this->num_genes = ematrix->getNumGenes();
+  this->num_samples = ematrix->getNumSamples();
+  this->num_reps = num_reps;
+  this->min_obs = min_obs;
+  this->cutoff = cutoff;
+
+  // Correlation does not change when a gene is shifted, so center every
+  // gene on its mean to keep the sums small.
+  centered = (double **) malloc(sizeof(double *) * num_genes);
+  complete = (int *) malloc(sizeof(int) * num_genes);
+  for (int j = 0; j < num_genes; j++) {
+    double * x = ematrix->getRow(j);
+    double sum = 0;
+    int m = 0;
+    complete[j] = 1;
+    for (int s = 0; s < num_samples; s++) {
+      if (isnan(x[s]) || isinf(x[s])) {
+        complete[j] = 0;
+        continue;
+      }
+      sum += x[s];
+      m++;
+    }
+    double mean = m > 0 ? sum / m : 0;
+    centered[j] = (double *) malloc(sizeof(double) * num_samples);
+    for (int s = 0; s < num_samples; s++) {
+      centered[j][s] = x[s] - mean;
+    }
+  }
+
+  n = (double *) malloc(sizeof(double) * num_reps);
+  sx = (double *) malloc(sizeof(double) * num_reps);
+  sy = (double *) malloc(sizeof(double) * num_reps);
+  sxx = (double *) malloc(sizeof(double) * num_reps);
+  syy = (double *) malloc(sizeof(double) * num_reps);
+  sxy = (double *) malloc(sizeof(double) * num_reps);
+
+  printf("  Drawing %d bootstrap replicates...\n", num_reps);
+  drawReplicates();
+  sumGenes();
+}
+
+/**
+ * Destructor.
+ */
+Bootstrap::~Bootstrap() {
+  for (int j = 0; j < num_genes; j++) {
+    free(centered[j]);
+  }
+  free(centered);
+  free(complete);
+  free(weights);
+  free(gene_sum);
+  free(gene_sum2);
+  free(full_n);
+  free(n);
+  free(sx);
+  free(sy);
+  free(sxx);
+  free(syy);
+  free(sxy);
+}
+
+/**
+ * Draws the samples of each replicate with replacement.
+ */
+void Bootstrap::drawReplicates() {
+  // A private random number state with a fixed seed keeps the replicates
+  // reproducible between runs and independent of other random draws.
+  unsigned short xsubi[3] = {0x330E, 1, 0};
+
+  weights = (double *) calloc((long long int) num_samples * num_reps, sizeof(double));
+  for (int b = 0; b < num_reps; b++) {
+    for (int i = 0; i < num_samples; i++) {
+      int s = (int) (erand48(xsubi) * num_samples);
+      weights[(long long int) s * num_reps + b] += 1;
+    }
+  }
+}
+
+/**
+ * Calculates the weighted sums of each replicate that only depend on a
+ * single gene.
+ */
+void Bootstrap::sumGenes() {
+  full_n = (double *) calloc(num_reps, sizeof(double));
+  gene_sum = (double *) calloc((long long int) num_genes * num_reps, sizeof(double));
+  gene_sum2 = (double *) calloc((long long int) num_genes * num_reps, sizeof(double));
+
+  for (int s = 0; s < num_samples; s++) {
+    double * w = &weights[(long long int) s * num_reps];
+    for (int b = 0; b < num_reps; b++) {
+      full_n[b] += w[b];
+    }
+  }
+  for (int j = 0; j < num_genes; j++) {
+    if (!complete[j]) {
+      continue;
+    }
+    double * gs = &gene_sum[(long long int) j * num_reps];
+    double * gs2 = &gene_sum2[(long long int) j * num_reps];
+    for (int s = 0; s < num_samples; s++) {
+      double * w = &weights[(long long int) s * num_reps];
+      double x = centered[j][s];
+      for (int b = 0; b < num_reps; b++) {
+        gs[b] += w[b] * x;
+        gs2[b] += w[b] * x * x;
+      }
+    }
+  }
+}
+
+/**
+ * Calculates Pearson's correlation of each replicate for a pair of genes
+ * and summarizes them.
+ *
+ * @param PairWiseSet * pwset
+ *   The pair of genes.  Only the samples it uses are drawn.
+ * @param double * mean
+ *   Upon return, the mean correlation of the replicates.
+ * @param double * var
+ *   Upon return, the variance of the correlation between the replicates.
+ * @param double * freq
+ *   Upon return, the fraction of the replicates with an absolute
+ *   correlation at or above the cutoff.
+ *
+ * Replicates with fewer than min_obs observations, or in which a gene is
+ * constant, are left out.  All values are NaN if the pair itself has too
+ * few observations or no replicate remains.
+ */
+void Bootstrap::run(PairWiseSet * pwset, double * mean, double * var, double * freq) {
+  int j = pwset->gene1;
+  int k = pwset->gene2;
+  double * x = centered[j];
+  double * y = centered[k];
+  double * pn, * psx, * psy, * psxx, * psyy;
+  int b, s;
+
+  *mean = NAN;
+  *var = NAN;
+  *freq = NAN;
+  if (pwset->n_clean < min_obs) {
+    return;
+  }
+
+  for (b = 0; b < num_reps; b++) {
+    sxy[b] = 0;
+  }
+  if (complete[j] && complete[k]) {
+    // Both genes use every sample, so only the products are needed.
+    for (s = 0; s < num_samples; s++) {
+      double * w = &weights[(long long int) s * num_reps];
+      double xy = x[s] * y[s];
+      for (b = 0; b < num_reps; b++) {
+        sxy[b] += w[b] * xy;
+      }
+    }
+    pn = full_n;
+    psx = &gene_sum[(long long int) j * num_reps];
+    psy = &gene_sum[(long long int) k * num_reps];
+    psxx = &gene_sum2[(long long int) j * num_reps];
+    psyy = &gene_sum2[(long long int) k * num_reps];
+  }
+  else {
+    for (b = 0; b < num_reps; b++) {
+      n[b] = 0;
+      sx[b] = 0;
+      sy[b] = 0;
+      sxx[b] = 0;
+      syy[b] = 0;
+    }
+    for (s = 0; s < num_samples; s++) {
+      if (pwset->samples[s] != 1) {
+        continue;
+      }
+      double * w = &weights[(long long int) s * num_reps];
+      double xs = x[s];
+      double ys = y[s];
+      for (b = 0; b < num_reps; b++) {
+        n[b] += w[b];
+        sx[b] += w[b] * xs;
+        sy[b] += w[b] * ys;
+        sxx[b] += w[b] * xs * xs;
+        syy[b] += w[b] * ys * ys;
+        sxy[b] += w[b] * xs * ys;
+      }
+    }
+    pn = n;
+    psx = sx;
+    psy = sy;
+    psxx = sxx;
+    psyy = syy;
+  }
+
+  // Summarize the replicates.
+  int num_valid = 0;
+  int num_above = 0;
+  double sum = 0;
+  double sum2 = 0;
+  for (b = 0; b < num_reps; b++) {
+    if (pn[b] < min_obs) {
+      continue;
+    }
+    double va = pn[b] * psxx[b] - psx[b] * psx[b];
+    double vb = pn[b] * psyy[b] - psy[b] * psy[b];
+    if (va <= 0 || vb <= 0) {
+      continue;
+    }
+    double r = (pn[b] * sxy[b] - psx[b] * psy[b]) / sqrt(va * vb);
+    num_valid++;
+    sum += r;
+    sum2 += r * r;
+    if (fabs(r) >= cutoff) {
+      num_above++;
+    }
+  }
+  if (num_valid == 0) {
+    return;
+  }
+  *mean = sum / num_valid;
+  *var = 0;
+  if (num_valid > 1) {
+    *var = (sum2 - sum * sum / num_valid) / (num_valid - 1);
+    if (*var < 0) {
+      *var = 0;
+    }
+  }
+  if (!isnan(cutoff)) {
+    *freq = num_above / (double) num_valid;
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef _BOOTSTRAP_
+#define _BOOTSTRAP_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../ematrix/EMatrix.h"
+#include "PairWiseSet.h"
+
+/**
+ * Calculates bootstrap replicates of Pearson's correlation for every pair.
+ *
+ * Each replicate draws the samples with replacement.  A replicate is stored
+ * as the number of times each sample was drawn, so the correlation of a
+ * replicate is a weighted correlation of the original samples.  The weights
+ * are stored sample by sample with the replicates next to each other, which
+ * lets the compiler vectorize the loop over the replicates.
+ *
+ * The sums that only depend on one gene are calculated once per gene for
+ * genes without missing values. For a pair of such genes only the sum of
+ * the products has to be calculated.
+ */
+class Bootstrap {
+
+  private:
+    // The number of genes and samples.
+    int num_genes;
+    int num_samples;
+    // The number of bootstrap replicates.
+    int num_reps;
+    // The minimum number of observations in a replicate.
+    int min_obs;
+    // The absolute correlation used for the edge frequency or NaN.
+    double cutoff;
+
+    // The mean centered expression values of each gene.
+    double ** centered;
+    // The number of times each sample is drawn by each replicate: the
+    // weight of sample s in replicate b is weights[s * num_reps + b].
+    double * weights;
+    // Set to 1 for genes without missing values.
+    int * complete;
+    // For complete genes, the weighted sum and sum of squares of each
+    // replicate, num_reps per gene.
+    double * gene_sum;
+    double * gene_sum2;
+    // The number of observations in each replicate when no sample is
+    // missing.
+    double * full_n;
+
+    // Work arrays for the sums of a pair, num_reps each.
+    double * n;
+    double * sx;
+    double * sy;
+    double * sxx;
+    double * syy;
+    double * sxy;
+
+    void drawReplicates();
+    void sumGenes();
+
+  public:
+    Bootstrap(EMatrix * ematrix, int num_reps, int min_obs, double cutoff);
+    ~Bootstrap();
+
+    // Calculates the replicates of a pair and summarizes them.
+    void run(PairWiseSet * pwset, double * mean, double * var, double * freq);
+};
+
+#endif
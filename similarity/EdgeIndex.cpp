@@ -0,0 +1,362 @@
+#include "EdgeIndex.h"
+
+// The number of pairs read from the index at a time.
+#define EDGE_INDEX_CHUNK 65536
+
+/**
+ * Constructor.  Opens the index, building it first if needed.
+ *
+ * @param char * dir
+ *   The directory of the similarity matrix.
+ * @param char * prefix
+ *   The file prefix of the similarity matrix.
+ * @param char * method
+ *   The similarity method.
+ * @param SimMatrixReader * reader
+ *   The similarity matrix, read if the index must be built.
+ * @param float floor
+ *   The lowest absolute score the index must hold.
+ */
+EdgeIndex::EdgeIndex(char * dir, char * prefix, char * method, SimMatrixReader * reader, float floor) {
+  this->fh = NULL;
+  this->floor = floor;
+  this->num_genes = 0;
+  this->num_edges = 0;
+  this->edges = NULL;
+  this->num_read = 0;
+  this->capacity = 0;
+
+  getFileName(dir, prefix, method, filename);
+  if (!isCurrent(dir, prefix, method, reader->getNumGenes(), floor)) {
+    build(reader, floor);
+  }
+  open();
+}
+
+/**
+ * Constructor.  Opens an existing index without a similarity matrix.
+ *
+ * @param char * dir
+ *   The directory of the index.
+ * @param char * prefix
+ *   The file prefix of the similarity matrix.
+ * @param char * method
+ *   The similarity method.
+ */
+EdgeIndex::EdgeIndex(char * dir, char * prefix, char * method) {
+  this->fh = NULL;
+  this->floor = 0;
+  this->num_genes = 0;
+  this->num_edges = 0;
+  this->edges = NULL;
+  this->num_read = 0;
+  this->capacity = 0;
+
+  getFileName(dir, prefix, method, filename);
+  open();
+}
+
+/**
+ * Constructor.  Keeps the pairs in memory only, without an index file.
+ *
+ * @param SimMatrixReader * reader
+ *   The similarity matrix.
+ * @param float floor
+ *   The lowest absolute score to keep.
+ */
+EdgeIndex::EdgeIndex(SimMatrixReader * reader, float floor) {
+  this->fh = NULL;
+  this->filename[0] = '\0';
+  this->floor = floor;
+  this->num_genes = reader->getNumGenes();
+
+  printf("  Reading the pairs of at least %f into memory...\n", floor);
+  this->edges = collect(reader, floor, &num_edges);
+  this->num_read = num_edges;
+  this->capacity = num_edges;
+  printf("  Keeping %lld pairs (%.1f MB) in memory.\n", num_edges,
+      num_edges * sizeof(edge_index_edge_t) / (1024.0 * 1024.0));
+}
+
+/**
+ * Destructor.
+ */
+EdgeIndex::~EdgeIndex() {
+  if (fh) {
+    fclose(fh);
+  }
+  free(edges);
+}
+
+/**
+ * Indicates if the index file exists, is complete, is at least as recent
+ * as the similarity matrix and holds every pair down to the floor.
+ *
+ * @param char * dir
+ * @param char * prefix
+ * @param char * method
+ * @param int num_genes
+ *   The number of genes of the similarity matrix.
+ * @param float floor
+ *
+ * @return int
+ */
+int EdgeIndex::isCurrent(char * dir, char * prefix, char * method, int num_genes, float floor) {
+  edge_index_header_t header;
+  char matrix_file[1024];
+  struct stat index_stat;
+  struct stat matrix_stat;
+
+  SimMatrixReader::getFileName(dir, prefix, method, matrix_file);
+  if (stat(filename, &index_stat) != 0 || stat(matrix_file, &matrix_stat) != 0 ||
+      index_stat.st_mtime < matrix_stat.st_mtime) {
+    return 0;
+  }
+
+  FILE * f = fopen(filename, "rb");
+  if (!f) {
+    return 0;
+  }
+  int ok = fread(&header, sizeof(header), 1, f) == 1 &&
+      memcmp(header.magic, EDGE_INDEX_MAGIC, 8) == 0 &&
+      header.version == EDGE_INDEX_VERSION &&
+      header.num_genes == num_genes &&
+      header.floor <= floor;
+  fclose(f);
+  return ok;
+}
+
+/**
+ * Orders pairs by decreasing absolute score.  Ties are ordered by row and
+ * column so the index does not depend on the sort.
+ */
+static int compare_edges(const void * a, const void * b) {
+  edge_index_edge_t * ea = (edge_index_edge_t *) a;
+  edge_index_edge_t * eb = (edge_index_edge_t *) b;
+  float sa = fabsf(ea->score);
+  float sb = fabsf(eb->score);
+
+  if (sa != sb) {
+    return sa > sb ? -1 : 1;
+  }
+  if (ea->i != eb->i) {
+    return ea->i < eb->i ? -1 : 1;
+  }
+  return ea->j < eb->j ? -1 : (ea->j > eb->j ? 1 : 0);
+}
+
+// The pairs found by each thread while the index is built.
+typedef struct {
+  float floor;
+  long long int * num_edges;
+  long long int * sizes;
+  edge_index_edge_t ** edges;
+} edge_index_build_t;
+
+/**
+ * Collects the pairs of a row that are at least the floor.  Called by
+ * SimMatrixReader::scanRows().
+ */
+static void collect_row(int i, float * row, int thread, void * arg) {
+  edge_index_build_t * b = (edge_index_build_t *) arg;
+
+  for (int j = 0; j < i; j++) {
+    if (fabsf(row[j]) >= b->floor) {
+      long long int n = b->num_edges[thread];
+      if (n == b->sizes[thread]) {
+        b->sizes[thread] *= 2;
+        b->edges[thread] = (edge_index_edge_t *) realloc(b->edges[thread], sizeof(edge_index_edge_t) * b->sizes[thread]);
+      }
+      b->edges[thread][n].i = i;
+      b->edges[thread][n].j = j;
+      b->edges[thread][n].score = row[j];
+      b->num_edges[thread] = n + 1;
+    }
+  }
+}
+
+/**
+ * Finds the pairs of the similarity matrix that are at least the floor and
+ * sorts them.  The rows are scanned by several threads, each collecting its
+ * own pairs.
+ *
+ * @param SimMatrixReader * reader
+ * @param float floor
+ * @param long long int * num_edges
+ *   Set to the number of pairs.
+ *
+ * @return edge_index_edge_t *
+ */
+edge_index_edge_t * EdgeIndex::collect(SimMatrixReader * reader, float floor, long long int * num_edges) {
+  int num_threads = reader->getNumThreads();
+  edge_index_build_t b;
+
+  b.floor = floor;
+  b.num_edges = (long long int *) calloc(num_threads, sizeof(long long int));
+  b.sizes = (long long int *) malloc(sizeof(long long int) * num_threads);
+  b.edges = (edge_index_edge_t **) malloc(sizeof(edge_index_edge_t *) * num_threads);
+  for (int t = 0; t < num_threads; t++) {
+    b.sizes[t] = EDGE_INDEX_CHUNK;
+    b.edges[t] = (edge_index_edge_t *) malloc(sizeof(edge_index_edge_t) * b.sizes[t]);
+  }
+  reader->scanRows(floor, collect_row, &b);
+
+  long long int n = 0;
+  for (int t = 0; t < num_threads; t++) {
+    n += b.num_edges[t];
+  }
+  edge_index_edge_t * all = (edge_index_edge_t *) malloc(sizeof(edge_index_edge_t) * (n > 0 ? n : 1));
+  n = 0;
+  for (int t = 0; t < num_threads; t++) {
+    memcpy(all + n, b.edges[t], sizeof(edge_index_edge_t) * b.num_edges[t]);
+    n += b.num_edges[t];
+    free(b.edges[t]);
+  }
+  free(b.edges);
+  free(b.sizes);
+  free(b.num_edges);
+  qsort(all, n, sizeof(edge_index_edge_t), compare_edges);
+
+  *num_edges = n;
+  return all;
+}
+
+/**
+ * Builds the index file from the similarity matrix.
+ *
+ * @param SimMatrixReader * reader
+ * @param float floor
+ */
+void EdgeIndex::build(SimMatrixReader * reader, float floor) {
+  edge_index_header_t header;
+  int num_genes = reader->getNumGenes();
+  long long int n;
+
+  printf("  Building edge index: %s (floor %f)...\n", filename, floor);
+  edge_index_edge_t * all = collect(reader, floor, &n);
+
+  FILE * f = fopen(filename, "wb");
+  if (!f) {
+    fprintf(stderr, "ERROR: could not open edge index file: '%s'\n", filename);
+    exit(-1);
+  }
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, f);
+  if (fwrite(all, sizeof(edge_index_edge_t), n, f) != (size_t) n) {
+    fprintf(stderr, "ERROR: could not write edge index file: '%s'\n", filename);
+    exit(-1);
+  }
+  memcpy(header.magic, EDGE_INDEX_MAGIC, 8);
+  header.version = EDGE_INDEX_VERSION;
+  header.num_genes = num_genes;
+  header.floor = floor;
+  header.num_edges = n;
+  fseek(f, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, f);
+  fclose(f);
+  free(all);
+  printf("  Edge index holds %lld pairs.\n", n);
+}
+
+/**
+ * Opens the index file and reads its header.
+ */
+void EdgeIndex::open() {
+  edge_index_header_t header;
+
+  fh = fopen(filename, "rb");
+  if (!fh || fread(&header, sizeof(header), 1, fh) != 1 ||
+      memcmp(header.magic, EDGE_INDEX_MAGIC, 8) != 0 || header.version != EDGE_INDEX_VERSION) {
+    fprintf(stderr, "ERROR: cannot read edge index file: '%s'\n", filename);
+    exit(-1);
+  }
+  floor = header.floor;
+  num_genes = header.num_genes;
+  num_edges = header.num_edges;
+  printf("  Using edge index: %s (%lld pairs, floor %f)\n", filename, num_edges, floor);
+}
+
+/**
+ * Reads the next chunk of pairs from the index file.
+ */
+void EdgeIndex::readMore() {
+  long long int n = num_edges - num_read < EDGE_INDEX_CHUNK ? num_edges - num_read : EDGE_INDEX_CHUNK;
+
+  if (num_read + n > capacity) {
+    capacity = capacity == 0 ? EDGE_INDEX_CHUNK : capacity * 2;
+    edges = (edge_index_edge_t *) realloc(edges, sizeof(edge_index_edge_t) * capacity);
+  }
+  if (fread(edges + num_read, sizeof(edge_index_edge_t), n, fh) != (size_t) n) {
+    fprintf(stderr, "ERROR: cannot read edge index file: '%s'\n", filename);
+    exit(-1);
+  }
+  num_read += n;
+}
+
+/**
+ * Retrieves the pairs whose absolute score is larger than a threshold.  Only
+ * the part of the index that was not needed for a higher threshold is read.
+ *
+ * @param float th
+ *   The threshold. It must not be lower than the floor of the index.
+ * @param edge_index_edge_t ** edges
+ *   Set to the pairs, sorted by decreasing absolute score. The array
+ *   belongs to the index and may move on the next call.
+ *
+ * @return long long int
+ *   The number of pairs, or -1 if the threshold is below the floor.
+ */
+long long int EdgeIndex::getEdges(float th, edge_index_edge_t ** edges) {
+  if (th < floor) {
+    return -1;
+  }
+  while (num_read < num_edges && (num_read == 0 || fabsf(this->edges[num_read - 1].score) > th)) {
+    readMore();
+  }
+
+  // Find the first pair that is not above the threshold.
+  long long int lo = 0;
+  long long int hi = num_read;
+  while (lo < hi) {
+    long long int mid = lo + (hi - lo) / 2;
+    if (fabsf(this->edges[mid].score) > th) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  *edges = this->edges;
+  return lo;
+}
+
+/**
+ * Retrieves every pair of the index.
+ *
+ * @param edge_index_edge_t ** edges
+ *   Set to the pairs, sorted by decreasing absolute score. The array
+ *   belongs to the index.
+ *
+ * @return long long int
+ *   The number of pairs.
+ */
+long long int EdgeIndex::getAllEdges(edge_index_edge_t ** edges) {
+  while (num_read < num_edges) {
+    readMore();
+  }
+  *edges = this->edges;
+  return num_read;
+}
+
+/**
+ * Sets the name of the index file of a similarity matrix.
+ *
+ * @param char * dir
+ * @param char * prefix
+ * @param char * method
+ * @param char * filename
+ *   Receives the file name.
+ */
+void EdgeIndex::getFileName(char * dir, char * prefix, char * method, char * filename) {
+  sprintf(filename, "%s/%s.%s.eidx", dir, prefix, method);
+}
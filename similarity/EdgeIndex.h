@@ -0,0 +1,104 @@
+#ifndef _EDGEINDEX_
+#define _EDGEINDEX_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "SimMatrixReader.h"
+
+// The magic string at the start of an edge index file.
+#define EDGE_INDEX_MAGIC "RMTGNEDG"
+// The version of the edge index format.
+#define EDGE_INDEX_VERSION 1
+
+/**
+ * The header of an edge index file.
+ */
+typedef struct {
+  // EDGE_INDEX_MAGIC, without a terminating NUL.
+  char magic[8];
+  int version;
+  // The number of genes of the similarity matrix.
+  int num_genes;
+  // Every pair whose absolute score is at least the floor is stored.
+  float floor;
+  // Unused. Set to zero.
+  int reserved1;
+  // The number of stored pairs.
+  long long int num_edges;
+  // Unused. Set to zero.
+  long long int reserved[4];
+} edge_index_header_t;
+
+/**
+ * A pair of genes and its score.  i is the row of the lower triangle and j
+ * the column, so i > j.
+ */
+typedef struct {
+  int i;
+  int j;
+  float score;
+} edge_index_edge_t;
+
+/**
+ * A sidecar index of the pairs of a similarity matrix with a high score.
+ *
+ * The file <dir>/<prefix>.<method>.eidx holds every pair whose absolute
+ * score is at least a floor, sorted by decreasing absolute score.  The pairs
+ * above any threshold that is not lower than the floor are then a prefix of
+ * the file.  As the threshold is lowered, only the next slice of the file
+ * is read, so the cost of a threshold search depends on the number of
+ * pairs above the floor rather than on the size of the matrix.
+ *
+ * The index is built from the matrix the first time it is needed, and
+ * again if it is older than the matrix or its floor is higher than the one
+ * requested.  The header is written last, so an incomplete file is
+ * rebuilt.
+ *
+ * The pairs can also be collected into memory only, without a file.
+ */
+class EdgeIndex {
+
+  private:
+    // The name of the index file.
+    char filename[1024];
+    FILE * fh;
+    // The floor, number of genes and number of pairs of the index.
+    float floor;
+    int num_genes;
+    long long int num_edges;
+    // The pairs read from the file so far.
+    edge_index_edge_t * edges;
+    long long int num_read;
+    long long int capacity;
+
+    int isCurrent(char * dir, char * prefix, char * method, int num_genes, float floor);
+    edge_index_edge_t * collect(SimMatrixReader * reader, float floor, long long int * num_edges);
+    void build(SimMatrixReader * reader, float floor);
+    void open();
+    void readMore();
+
+  public:
+    EdgeIndex(char * dir, char * prefix, char * method, SimMatrixReader * reader, float floor);
+    EdgeIndex(char * dir, char * prefix, char * method);
+    EdgeIndex(SimMatrixReader * reader, float floor);
+    ~EdgeIndex();
+
+    // Retrieves the floor of the index.
+    float getFloor() { return floor; }
+    // Retrieves the number of genes of the similarity matrix.
+    int getNumGenes() { return num_genes; }
+    // Retrieves the number of pairs in the index.
+    long long int getNumEdges() { return num_edges; }
+    // Retrieves the pairs whose absolute score is larger than th.
+    long long int getEdges(float th, edge_index_edge_t ** edges);
+    // Retrieves every pair of the index.
+    long long int getAllEdges(edge_index_edge_t ** edges);
+
+    // Sets the name of the index file.
+    static void getFileName(char * dir, char * prefix, char * method, char * filename);
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "GeneMaxIndex.h"
+
+/**
+ * Orders maxima from the largest down.
+ */
+static int compare_maxima(const void * a, const void * b) {
+  float fa = *(float *) a;
+  float fb = *(float *) b;
+  return fa > fb ? -1 : (fa < fb ? 1 : 0);
+}
+
+/**
+ * Constructor.  Loads the maxima, building the file first if needed.
+ *
+ * @param char * dir
+ *   The directory of the similarity matrix.
+ * @param char * prefix
+ *   The file prefix of the similarity matrix.
+ * @param char * method
+ *   The similarity method.
+ * @param SimMatrixReader * reader
+ *   The similarity matrix, read if the file must be built.
+ */
+GeneMaxIndex::GeneMaxIndex(char * dir, char * prefix, char * method, SimMatrixReader * reader) {
+  this->num_genes = reader->getNumGenes();
+  this->maxima = (float *) malloc(sizeof(float) * (num_genes > 0 ? num_genes : 1));
+  this->sorted = (float *) malloc(sizeof(float) * (num_genes > 0 ? num_genes : 1));
+  this->histogram = (long long int *) calloc(GENE_MAX_HIST_BINS, sizeof(long long int));
+
+  getFileName(dir, prefix, method, filename);
+  if (isCurrent(dir, prefix, method)) {
+    load();
+  }
+  else {
+    build(reader);
+  }
+
+  // Sort a copy of the maxima from the largest down.
+  memcpy(sorted, maxima, sizeof(float) * num_genes);
+  qsort(sorted, num_genes, sizeof(float), compare_maxima);
+}
+
+/**
+ * Destructor.
+ */
+GeneMaxIndex::~GeneMaxIndex() {
+  free(maxima);
+  free(sorted);
+  free(histogram);
+}
+
+/**
+ * Indicates if the file exists, is complete, is at least as recent as the
+ * similarity matrix and has the same number of genes.
+ *
+ * @param char * dir
+ * @param char * prefix
+ * @param char * method
+ *
+ * @return int
+ */
+int GeneMaxIndex::isCurrent(char * dir, char * prefix, char * method) {
+  gene_max_header_t header;
+  char matrix_file[1024];
+  struct stat index_stat;
+  struct stat matrix_stat;
+
+  SimMatrixReader::getFileName(dir, prefix, method, matrix_file);
+  if (stat(filename, &index_stat) != 0 || stat(matrix_file, &matrix_stat) != 0 ||
+      index_stat.st_mtime < matrix_stat.st_mtime) {
+    return 0;
+  }
+
+  FILE * f = fopen(filename, "rb");
+  if (!f) {
+    return 0;
+  }
+  int ok = fread(&header, sizeof(header), 1, f) == 1 &&
+      memcmp(header.magic, GENE_MAX_MAGIC, 8) == 0 &&
+      header.version == GENE_MAX_VERSION &&
+      header.num_genes == num_genes &&
+      header.num_bins == GENE_MAX_HIST_BINS;
+  fclose(f);
+  return ok;
+}
+
+// The maxima and histograms found by each thread while the file is built.
+typedef struct {
+  float ** maxima;
+  long long int ** histograms;
+} gene_max_build_t;
+
+/**
+ * Retrieves the histogram bin of an absolute similarity.  The bits of a
+ * positive float grow with its value, so the bins are in order.
+ */
+static int hist_bin(float v) {
+  unsigned int bits;
+
+  memcpy(&bits, &v, sizeof(bits));
+  return bits >> GENE_MAX_HIST_SHIFT;
+}
+
+/**
+ * Raises the maxima of the genes of a row and counts its values in the
+ * histogram.  Called by SimMatrixReader::scanRows().
+ */
+static void max_row(int j, float * row, int thread, void * arg) {
+  float * maxima = ((gene_max_build_t *) arg)->maxima[thread];
+  long long int * histogram = ((gene_max_build_t *) arg)->histograms[thread];
+
+  for (int k = 0; k < j; k++) {
+    float v = fabsf(row[k]);
+    if (isnan(v)) {
+      continue;
+    }
+    histogram[hist_bin(v)]++;
+    if (v > maxima[k]) {
+      maxima[k] = v;
+    }
+    if (v > maxima[j]) {
+      maxima[j] = v;
+    }
+  }
+}
+
+/**
+ * Finds the maxima in the similarity matrix and writes the file.  The rows
+ * are read by several threads, each with its own maxima.
+ *
+ * @param SimMatrixReader * reader
+ */
+void GeneMaxIndex::build(SimMatrixReader * reader) {
+  gene_max_header_t header;
+  int num_threads = reader->getNumThreads();
+  gene_max_build_t b;
+
+  printf("  Finding the largest similarity of every gene: %s...\n", filename);
+  b.maxima = (float **) malloc(sizeof(float *) * num_threads);
+  b.histograms = (long long int **) malloc(sizeof(long long int *) * num_threads);
+  for (int t = 0; t < num_threads; t++) {
+    b.maxima[t] = (float *) malloc(sizeof(float) * (num_genes > 0 ? num_genes : 1));
+    for (int i = 0; i < num_genes; i++) {
+      b.maxima[t][i] = -1;
+    }
+    b.histograms[t] = (long long int *) calloc(GENE_MAX_HIST_BINS, sizeof(long long int));
+  }
+  reader->scanRows(0, max_row, &b);
+
+  for (int i = 0; i < num_genes; i++) {
+    maxima[i] = -1;
+    for (int t = 0; t < num_threads; t++) {
+      if (b.maxima[t][i] > maxima[i]) {
+        maxima[i] = b.maxima[t][i];
+      }
+    }
+  }
+  for (int t = 0; t < num_threads; t++) {
+    for (int i = 0; i < GENE_MAX_HIST_BINS; i++) {
+      histogram[i] += b.histograms[t][i];
+    }
+    free(b.maxima[t]);
+    free(b.histograms[t]);
+  }
+  free(b.maxima);
+  free(b.histograms);
+
+  FILE * f = fopen(filename, "wb");
+  if (!f) {
+    fprintf(stderr, "ERROR: could not open gene maximum file: '%s'\n", filename);
+    exit(-1);
+  }
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, f);
+  if (fwrite(maxima, sizeof(float), num_genes, f) != (size_t) num_genes ||
+      fwrite(histogram, sizeof(long long int), GENE_MAX_HIST_BINS, f) != GENE_MAX_HIST_BINS) {
+    fprintf(stderr, "ERROR: could not write gene maximum file: '%s'\n", filename);
+    exit(-1);
+  }
+  memcpy(header.magic, GENE_MAX_MAGIC, 8);
+  header.version = GENE_MAX_VERSION;
+  header.num_genes = num_genes;
+  header.num_bins = GENE_MAX_HIST_BINS;
+  fseek(f, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, f);
+  fclose(f);
+}
+
+/**
+ * Reads the maxima from the file.
+ */
+void GeneMaxIndex::load() {
+  gene_max_header_t header;
+
+  FILE * f = fopen(filename, "rb");
+  if (!f || fread(&header, sizeof(header), 1, f) != 1 ||
+      fread(maxima, sizeof(float), num_genes, f) != (size_t) num_genes ||
+      fread(histogram, sizeof(long long int), GENE_MAX_HIST_BINS, f) != GENE_MAX_HIST_BINS) {
+    fprintf(stderr, "ERROR: cannot read gene maximum file: '%s'\n", filename);
+    exit(-1);
+  }
+  fclose(f);
+  printf("  Using the largest similarity of every gene: %s\n", filename);
+}
+
+/**
+ * Retrieves the number of genes whose largest absolute similarity is above
+ * a threshold.
+ *
+ * @param float th
+ *
+ * @return int
+ */
+int GeneMaxIndex::countAbove(float th) {
+  int lo = 0;
+  int hi = num_genes;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (sorted[mid] > th) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/**
+ * Retrieves the lowest floor for which the pairs whose absolute similarity
+ * is at least the floor number at most max_pairs.  The floor is the lower
+ * edge of a histogram bin.
+ *
+ * @param long long int max_pairs
+ * @param long long int * num_pairs
+ *   Set to the number of pairs at or above the floor.
+ *
+ * @return float
+ */
+float GeneMaxIndex::getFloor(long long int max_pairs, long long int * num_pairs) {
+  long long int n = 0;
+  int b = GENE_MAX_HIST_BINS;
+
+  while (b > 0 && n + histogram[b - 1] <= max_pairs) {
+    n += histogram[b - 1];
+    b--;
+  }
+  *num_pairs = n;
+  // Every pair fits, or not even the highest bin does.
+  if (b == 0) {
+    return 0;
+  }
+  if (b == GENE_MAX_HIST_BINS) {
+    return INFINITY;
+  }
+
+  unsigned int bits = (unsigned int) b << GENE_MAX_HIST_SHIFT;
+  float floor;
+  memcpy(&floor, &bits, sizeof(floor));
+  return floor;
+}
+
+/**
+ * Sets the name of the gene maximum file of a similarity matrix.
+ *
+ * @param char * dir
+ * @param char * prefix
+ * @param char * method
+ * @param char * filename
+ *   Receives the file name.
+ */
+void GeneMaxIndex::getFileName(char * dir, char * prefix, char * method, char * filename) {
+  sprintf(filename, "%s/%s.%s.gmax", dir, prefix, method);
+}
@@ -0,0 +1,88 @@
+#ifndef _GENEMAXINDEX_
+#define _GENEMAXINDEX_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "SimMatrixReader.h"
+
+// The magic string at the start of a gene maximum file.
+#define GENE_MAX_MAGIC "RMTGNMAX"
+// The version of the gene maximum format.
+#define GENE_MAX_VERSION 2
+// The histogram of absolute similarities has a bin for every float with
+// the same upper bits: GENE_MAX_HIST_SHIFT bits of the mantissa are left
+// out, so a bin is about 1/256th of its values wide.
+#define GENE_MAX_HIST_SHIFT 15
+#define GENE_MAX_HIST_BINS (1 << (31 - GENE_MAX_HIST_SHIFT))
+
+/**
+ * The header of a gene maximum file.
+ */
+typedef struct {
+  // GENE_MAX_MAGIC, without a terminating NUL.
+  char magic[8];
+  int version;
+  // The number of genes of the similarity matrix.
+  int num_genes;
+  // The number of bins of the histogram.
+  int num_bins;
+  // Unused. Set to zero.
+  int reserved1;
+  long long int reserved[5];
+} gene_max_header_t;
+
+/**
+ * A sidecar file with the largest absolute similarity of every gene.
+ *
+ * The file <dir>/<prefix>.<method>.gmax holds, for each gene, the largest
+ * absolute value of its row and column of the similarity matrix without the
+ * diagonal, or -1 if it has no values.  A gene is in the cut matrix of a
+ * threshold exactly when its maximum is above the threshold, so the genes
+ * of a cut matrix, and its size, are known without reading the matrix.
+ * The maxima are also kept sorted, so the size of a cut matrix is found
+ * with a binary search.
+ *
+ * The file also holds a histogram of the absolute similarities of all pairs,
+ * from which the number of pairs above any threshold can be estimated.
+ *
+ * The file is built from the matrix the first time it is needed, and again
+ * if it is older than the matrix.  The header is written last, so an
+ * incomplete file is rebuilt.
+ */
+class GeneMaxIndex {
+
+  private:
+    // The name of the file.
+    char filename[1024];
+    // The number of genes, the maximum of each and the maxima sorted from
+    // the largest down.
+    int num_genes;
+    float * maxima;
+    float * sorted;
+    // The number of pairs in each bin of the histogram.
+    long long int * histogram;
+
+    int isCurrent(char * dir, char * prefix, char * method);
+    void build(SimMatrixReader * reader);
+    void load();
+
+  public:
+    GeneMaxIndex(char * dir, char * prefix, char * method, SimMatrixReader * reader);
+    ~GeneMaxIndex();
+
+    // Retrieves the largest absolute similarity of every gene.
+    float * getMaxima() { return maxima; }
+    // Retrieves the number of genes whose maximum is above th.
+    int countAbove(float th);
+    // Retrieves the lowest floor for which the pairs at or above it number
+    // at most max_pairs.
+    float getFloor(long long int max_pairs, long long int * num_pairs);
+
+    // Sets the name of the gene maximum file.
+    static void getFileName(char * dir, char * prefix, char * method, char * filename);
+};
+
+#endif
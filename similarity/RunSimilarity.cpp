@@ -15,7 +15,8 @@ void RunSimilarity::printUsage() {
   printf("                    row if it exists\n");
   printf("  --cols|-c         The number of columns in the input file\n");
   printf("  --method|-m       The correlation methods to use. Supported methods include\n");
-  printf("                    Pearson's correlation ('pc'), Spearman's rank ('sc')\n");
+  printf("                    Pearson's correlation ('pc'), Spearman's rank ('sc'),\n");
+  printf("                    Kendall's tau ('kc'), biweight midcorrelation ('bc')\n");
   printf("                    and Mutual Information ('mi').\n");
   printf("\n");
   printf("Optional Filtering Arguments:\n");
@@ -45,6 +46,55 @@ void RunSimilarity::printUsage() {
   printf("                    removed) that must be present to calculate a simililarity score.\n");
   printf("                    Default is 30.\n");
   printf("  --th|s            The minimum expression level to include. Anything below is excluded\n");
+  printf("  --suffstats       Use only if the method includes 'pc'. Saves the sufficient\n");
+  printf("                    statistics of every pair so that new samples can later be\n");
+  printf("                    added with the 'update' command without recomputing.\n");
+  printf("  --append          Provide this flag when new genes were added to the end of\n");
+  printf("                    the expression matrix.  The genes already in the existing\n");
+  printf("                    similarity matrix are found using its gene index and only\n");
+  printf("                    the rows of the new genes are calculated and appended.\n");
+  printf("  --format|-z       The file format of the similarity matrix: 'sim' for a single\n");
+  printf("                    indexed file or 'bin' for the original .bin files. Default\n");
+  printf("                    is 'sim'. With --append the format of the existing matrix is used.\n");
+  printf("  --dtype|-y        The data type of the values in a 'sim' file: 'float32', or\n");
+  printf("                    the 2-byte 'float16' (half precision) or 'int16' (fixed point\n");
+  printf("                    scaled to [-1, 1], or to the largest value for 'mi'). The\n");
+  printf("                    2-byte types halve the file size. Default is 'float32'.\n");
+  printf("  --compress        Provide this flag to store a 'sim' file as compressed tiles\n");
+  printf("                    of 256 x 256 values.\n");
+  printf("\n");
+  printf("Optional Candidate Pruning Arguments:\n");
+  printf("  --sketch_th|-k    Use only if the method is 'pc'. Only pairs with an absolute\n");
+  printf("                    correlation at or above this value are needed. Pairs whose\n");
+  printf("                    correlation estimated from random projection sketches is\n");
+  printf("                    below it by more than the margin are not computed and are\n");
+  printf("                    stored as NaN.\n");
+  printf("  --sketch_margin|-u\n");
+  printf("                    The safety margin below --sketch_th. Default is 0.1.\n");
+  printf("  --sketch_bits|-v  The number of bits in each gene sketch. Default is 256.\n");
+  printf("  --sketch_recall   Provide this flag for high recall: the margin is widened to\n");
+  printf("                    at least five standard errors of the estimate and pairs\n");
+  printf("                    with missing values are never pruned. A pair at the\n");
+  printf("                    cutoff is still missed with a probability of about 3 in\n");
+  printf("                    10 million.\n");
+  printf("\n");
+  printf("Optional Sample Group Arguments:\n");
+  printf("  --groups|-g       The path to a tab delimited file that assigns samples to\n");
+  printf("                    groups (e.g. tissues or conditions). Each line contains a\n");
+  printf("                    sample name from the header of the expression matrix and a\n");
+  printf("                    group name. One similarity matrix is calculated for each\n");
+  printf("                    group, using only the group's samples, and is written to a\n");
+  printf("                    subdirectory named after the group. Requires --headers.\n");
+  printf("\n");
+  printf("Optional Bootstrap Arguments:\n");
+  printf("  --bootstrap|-B    Use only if the method includes 'pc'. The number of bootstrap\n");
+  printf("                    replicates. For every pair, the samples are drawn with\n");
+  printf("                    replacement this many times and the mean and variance of the\n");
+  printf("                    replicates' correlations are written to the Bootstrap\n");
+  printf("                    directory.\n");
+  printf("  --bootstrap_th|-F The absolute correlation at which an edge is included.\n");
+  printf("                    If provided, the fraction of replicates that include each\n");
+  printf("                    edge is also written.\n");
   printf("\n");
   printf("Optional Mutual Information Arguments:\n");
   printf("  --mi_bins|-b      Use only if the method is 'mi'. The number of bins for the\n");
@@ -73,6 +123,28 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
   // Set the default threshold for expression values.
   threshold  = -INFINITY;
 
+  // Defaults for sketch-based candidate pruning.
+  sketch_th = NAN;
+  sketch_margin = 0.1;
+  sketch_bits = 256;
+  sketch_recall = 0;
+
+  suffstats = 0;
+  append = 0;
+  format = SIMMATRIX_FORMAT_SIM;
+  dtype = SIMMATRIX_DTYPE_FLOAT32;
+  compress = 0;
+
+  // Defaults for sample groups.
+  groupsfile = NULL;
+  num_groups = 0;
+  groups = NULL;
+  group_masks = NULL;
+
+  // Defaults for bootstrap replicates.
+  bootstrap = 0;
+  bootstrap_th = NAN;
+
   // Initialize the array of method names. We set it to 10 as max. We'll
   // most likely never have this many of similarity methods available.
   method = (char **) malloc(sizeof(char *) * 10);
@@ -94,12 +166,27 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
       {"method",       required_argument, 0,  'm' },
       {"min_obs",      required_argument, 0,  'o' },
       {"th",           required_argument, 0,  's' },
+      {"suffstats",    no_argument,       &suffstats,  1 },
+      {"append",       no_argument,       &append,  1 },
+      {"format",       required_argument, 0,  'z' },
+      {"dtype",        required_argument, 0,  'y' },
+      {"compress",     no_argument,       &compress,  1 },
       // Filtering options.
       {"set1",         required_argument, 0,  '1' },
       {"set2",         required_argument, 0,  '2' },
       // Mutual information options.
       {"mi_bins",      required_argument, 0,  'b' },
       {"mi_degree",    required_argument, 0,  'd' },
+      // Candidate pruning options.
+      {"sketch_th",     required_argument, 0,  'k' },
+      {"sketch_margin", required_argument, 0,  'u' },
+      {"sketch_bits",   required_argument, 0,  'v' },
+      {"sketch_recall", no_argument,       &sketch_recall,  1 },
+      // Sample group options.
+      {"groups",        required_argument, 0,  'g' },
+      // Bootstrap options.
+      {"bootstrap",     required_argument, 0,  'B' },
+      {"bootstrap_th",  required_argument, 0,  'F' },
       // Expression matrix options.
       {"rows",         required_argument, 0,  'r' },
       {"cols",         required_argument, 0,  'c' },
@@ -113,7 +200,7 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
     };
 
     // get the next option
-    c = getopt_long(argc, argv, "m:o:b:d:j:i:t:a:l:r:c:f:n:e:s:h", long_options, &option_index);
+    c = getopt_long(argc, argv, "m:o:b:d:j:i:t:a:l:r:c:f:n:e:s:k:u:v:g:B:F:z:y:h", long_options, &option_index);
 
     // if the index is -1 then we have reached the end of the options list
     // and we break out of the while loop
@@ -134,6 +221,25 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
       case 's':
         threshold = atof(optarg);
         break;
+      case 'z':
+        if (strcmp(optarg, "sim") == 0) {
+          format = SIMMATRIX_FORMAT_SIM;
+        }
+        else if (strcmp(optarg, "bin") == 0) {
+          format = SIMMATRIX_FORMAT_BIN;
+        }
+        else {
+          fprintf(stderr, "Error: The file format (--format option) must be 'sim' or 'bin'.\n");
+          exit(-1);
+        }
+        break;
+      case 'y':
+        dtype = simmatrix_dtype_parse(optarg);
+        if (dtype == -1) {
+          fprintf(stderr, "Error: The data type (--dtype option) must be 'float32', 'float16' or 'int16'.\n");
+          exit(-1);
+        }
+        break;
       // Mutual information options.
       case 'b':
         mi_bins = atoi(optarg);
@@ -141,6 +247,27 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
       case 'd':
         mi_degree = atoi(optarg);
         break;
+      // Candidate pruning options.
+      case 'k':
+        sketch_th = atof(optarg);
+        break;
+      case 'u':
+        sketch_margin = atof(optarg);
+        break;
+      case 'v':
+        sketch_bits = atoi(optarg);
+        break;
+      // Sample group options.
+      case 'g':
+        groupsfile = optarg;
+        break;
+      // Bootstrap options.
+      case 'B':
+        bootstrap = atoi(optarg);
+        break;
+      case 'F':
+        bootstrap_th = atof(optarg);
+        break;
       // Expression matrix options.
       case 'e':
         infilename = optarg;
@@ -199,10 +326,92 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
     exit(-1);
   }
 
+  if (format == SIMMATRIX_FORMAT_BIN && dtype != SIMMATRIX_DTYPE_FLOAT32) {
+    fprintf(stderr, "Error: The 'bin' format (--format option) only stores 'float32' values (--dtype option).\n");
+    exit(-1);
+  }
+  if (format == SIMMATRIX_FORMAT_BIN && compress) {
+    fprintf(stderr, "Error: Only the 'sim' format (--format option) can be compressed (--compress option).\n");
+    exit(-1);
+  }
+  // The fixed point scale of mutual information is only known once all of
+  // the values are, which is too late for tiles.
+  if (compress && dtype == SIMMATRIX_DTYPE_INT16) {
+    for (int i = 0; i < num_methods; i++) {
+      if (strcmp(method[i], "mi") == 0) {
+        fprintf(stderr, "Error: The 'mi' method cannot be compressed (--compress option) with the 'int16' type.\n");
+        fprintf(stderr, "Use 'float16' instead.\n");
+        exit(-1);
+      }
+    }
+  }
   if (omit_na && !na_val) {
     fprintf(stderr, "Error: The missing value string should be provided (--na_val option).\n");
     exit(-1);
   }
+  // The sketches estimate Pearson's correlation only.
+  if (!isnan(sketch_th)) {
+    if (num_methods != 1 || strcmp(method[0], "pc") != 0) {
+      fprintf(stderr, "Error: Candidate pruning (--sketch_th option) can only be used with the 'pc' method.\n");
+      exit(-1);
+    }
+    if (sketch_th <= 0 || sketch_th > 1 || sketch_margin < 0 || sketch_bits <= 0) {
+      fprintf(stderr, "Error: Please provide a --sketch_th between 0 and 1, a positive --sketch_margin and --sketch_bits.\n");
+      exit(-1);
+    }
+  }
+  if (suffstats) {
+    int has_pc = 0;
+    for (int i = 0; i < num_methods; i++) {
+      if (strcmp(method[i], "pc") == 0) {
+        has_pc = 1;
+      }
+    }
+    if (!has_pc) {
+      fprintf(stderr, "Error: Sufficient statistics (--suffstats option) can only be saved for the 'pc' method.\n");
+      exit(-1);
+    }
+    if (!isnan(sketch_th)) {
+      fprintf(stderr, "Error: Sufficient statistics (--suffstats option) cannot be saved when pairs are pruned (--sketch_th option).\n");
+      exit(-1);
+    }
+  }
+  if (bootstrap < 0) {
+    fprintf(stderr, "Error: Please provide a positive number of bootstrap replicates (--bootstrap option).\n");
+    exit(-1);
+  }
+  if (bootstrap > 0) {
+    int has_pc = 0;
+    for (int i = 0; i < num_methods; i++) {
+      if (strcmp(method[i], "pc") == 0) {
+        has_pc = 1;
+      }
+    }
+    if (!has_pc) {
+      fprintf(stderr, "Error: Bootstrap replicates (--bootstrap option) can only be calculated for the 'pc' method.\n");
+      exit(-1);
+    }
+  }
+  if (!isnan(bootstrap_th) && (bootstrap == 0 || bootstrap_th <= 0 || bootstrap_th > 1)) {
+    fprintf(stderr, "Error: Please provide a --bootstrap_th between 0 and 1 together with --bootstrap.\n");
+    exit(-1);
+  }
+  // The sketches, statistics and replicates are calculated from all of the
+  // samples, so they cannot be combined with groups.
+  if (groupsfile) {
+    if (!headers) {
+      fprintf(stderr, "Error: Sample groups (--groups option) require the sample names (--headers option).\n");
+      exit(-1);
+    }
+    if (!isnan(sketch_th) || suffstats || bootstrap > 0) {
+      fprintf(stderr, "Error: Sample groups (--groups option) cannot be used with --sketch_th, --suffstats or --bootstrap.\n");
+      exit(-1);
+    }
+    if (access(groupsfile, F_OK) == -1) {
+      fprintf(stderr,"The sample groups file does not exists or is not readable.\n");
+      exit(-1);
+    }
+  }
   // make sure the input file exists
   if (access(infilename, F_OK) == -1) {
     fprintf(stderr,"The input file does not exists or is not readable.\n");
@@ -231,11 +440,23 @@ RunSimilarity::RunSimilarity(int argc, char *argv[]) {
     }
   }
   printf("  Minimal observed value: %f\n", threshold);
+  if (!isnan(sketch_th)) {
+    printf("  Pruning pairs below: %f (margin %f, %d bits)\n", sketch_th, sketch_margin, sketch_bits);
+  }
+  if (bootstrap > 0) {
+    printf("  Bootstrap replicates: %d\n", bootstrap);
+    if (!isnan(bootstrap_th)) {
+      printf("  Bootstrap edge threshold: %f\n", bootstrap_th);
+    }
+  }
 
   // Retrieve the data from the EMatrix file.
   printf("  Reading expression matrix...\n");
   ematrix = new EMatrix(infilename, rows, cols, headers, omit_na, na_val, func);
 
+  if (groupsfile) {
+    readGroups();
+  }
 }
 /**
  *
@@ -263,8 +484,10 @@ void RunSimilarity::parseMethods(char * methods_str) {
   for (i = 0; i < this->num_methods; i++) {
     if (strcmp(method[i], "pc") != 0 &&
         strcmp(method[i], "mi") != 0 &&
-        strcmp(method[i], "sc") != 0 ) {
-      fprintf(stderr,"Error: The method (--method option) must contain only 'pc', 'sc' or 'mi'.\n");
+        strcmp(method[i], "sc") != 0 &&
+        strcmp(method[i], "kc") != 0 &&
+        strcmp(method[i], "bc") != 0 ) {
+      fprintf(stderr,"Error: The method (--method option) must contain only 'pc', 'sc', 'kc', 'bc' or 'mi'.\n");
       exit(-1);
     }
     // Make sure the method isn't specified more than once.
@@ -287,6 +510,92 @@ RunSimilarity::~RunSimilarity() {
     free(method[i]);
   }
   free(method);
+  for (int g = 0; g < num_groups; g++) {
+    free(groups[g]);
+    free(group_masks[g]);
+  }
+  free(groups);
+  free(group_masks);
+}
+
+/**
+ * Reads the file that assigns samples to groups and creates the samples
+ * array of each group.
+ *
+ * Each line of the file has a sample name and a group name separated by
+ * white space.  Samples that are not listed are not part of any group.
+ */
+void RunSimilarity::readGroups() {
+  char sample[1024];
+  char group[1024];
+  int num_samples = ematrix->getNumSamples();
+  char ** samples = ematrix->getSamples();
+
+  FILE * fh = fopen(groupsfile, "r");
+  if (!fh) {
+    fprintf(stderr, "Error: could not open the sample groups file: '%s'\n", groupsfile);
+    exit(-1);
+  }
+  // A sample may be in several groups, so the arrays grow as groups are
+  // added.
+  int max_groups = 16;
+  groups = (char **) malloc(sizeof(char *) * max_groups);
+  group_masks = (int **) malloc(sizeof(int *) * max_groups);
+
+  while (fscanf(fh, "%1023s %1023s", sample, group) == 2) {
+    // Find the sample.
+    int s;
+    for (s = 0; s < num_samples; s++) {
+      if (strcmp(samples[s], sample) == 0) {
+        break;
+      }
+    }
+    if (s == num_samples) {
+      fprintf(stderr, "Error: The sample '%s' of the sample groups file is not in the expression matrix.\n", sample);
+      exit(-1);
+    }
+    // The group name is used as a directory name.
+    if (strchr(group, '/') || strcmp(group, ".") == 0 || strcmp(group, "..") == 0) {
+      fprintf(stderr, "Error: The group name '%s' cannot be used as a directory name.\n", group);
+      exit(-1);
+    }
+    // Find the group or add it.
+    int g;
+    for (g = 0; g < num_groups; g++) {
+      if (strcmp(groups[g], group) == 0) {
+        break;
+      }
+    }
+    if (g == num_groups) {
+      if (num_groups == max_groups) {
+        max_groups *= 2;
+        groups = (char **) realloc(groups, sizeof(char *) * max_groups);
+        group_masks = (int **) realloc(group_masks, sizeof(int *) * max_groups);
+      }
+      groups[g] = (char *) malloc(sizeof(char) * (strlen(group) + 1));
+      strcpy(groups[g], group);
+      group_masks[g] = (int *) calloc(num_samples, sizeof(int));
+      num_groups++;
+    }
+    if (group_masks[g][s]) {
+      fprintf(stderr, "Error: The sample '%s' is assigned to the group '%s' more than once.\n", sample, group);
+      exit(-1);
+    }
+    group_masks[g][s] = 1;
+  }
+  fclose(fh);
+
+  if (num_groups == 0) {
+    fprintf(stderr, "Error: The sample groups file '%s' does not assign any samples.\n", groupsfile);
+    exit(-1);
+  }
+  for (int g = 0; g < num_groups; g++) {
+    int n = 0;
+    for (int s = 0; s < num_samples; s++) {
+      n += group_masks[g][s];
+    }
+    printf("  Sample group '%s': %d samples\n", groups[g], n);
+  }
 }
 
 /**
@@ -294,16 +603,8 @@ RunSimilarity::~RunSimilarity() {
  */
 void RunSimilarity::execute() {
 
-  // The output file name.
-  char outfilename[1024];
   // Used for pairwise comparison of the same gene.
   float one = 1.0;
-  // The number of binary files needed to store the matrix.
-  int num_bins;
-  // The current binary file number.
-  int curr_bin;
-  // Holds the number of rows in the file.
-  int bin_rows;
   // The total number of pair-wise comparisons to be made.
   long long int total_comps;
   // The number of comparisions completed during looping.
@@ -313,118 +614,360 @@ void RunSimilarity::execute() {
   // The binary output file prefix
   char * fileprefix = ematrix->getFilePrefix();
   char outdir[100];
-  // Hold an array of output files (one per each method).
-  FILE ** outfiles = NULL;
+  // The number of sample sets: one per group or a single set of all samples.
+  int num_sets = num_groups > 0 ? num_groups : 1;
+  // The number of similarity matrices written (one per set and method).
+  int num_outputs = num_sets * this->num_methods;
+  // Hold an array of output directories and writers (one per each output).
+  char ** outdirs = NULL;
+  SimMatrixWriter ** writers = NULL;
+  // The per-gene sample sort orders used by Kendall's tau.
+  int ** orders = NULL;
+  // The per-set and per-gene biweight vectors used by bicor.
+  double *** weighted = NULL;
+  // The optional candidate pair prefilter.
+  SketchFilter * sketch = NULL;
+  // The optional file of Pearson sufficient statistics.
+  FILE * statsfile = NULL;
+  // The first row to calculate. Rows before it are already stored.
+  int start_row = 0;
+  // The layout of a new .sim file.
+  int layout = compress ? SIMMATRIX_LAYOUT_TILES : SIMMATRIX_LAYOUT_ROWS;
+  // The optional bootstrap replicates and the writers for the mean,
+  // variance and edge frequency of each pair.
+  Bootstrap * boot = NULL;
+  char bootdir[] = "./Bootstrap";
+  char boot_methods[3][8] = {"pc.mean", "pc.var", "pc.freq"};
+  int num_boot_outputs = isnan(bootstrap_th) ? 2 : 3;
+  SimMatrixWriter * boot_writers[3];
 
-  // calculate the number of binary files needed to store the similarity matrix
-  num_bins = (num_genes - 1) / ROWS_PER_OUTPUT_FILE;
+  // The output files will be located in the method's directory, or in a
+  // subdirectory for each sample group, and named based on the input file
+  // info.  Output o holds the matrix of method o % num_methods for the
+  // set o / num_methods.
+  outdirs = (char **) malloc(sizeof(char *) * num_outputs);
+  for (int g = 0; g < num_sets; g++) {
+    for (int i = 0; i < this->num_methods; i++) {
+      int o = g * this->num_methods + i;
+      getOutputDir(method[i], outdir);
+      outdirs[o] = (char *) malloc(sizeof(char) * (strlen(outdir) + (num_groups > 0 ? strlen(groups[g]) : 0) + 2));
+      strcpy(outdirs[o], outdir);
+      if (num_groups > 0) {
+        sprintf(outdirs[o], "%s/%s", outdir, groups[g]);
+      }
+    }
+  }
 
   // Make sure the output directory exists
   for (int i = 0; i < this->num_methods; i++) {
-    if (strcmp(method[i], "sc") == 0) {
-      strcpy((char *)&outdir, "./Spearman");
-    }
-    if (strcmp(method[i], "pc") == 0) {
-      strcpy((char *)&outdir, "./Pearson");
-    }
-    if (strcmp(method[i], "mi") == 0) {
-      strcpy((char *)&outdir, "./MI");
-    }
+    getOutputDir(method[i], outdir);
     struct stat st = {0};
     if (stat(outdir, &st) == -1) {
       mkdir(outdir, 0700);
     }
   }
+  for (int o = 0; num_groups > 0 && o < num_outputs; o++) {
+    struct stat st = {0};
+    if (stat(outdirs[o], &st) == -1) {
+      mkdir(outdirs[o], 0700);
+    }
+  }
 
-  total_comps = ((long long int)num_genes * ((long long int)num_genes - 1)) / 2;
-  n_comps = 0;
+  if (bootstrap > 0) {
+    struct stat st = {0};
+    if (stat(bootdir, &st) == -1) {
+      mkdir(bootdir, 0700);
+    }
+  }
 
-  // each iteration of m is a new output file
-  printf("Calculating correlations...\n");
-  for (curr_bin = 0; curr_bin <= num_bins; curr_bin++) {
+  // When appending, find the genes that are already in the matrix. Every
+  // output must hold the same genes and is continued in its own format.
+  if (append) {
+    for (int o = 0; o < num_outputs; o++) {
+      int out_format = SimMatrixReader::exists(outdirs[o], fileprefix, method[o % this->num_methods]);
+      if (out_format == -1) {
+        fprintf(stderr, "Error: There is no similarity matrix in '%s'. The --append option requires\n", outdirs[o]);
+        fprintf(stderr, "an existing similarity matrix.\n");
+        exit(-1);
+      }
+      if (o > 0 && out_format != format) {
+        fprintf(stderr, "Error: The similarity matrices in '%s' and '%s' have different formats.\n",
+            outdirs[o], outdirs[0]);
+        exit(-1);
+      }
+      format = out_format;
+      int num_stored = readGeneIndex(method[o % this->num_methods], outdirs[o]);
+      if (o > 0 && num_stored != start_row) {
+        fprintf(stderr, "Error: The similarity matrix in '%s' has %d genes but the one in '%s' has %d.\n",
+            outdirs[o], num_stored, outdirs[0], start_row);
+        exit(-1);
+      }
+      start_row = num_stored;
+    }
+    printf("  Genes already in the similarity matrix: %d\n", start_row);
+    printf("  New genes: %d\n", num_genes - start_row);
+    if (start_row == num_genes) {
+      printf("There are no new genes to add.\n");
+      return;
+    }
+  }
+
+  // Kendall's tau needs the samples of every gene in sorted order. Rather
+  // than sort them again for every pair, sort each gene once up front.
+  for (int i = 0; i < this->num_methods; i++) {
+    if (strcmp(method[i], "kc") == 0) {
+      orders = (int **) malloc(sizeof(int *) * num_genes);
+      for (int j = 0; j < num_genes; j++) {
+        orders[j] = KendallSimilarity::getSortOrder(ematrix->getRow(j), ematrix->getNumSamples());
+      }
+    }
+  }
+
+  // Likewise, bicor only needs the median and MAD of each gene once. They
+  // depend on the samples, so each group has its own.
+  for (int i = 0; i < this->num_methods; i++) {
+    if (strcmp(method[i], "bc") == 0) {
+      int num_samples = ematrix->getNumSamples();
+      double * x = (double *) malloc(sizeof(double) * num_samples);
+      weighted = (double ***) malloc(sizeof(double **) * num_sets);
+      for (int g = 0; g < num_sets; g++) {
+        weighted[g] = (double **) malloc(sizeof(double *) * num_genes);
+        for (int j = 0; j < num_genes; j++) {
+          double * row = ematrix->getRow(j);
+          for (int s = 0; s < num_samples; s++) {
+            x[s] = (num_groups == 0 || group_masks[g][s] == 1) ? row[s] : NAN;
+          }
+          weighted[g][j] = BicorSimilarity::getWeightedRow(x, num_samples);
+        }
+      }
+      free(x);
+    }
+  }
+
+  if (!isnan(sketch_th)) {
+    sketch = new SketchFilter(ematrix, sketch_bits, sketch_th, sketch_margin, sketch_recall);
+  }
+
+  if (bootstrap > 0) {
+    boot = new Bootstrap(ematrix, bootstrap, min_obs, bootstrap_th);
+    for (int i = 0; i < num_boot_outputs; i++) {
+      boot_writers[i] = new SimMatrixWriter(bootdir, fileprefix, boot_methods[i], num_genes,
+          ematrix->getGenes(), format, dtype, layout, start_row);
+    }
+  }
 
-    // calculate the limit on the rows to output based on where we are in the calculation
-    if (curr_bin < num_bins) {
-      bin_rows = (curr_bin + 1) * ROWS_PER_OUTPUT_FILE;
+  // Open the sufficient statistics file and write the size of the matrix.
+  // The statistics are stored in the same order as the matrix, so the new
+  // rows are appended to the end of an existing file.
+  if (suffstats) {
+    char statsfilename[1024];
+    int num_samples = ematrix->getNumSamples();
+    getStatsFileName(fileprefix, statsfilename);
+    if (start_row > 0) {
+      printf("Appending sufficient statistics: %s... \n", statsfilename);
+      statsfile = fopen(statsfilename, "r+b");
+      if (!statsfile) {
+        fprintf(stderr, "ERROR: could not open the statistics file: '%s'\n", statsfilename);
+        exit(-1);
+      }
+      int file_num_genes;
+      int file_num_samples;
+      int file_version;
+      if (fread(&file_num_genes, sizeof(int), 1, statsfile) != 1 ||
+          fread(&file_num_samples, sizeof(int), 1, statsfile) != 1 ||
+          fread(&file_version, sizeof(int), 1, statsfile) != 1) {
+        fprintf(stderr, "ERROR: cannot read the statistics file: '%s'\n", statsfilename);
+        exit(-1);
+      }
+      long long int num_pairs = ((long long int) start_row * ((long long int) start_row - 1)) / 2;
+      fseek(statsfile, 0, SEEK_END);
+      long long int size = ftell(statsfile);
+      if (file_num_genes != start_row || file_num_samples != num_samples ||
+          file_version != PEARSON_SUMS_VERSION ||
+          size != 3 * (long long int) sizeof(int) + num_pairs * 6 * (long long int) sizeof(double)) {
+        fprintf(stderr, "ERROR: The statistics file '%s' does not match the existing\n", statsfilename);
+        fprintf(stderr, "similarity matrix of %d genes and %d samples.\n", start_row, num_samples);
+        exit(-1);
+      }
+      fseek(statsfile, 0, SEEK_SET);
+      fwrite(&num_genes, sizeof(num_genes), 1, statsfile);
+      fseek(statsfile, 0, SEEK_END);
     }
     else {
-      bin_rows = num_genes;
+      printf("Writing sufficient statistics: %s... \n", statsfilename);
+      statsfile = fopen(statsfilename, "wb");
+      if (!statsfile) {
+        fprintf(stderr, "ERROR: could not open the statistics file: '%s'\n", statsfilename);
+        exit(-1);
+      }
+      int version = PEARSON_SUMS_VERSION;
+      fwrite(&num_genes, sizeof(num_genes), 1, statsfile);
+      fwrite(&num_samples, sizeof(num_samples), 1, statsfile);
+      fwrite(&version, sizeof(version), 1, statsfile);
     }
+  }
 
-    // the output file will be located in the  directory and named based on the input file info
-    outfiles = (FILE **) malloc(sizeof(FILE *) * this->num_methods);
-    for (int i = 0; i < this->num_methods; i++) {
-      // Open the file for storing the binary results.
-      sprintf(outfilename, "%s/%s.%s%d.bin", outdir,fileprefix, method[i], curr_bin);
-      printf("Writing file %d of %d: %s... \n", curr_bin + 1, num_bins + 1, outfilename);
-      outfiles[i] = fopen(outfilename, "wb");
-
-      // write the size of the matrix.
-      fwrite(&num_genes, sizeof(num_genes), 1, outfiles[i]);
-      // write the number of lines in this file
-      int num_lines = bin_rows - (curr_bin * ROWS_PER_OUTPUT_FILE);
-      fwrite(&num_lines, sizeof(num_lines), 1, outfiles[i]);
-    }
-
-
-    // iterate through the genes that belong in this file
-    for (int j = curr_bin * ROWS_PER_OUTPUT_FILE; j < bin_rows; j++) {
-      // iterate through all the genes up to j (only need lower triangle)
-      for (int k = 0; k <= j; k++) {
-        n_comps++;
-        if (n_comps % 1000 == 0) {
-          statm_t * memory = memory_get_usage();
-          printf("Percent complete: %.2f%%. Mem: %ldb. \r", (n_comps / (float) total_comps) * 100, memory->size);
-          free(memory);
+  writers = (SimMatrixWriter **) malloc(sizeof(SimMatrixWriter *) * num_outputs);
+  for (int o = 0; o < num_outputs; o++) {
+    writers[o] = new SimMatrixWriter(outdirs[o], fileprefix, method[o % this->num_methods], num_genes,
+        ematrix->getGenes(), format, dtype, layout, start_row);
+  }
+
+  total_comps = ((long long int)num_genes * ((long long int)num_genes - 1)) / 2 -
+                ((long long int)start_row * ((long long int)start_row - 1)) / 2;
+  n_comps = 0;
+
+  printf("Calculating correlations...\n");
+  for (int j = start_row; j < num_genes; j++) {
+    // iterate through all the genes up to j (only need lower triangle)
+    for (int k = 0; k <= j; k++) {
+      n_comps++;
+      if (n_comps % 1000 == 0) {
+        statm_t * memory = memory_get_usage();
+        printf("Percent complete: %.2f%%. Mem: %ldb. \r", (n_comps / (float) total_comps) * 100, memory->size);
+        free(memory);
+      }
+      if (j == k) {
+        // correlation of an element with itself is 1
+        for (int o = 0; o < num_outputs; o++) {
+          writers[o]->write(one);
         }
-        if (j == k) {
-          // correlation of an element with itself is 1
-          for (int i = 0; i < this->num_methods; i++) {
-            fwrite(&one, sizeof(one), 1, outfiles[i]);
+        if (boot) {
+          float zero = 0.0;
+          boot_writers[0]->write(one);
+          boot_writers[1]->write(zero);
+          if (num_boot_outputs == 3) {
+            boot_writers[2]->write(one);
           }
-          continue;
         }
+        continue;
+      }
+
+      float score;
+
+      // Skip pairs that the sketches show are well below the cutoff.
+      if (sketch && !sketch->isCandidate(j, k)) {
+        score = NAN;
+        for (int i = 0; i < this->num_methods; i++) {
+          writers[i]->write(score);
+        }
+        for (int i = 0; boot && i < num_boot_outputs; i++) {
+          boot_writers[i]->write(score);
+        }
+        continue;
+      }
+
+      // The pair is loaded and cleaned once for all groups and methods.
+      PairWiseSet * pwset = new PairWiseSet(ematrix, j, k);
 
-        float score;
-        PairWiseSet * pwset = new PairWiseSet(ematrix, j, k);
+      for (int g = 0; g < num_sets; g++) {
+        // The samples of this group, or NULL to use all samples.
+        int * mask = num_groups > 0 ? group_masks[g] : NULL;
 
         // Perform the appropriate calculation based on the method
         for (int i = 0; i < this->num_methods; i++) {
           if (strcmp(method[i], "pc") == 0) {
-            PearsonSimilarity * pws = new PearsonSimilarity(pwset, min_obs);
+            PearsonSimilarity * pws = new PearsonSimilarity(pwset, min_obs, mask);
             pws->run();
             score = (float) pws->getScore();
+            if (statsfile) {
+              double sums[6];
+              pws->getSums(sums);
+              fwrite(sums, sizeof(double), 6, statsfile);
+            }
             delete pws;
+            if (sketch) {
+              sketch->addResult(score);
+            }
+            if (boot) {
+              double boot_scores[3];
+              boot->run(pwset, &boot_scores[0], &boot_scores[1], &boot_scores[2]);
+              for (int l = 0; l < num_boot_outputs; l++) {
+                boot_writers[l]->write((float) boot_scores[l]);
+              }
+            }
           }
           else if(strcmp(method[i], "mi") == 0) {
-            MISimilarity * pws = new MISimilarity(pwset, min_obs, mi_bins, mi_degree);
+            MISimilarity * pws = new MISimilarity(pwset, min_obs, mask, mi_bins, mi_degree);
             pws->run();
             score = (float) pws->getScore();
             delete pws;
           }
           else if(strcmp(method[i], "sc") == 0) {
-            SpearmanSimilarity * pws = new SpearmanSimilarity(pwset, min_obs);
+            SpearmanSimilarity * pws = new SpearmanSimilarity(pwset, min_obs, mask);
             pws->run();
             score = (float) pws->getScore();
             delete pws;
           }
+          else if(strcmp(method[i], "kc") == 0) {
+            KendallSimilarity * pws = new KendallSimilarity(pwset, min_obs, mask, orders[j]);
+            pws->run();
+            score = (float) pws->getScore();
+            delete pws;
+          }
+          else if(strcmp(method[i], "bc") == 0) {
+            BicorSimilarity * pws = new BicorSimilarity(pwset, min_obs, mask, weighted[g][j], weighted[g][k]);
+            pws->run();
+            score = (float) pws->getScore();
+            delete pws;
+          }
+          writers[g * this->num_methods + i]->write(score);
         }
-        delete pwset;
-        fwrite(&score, sizeof(float), 1, outfiles[0]);
-
-//        // if the historgram is turned on then store the value in the correct bin
-//        if (score < 1 && score > -1) {
-//          if (score < 0) {
-//            score = -score;
-//          }
-//          histogram[(int)(score * HIST_BINS)]++;
+      }
+      delete pwset;
+
+//      // if the historgram is turned on then store the value in the correct bin
+//      if (score < 1 && score > -1) {
+//        if (score < 0) {
+//          score = -score;
 //        }
+//        histogram[(int)(score * HIST_BINS)]++;
+//      }
+    }
+  }
+  for (int o = 0; o < num_outputs; o++) {
+    delete writers[o];
+    if (format == SIMMATRIX_FORMAT_BIN) {
+      writeGeneIndex(method[o % this->num_methods], outdirs[o]);
+    }
+    free(outdirs[o]);
+  }
+  free(writers);
+  free(outdirs);
+
+  if (boot) {
+    for (int i = 0; i < num_boot_outputs; i++) {
+      delete boot_writers[i];
+      if (format == SIMMATRIX_FORMAT_BIN) {
+        writeGeneIndex(boot_methods[i], bootdir);
       }
     }
-    for (int i = 0; i < this->num_methods; i++) {
-      fclose(outfiles[i]);
+    delete boot;
+  }
+
+  if (statsfile) {
+    fclose(statsfile);
+  }
+  if (orders) {
+    for (int j = 0; j < num_genes; j++) {
+      free(orders[j]);
+    }
+    free(orders);
+  }
+  if (weighted) {
+    for (int g = 0; g < num_sets; g++) {
+      for (int j = 0; j < num_genes; j++) {
+        free(weighted[g][j]);
+      }
+      free(weighted[g]);
     }
-    free(outfiles);
+    free(weighted);
+  }
+
+  if (sketch) {
+    printf("\n");
+    sketch->printStats();
+    delete sketch;
   }
 
   // Write the historgram
@@ -433,6 +976,136 @@ void RunSimilarity::execute() {
   printf("\nDone.\n");
 }
 
+/**
+ * Reads the gene index of an existing similarity matrix and makes sure its
+ * genes are the first genes of the expression matrix, in the same order.
+ * A .sim file holds its own gene names; .bin files have a separate index.
+ *
+ * @param char * method
+ *   The similarity method.
+ * @param char * outdir
+ *   The directory of the similarity matrix.
+ *
+ * @return int
+ *   The number of genes already in the similarity matrix.
+ */
+int RunSimilarity::readGeneIndex(char * method, char * outdir) {
+  char indexfilename[1024];
+  char gene[1024];
+  int num_genes = ematrix->getNumGenes();
+  char ** genes = ematrix->getGenes();
+  int num_stored = 0;
+
+  if (SimMatrixReader::exists(outdir, ematrix->getFilePrefix(), method) == SIMMATRIX_FORMAT_SIM) {
+    SimMatrixReader * reader = new SimMatrixReader(outdir, ematrix->getFilePrefix(), method);
+    char ** stored = reader->getGenes();
+    num_stored = reader->getNumGenes();
+    for (int i = 0; i < num_stored; i++) {
+      if (i >= num_genes || strcmp(stored[i], genes[i]) != 0) {
+        fprintf(stderr, "Error: Gene %d of the similarity matrix in '%s' is '%s', which is not\n", i + 1, outdir, stored[i]);
+        fprintf(stderr, "the gene on the same row of the expression matrix. New genes can only be\n");
+        fprintf(stderr, "appended to the end of the expression matrix.\n");
+        exit(-1);
+      }
+    }
+    delete reader;
+    return num_stored;
+  }
+
+  SimMatrixWriter::getGeneIndexFileName(outdir, ematrix->getFilePrefix(), method, indexfilename);
+  FILE * fh = fopen(indexfilename, "r");
+  if (!fh) {
+    fprintf(stderr, "Error: could not open the gene index: '%s'. The --append option requires\n", indexfilename);
+    fprintf(stderr, "an existing similarity matrix.\n");
+    exit(-1);
+  }
+  while (fscanf(fh, "%1023s", gene) == 1) {
+    if (num_stored >= num_genes || strcmp(gene, genes[num_stored]) != 0) {
+      fprintf(stderr, "Error: Gene %d of the gene index '%s' is '%s', which is not\n", num_stored + 1, indexfilename, gene);
+      fprintf(stderr, "the gene on the same row of the expression matrix. New genes can only be\n");
+      fprintf(stderr, "appended to the end of the expression matrix.\n");
+      exit(-1);
+    }
+    num_stored++;
+  }
+  fclose(fh);
+
+  return num_stored;
+}
+
+/**
+ * Writes the gene index of a similarity matrix.
+ *
+ * @param char * method
+ *   The similarity method.
+ * @param char * outdir
+ *   The directory of the similarity matrix.
+ */
+void RunSimilarity::writeGeneIndex(char * method, char * outdir) {
+  char indexfilename[1024];
+  char ** genes = ematrix->getGenes();
+
+  SimMatrixWriter::getGeneIndexFileName(outdir, ematrix->getFilePrefix(), method, indexfilename);
+  FILE * fh = fopen(indexfilename, "w");
+  if (!fh) {
+    fprintf(stderr, "ERROR: could not open the gene index: '%s'\n", indexfilename);
+    exit(-1);
+  }
+  for (int i = 0; i < ematrix->getNumGenes(); i++) {
+    fprintf(fh, "%s\n", genes[i]);
+  }
+  fclose(fh);
+}
+
+/**
+ * Retrieves the name of the file holding the Pearson sufficient statistics.
+ *
+ * The file starts with the number of genes, the number of samples and
+ * PEARSON_SUMS_VERSION, as integers, followed by six doubles for each pair
+ * (j, k) with k < j in the same order as the similarity matrix: n, the
+ * means of x and y, the sums of squared deviations of x and of y and the
+ * sum of the products of the deviations of x and y, where x is gene j and
+ * y is gene k.
+ *
+ * @param char * prefix
+ *   The expression matrix file prefix.
+ * @param char * filename
+ *   A string large enough to hold the file name.
+ */
+void RunSimilarity::getStatsFileName(char * prefix, char * filename) {
+  char outdir[100];
+  char pc[] = "pc";
+  getOutputDir(pc, outdir);
+  sprintf(filename, "%s/%s.pc.sstats.bin", outdir, prefix);
+}
+
+/**
+ * Retrieves the directory where the similarity matrix of a method is stored.
+ *
+ * @param char * method
+ *   The similarity method: pc, sc, kc, bc or mi.
+ * @param char * outdir
+ *   A string large enough to hold the directory name. Upon return it
+ *   contains the directory.
+ */
+void RunSimilarity::getOutputDir(char * method, char * outdir) {
+  if (strcmp(method, "sc") == 0) {
+    strcpy(outdir, "./Spearman");
+  }
+  if (strcmp(method, "pc") == 0) {
+    strcpy(outdir, "./Pearson");
+  }
+  if (strcmp(method, "mi") == 0) {
+    strcpy(outdir, "./MI");
+  }
+  if (strcmp(method, "kc") == 0) {
+    strcpy(outdir, "./Kendall");
+  }
+  if (strcmp(method, "bc") == 0) {
+    strcpy(outdir, "./Bicor");
+  }
+}
+
 /**
  * Prints the histogram to a file.
  *
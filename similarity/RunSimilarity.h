@@ -7,10 +7,14 @@
 #include "./methods/SpearmanSimilarity.h"
 #include "./methods/PearsonSimilarity.h"
 #include "./methods/MISimilarity.h"
+#include "./methods/KendallSimilarity.h"
+#include "./methods/BicorSimilarity.h"
+#include "./SketchFilter.h"
+#include "./Bootstrap.h"
+#include "./SimMatrixWriter.h"
+#include "./SimMatrixReader.h"
 #include "../general/misc.h"
 
-// a global variable for the number of rows in each output file
-#define ROWS_PER_OUTPUT_FILE 10000
 // the number of bins in the correlation value histogram
 #define HIST_BINS 100
 
@@ -20,7 +24,7 @@ class RunSimilarity {
   private:
     // The expression matrix object.
     EMatrix * ematrix;
-    // Specifies the methods: sc, pc, mi.
+    // Specifies the methods: sc, pc, mi, kc, bc.
     char ** method;
     // Indicates the number of methods.
     int num_methods;
@@ -55,12 +59,55 @@ class RunSimilarity {
     // The degree of the B-spline function.
     int mi_degree;
 
+    // Variables for sketch-based candidate pruning
+    // --------------------------------------------
+    // The absolute correlation of interest. Pruning is disabled if NaN.
+    double sketch_th;
+    // The safety margin below sketch_th.
+    double sketch_margin;
+    // The number of bits in each gene sketch.
+    int sketch_bits;
+    // Set to 1 to never prune pairs near the margin.
+    int sketch_recall;
+
+    // Set to 1 to save the Pearson sufficient statistics of every pair.
+    int suffstats;
+    // Set to 1 to only add the rows of new genes to an existing matrix.
+    int append;
+    // The output file format: SIMMATRIX_FORMAT_SIM or SIMMATRIX_FORMAT_BIN.
+    int format;
+    // The data type of the values in a .sim file.
+    int dtype;
+    // Set to 1 to store a .sim file as compressed tiles.
+    int compress;
+
+    // Variables for sample groups
+    // ---------------------------
+    // The file that assigns samples to groups or NULL.
+    char * groupsfile;
+    // The number of groups. Zero if samples are not grouped.
+    int num_groups;
+    // The names of the groups.
+    char ** groups;
+    // For each group, an array that is 1 for the samples in the group.
+    int ** group_masks;
+
+    // Variables for bootstrap replicates
+    // ----------------------------------
+    // The number of bootstrap replicates. Zero disables bootstrapping.
+    int bootstrap;
+    // The absolute correlation for the edge frequency or NaN.
+    double bootstrap_th;
+
 
     void writeHistogram();
     // Calcualtes pair-wise similarity score the traditional way.
     void executeTraditional();
     void parseMethods(char * methods_str);
     void parseMinSim(char * minsim_str);
+    int readGeneIndex(char * method, char * outdir);
+    void writeGeneIndex(char * method, char * outdir);
+    void readGroups();
 
   public:
     RunSimilarity(int argc, char *argv[]);
@@ -68,6 +115,11 @@ class RunSimilarity {
     void execute();
     static void printUsage();
 
+    // Retrieves the output directory for a similarity method.
+    static void getOutputDir(char * method, char * outdir);
+    // Retrieves the name of the Pearson sufficient statistics file.
+    static void getStatsFileName(char * prefix, char * filename);
+
 };
 
 #endif
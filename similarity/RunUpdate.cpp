@@ -0,0 +1,322 @@
+#include "RunUpdate.h"
+
+/**
+ * Prints the command-line usage instructions for the update command
+ */
+void RunUpdate::printUsage() {
+  printf("\n");
+  printf("Usage: ./rmtgnet update [options]\n");
+  printf("Adds new samples to a Pearson similarity matrix that was created with the\n");
+  printf("--suffstats option of the similarity command. The new samples must be\n");
+  printf("appended as the last columns of the original expression matrix file.\n");
+  printf("\n");
+  printf("The list of required options:\n");
+  printf("  --ematrix|-e      The tab delimited file name that contains the expression matrix\n");
+  printf("                    including the new samples.\n");
+  printf("  --rows|-r         The number of lines in the ematrix file including the header\n");
+  printf("                    row if it exists\n");
+  printf("  --cols|-c         The number of columns in the input file, including the new\n");
+  printf("                    samples\n");
+  printf("  --new_cols|-w     The number of new samples at the end of each row.\n");
+  printf("\n");
+  printf("Optional Expression Matrix Arguments:\n");
+  printf("  --omit_na         Provide this flag to ignore missing values. Use this option for\n");
+  printf("                    RNA-seq expression matricies where counts are zero.\n");
+  printf("  --na_val|-n       A string representing the missing values in the input file\n");
+  printf("                    (e.g. NA or 0.000)\n");
+  printf("  --func|-f         A transformation function to apply to elements of the ematrix.\n");
+  printf("                    Values include: log, log2 or log10. Default is to not perform\n");
+  printf("                    any transformation. Must match the original similarity run.\n");
+  printf("  --headers         Provide this flag if the first line of the matrix contains\n");
+  printf("                    headers.\n");
+  printf("\n");
+  printf("Optional Similarity Arguments:\n");
+  printf("  --min_obs|-o      The minimum number of observations (after missing values\n");
+  printf("                    removed) that must be present to calculate a simililarity score.\n");
+  printf("                    Default is 30.\n");
+  printf("\n");
+  printf("For Help:\n");
+  printf("  --help|-h       Print these usage instructions\n");
+  printf("\n");
+}
+
+/**
+ * The function to call when running the 'update' command.
+ */
+RunUpdate::RunUpdate(int argc, char *argv[]) {
+
+  // Initialize some of the program parameters.
+  min_obs = 30;
+  new_cols = 0;
+  headers = 0;
+  omit_na = 0;
+  rows = 0;
+  cols = 0;
+  infilename = NULL;
+  na_val = NULL;
+  strcpy(func, "none");
+
+  // The value returned by getopt_long.
+  int c;
+
+  // loop through the incoming arguments until the
+  // getopt_long function returns -1. Then we break out of the loop
+  while(1) {
+    int option_index = 0;
+
+    // specify the long options. The values returned are specified to be the
+    // short options which are then handled by the case statement below
+    static struct option long_options[] = {
+      {"help",         no_argument,       0,  'h' },
+      {"min_obs",      required_argument, 0,  'o' },
+      {"new_cols",     required_argument, 0,  'w' },
+      // Expression matrix options.
+      {"rows",         required_argument, 0,  'r' },
+      {"cols",         required_argument, 0,  'c' },
+      {"headers",      no_argument,       &headers,  1 },
+      {"omit_na",      no_argument,       &omit_na,  1 },
+      {"func",         required_argument, 0,  'f' },
+      {"na_val",       required_argument, 0,  'n' },
+      {"ematrix",      required_argument, 0,  'e' },
+      // Last element required to be all zeros.
+      {0, 0, 0,  0 }
+    };
+
+    // get the next option
+    c = getopt_long(argc, argv, "o:w:r:c:f:n:e:h", long_options, &option_index);
+
+    // if the index is -1 then we have reached the end of the options list
+    // and we break out of the while loop
+    if (c == -1) {
+      break;
+    }
+
+    // handle the options
+    switch (c) {
+      case 0:
+        break;
+      case 'o':
+        min_obs = atoi(optarg);
+        break;
+      case 'w':
+        new_cols = atoi(optarg);
+        break;
+      // Expression matrix options.
+      case 'e':
+        infilename = optarg;
+        break;
+      case 'r':
+        rows = atoi(optarg);
+        break;
+      case 'c':
+        cols = atoi(optarg);
+        break;
+      case 'n':
+        na_val = optarg;
+        break;
+      case 'f':
+        strcpy(func, optarg);
+        break;
+      // Help and catch-all options.
+      case 'h':
+        printUsage();
+        exit(-1);
+        break;
+      case '?':
+        exit(-1);
+        break;
+      case ':':
+        printUsage();
+        exit(-1);
+        break;
+      default:
+        printUsage();
+        exit(-1);
+    }
+  }
+
+  // make sure the required arguments are set and appropriate
+  if (!infilename) {
+    fprintf(stderr,"Please provide an expression matrix (--ematrix option).\n");
+    exit(-1);
+  }
+  // make sure we have a positive integer for the rows and columns of the matrix
+  if (rows < 0 || rows == 0) {
+    fprintf(stderr, "Please provide a positive integer value for the number of rows in the \n");
+    fprintf(stderr, "expression matrix (--rows option).\n");
+    exit(-1);
+  }
+  if (cols < 0 || cols == 0) {
+    fprintf(stderr, "Please provide a positive integer value for the number of columns in\n");
+    fprintf(stderr, "the expression matrix (--cols option).\n");
+    exit(-1);
+  }
+  if (new_cols <= 0 || new_cols >= cols) {
+    fprintf(stderr, "Please provide a positive number of new samples that is smaller than\n");
+    fprintf(stderr, "the number of columns (--new_cols option).\n");
+    exit(-1);
+  }
+  if (omit_na && !na_val) {
+    fprintf(stderr, "Error: The missing value string should be provided (--na_val option).\n");
+    exit(-1);
+  }
+  // make sure the input file exists
+  if (access(infilename, F_OK) == -1) {
+    fprintf(stderr,"The input file does not exists or is not readable.\n");
+    exit(-1);
+  }
+
+  if (headers == 1) {
+    printf("  Reading header line\n");
+  }
+  printf("  Performing transformation: %s \n", func);
+  if (omit_na) {
+    printf("  Missing values are: '%s'\n", na_val);
+  }
+  printf("  Required observations: %d\n", min_obs);
+  printf("  New samples: %d\n", new_cols);
+
+  // Retrieve the data from the EMatrix file.
+  printf("  Reading expression matrix...\n");
+  ematrix = new EMatrix(infilename, rows, cols, headers, omit_na, na_val, func);
+}
+
+/**
+ * Implements the destructor.
+ */
+RunUpdate::~RunUpdate() {
+  delete ematrix;
+}
+
+/**
+ * Folds the new samples into the sufficient statistics of every pair and
+ * rewrites the Pearson similarity matrix.
+ */
+void RunUpdate::execute() {
+  // Used for pairwise comparison of the same gene.
+  float one = 1.0;
+  // The number of genes and samples.
+  int num_genes = ematrix->getNumGenes();
+  int num_samples = ematrix->getNumSamples();
+  // The number of samples in the original matrix.
+  int old_cols = num_samples - new_cols;
+  // The binary output file prefix
+  char * fileprefix = ematrix->getFilePrefix();
+  char outdir[100];
+  char pc[] = "pc";
+  char statsfilename[1024];
+  char tmpfilename[1040];
+
+  // Open the statistics of the original run and make sure they match
+  // this expression matrix.
+  RunSimilarity::getStatsFileName(fileprefix, statsfilename);
+  FILE * instats = fopen(statsfilename, "rb");
+  if (!instats) {
+    fprintf(stderr, "ERROR: could not open the statistics file: '%s'. Was the similarity\n", statsfilename);
+    fprintf(stderr, "matrix created with the --suffstats option?\n");
+    exit(-1);
+  }
+  int file_num_genes;
+  int file_num_samples;
+  int file_version;
+  if (fread(&file_num_genes, sizeof(int), 1, instats) != 1 ||
+      fread(&file_num_samples, sizeof(int), 1, instats) != 1 ||
+      fread(&file_version, sizeof(int), 1, instats) != 1) {
+    fprintf(stderr, "ERROR: cannot read the statistics file: '%s'\n", statsfilename);
+    exit(-1);
+  }
+  if (file_version != PEARSON_SUMS_VERSION) {
+    fprintf(stderr, "ERROR: The statistics file '%s' was written by an earlier version.\n", statsfilename);
+    fprintf(stderr, "Calculate the similarity matrix again with the --suffstats option.\n");
+    exit(-1);
+  }
+  if (file_num_genes != num_genes) {
+    fprintf(stderr, "ERROR: The statistics file has %d genes but the expression matrix has %d.\n",
+        file_num_genes, num_genes);
+    exit(-1);
+  }
+  if (file_num_samples != old_cols) {
+    fprintf(stderr, "ERROR: The statistics file has %d samples but the expression matrix has %d\n",
+        file_num_samples, old_cols);
+    fprintf(stderr, "samples before the new columns.\n");
+    exit(-1);
+  }
+
+  // The updated statistics are written to a temporary file which replaces
+  // the original once the update is complete.
+  sprintf(tmpfilename, "%s.tmp", statsfilename);
+  FILE * outstats = fopen(tmpfilename, "wb");
+  if (!outstats) {
+    fprintf(stderr, "ERROR: could not open the statistics file: '%s'\n", tmpfilename);
+    exit(-1);
+  }
+  int version = PEARSON_SUMS_VERSION;
+  fwrite(&num_genes, sizeof(num_genes), 1, outstats);
+  fwrite(&num_samples, sizeof(num_samples), 1, outstats);
+  fwrite(&version, sizeof(version), 1, outstats);
+
+  // The matrix is rewritten in the format, data type and layout it
+  // already has.
+  RunSimilarity::getOutputDir(pc, outdir);
+  int format = SimMatrixReader::exists(outdir, fileprefix, pc);
+  int dtype = SIMMATRIX_DTYPE_FLOAT32;
+  int layout = SIMMATRIX_LAYOUT_ROWS;
+  if (format == -1) {
+    format = SIMMATRIX_FORMAT_SIM;
+  }
+  if (format == SIMMATRIX_FORMAT_SIM) {
+    SimMatrixReader * reader = new SimMatrixReader(outdir, fileprefix, pc);
+    dtype = reader->getDtype();
+    layout = reader->getLayout();
+    delete reader;
+  }
+  SimMatrixWriter * writer = new SimMatrixWriter(outdir, fileprefix, pc, num_genes,
+      ematrix->getGenes(), format, dtype, layout);
+
+  long long int total_comps = ((long long int)num_genes * ((long long int)num_genes - 1)) / 2;
+  long long int n_comps = 0;
+
+  printf("Updating correlations with %d new samples...\n", new_cols);
+  for (int j = 0; j < num_genes; j++) {
+    double * x = ematrix->getRow(j);
+    for (int k = 0; k <= j; k++) {
+      if (j == k) {
+        writer->write(one);
+        continue;
+      }
+      n_comps++;
+      if (n_comps % 1000 == 0) {
+        printf("Percent complete: %.2f%%. \r", (n_comps / (float) total_comps) * 100);
+      }
+
+      double sums[6];
+      if (fread(sums, sizeof(double), 6, instats) != 6) {
+        fprintf(stderr, "\nERROR: the statistics file ended early: '%s'\n", statsfilename);
+        exit(-1);
+      }
+
+      // Add the new samples that are present in both genes.
+      double * y = ematrix->getRow(k);
+      for (int s = old_cols; s < num_samples; s++) {
+        if (isnan(x[s]) || isnan(y[s]) || isinf(x[s]) || isinf(y[s])) {
+          continue;
+        }
+        PearsonSimilarity::addSample(sums, x[s], y[s]);
+      }
+      fwrite(sums, sizeof(double), 6, outstats);
+
+      float score = (float) PearsonSimilarity::getScoreFromSums(sums, min_obs);
+      writer->write(score);
+    }
+  }
+  delete writer;
+  fclose(instats);
+  fclose(outstats);
+
+  if (rename(tmpfilename, statsfilename) != 0) {
+    fprintf(stderr, "\nERROR: could not replace the statistics file: '%s'\n", statsfilename);
+    exit(-1);
+  }
+
+  printf("\nDone.\n");
+}
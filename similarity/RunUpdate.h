@@ -0,0 +1,51 @@
+#ifndef _RUNUPDATE_
+#define _RUNUPDATE_
+
+#include <getopt.h>
+#include "RunSimilarity.h"
+
+/**
+ * Updates a Pearson similarity matrix after new samples were appended to
+ * the expression matrix.
+ *
+ * The sufficient statistics saved by 'similarity --suffstats' are read for
+ * every pair, the values of the new samples are added to them and the
+ * correlations are recalculated. Only the new columns are visited, so the
+ * cost is proportional to the number of new samples rather than to the
+ * size of the whole compendium.
+ */
+class RunUpdate {
+
+  private:
+    // The expression matrix object.
+    EMatrix * ematrix;
+    // The minimum number of observations to calculate correlation.
+    int min_obs;
+    // The number of samples appended to the end of the expression matrix.
+    int new_cols;
+
+    // Variables for the expression matrix
+    // -----------------------------------
+    // Indicates if the expression matrix has headers.
+    int headers;
+    // The input file name
+    char *infilename;
+    // The number of rows in the input ematrix file (including the header)
+    int rows;
+    // The number of cols in the input ematrix file.
+    int cols;
+    // Indicates if missing values should be ignored in the EMatrix file.
+    int omit_na;
+    // Specifies the value that represents a missing value.
+    char *na_val;
+    // Specifies the transformation function: log2, none.
+    char func[10];
+
+  public:
+    RunUpdate(int argc, char *argv[]);
+    ~RunUpdate();
+    void execute();
+    static void printUsage();
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include <math.h>
+#include <string.h>
+#include "SimMatrixFormat.h"
+#include "../general/lz.h"
+
+// The half precision NaN written for missing values.
+#define FLOAT16_NAN 0x7E00
+
+/**
+ * Converts a float to IEEE half precision, rounding to the nearest value.
+ * Values too large for a half become infinite.
+ *
+ * @param float f
+ *
+ * @return unsigned short
+ */
+static unsigned short float_to_half(float f) {
+  unsigned int x;
+  memcpy(&x, &f, sizeof(x));
+
+  unsigned int sign = (x >> 16) & 0x8000;
+  int exp = (x >> 23) & 0xff;
+  unsigned int mant = x & 0x7fffff;
+
+  // Infinity and NaN.
+  if (exp == 0xff) {
+    return mant ? FLOAT16_NAN : sign | 0x7c00;
+  }
+  int e = exp - 127 + 15;
+  if (e >= 31) {
+    return sign | 0x7c00;
+  }
+  // Values below the smallest normal half are stored as subnormals.
+  if (e <= 0) {
+    if (e < -10) {
+      return sign;
+    }
+    mant |= 0x800000;
+    int shift = 14 - e;
+    unsigned int h = mant >> shift;
+    unsigned int rem = mant & ((1u << shift) - 1);
+    unsigned int half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) {
+      h++;
+    }
+    return sign | h;
+  }
+  // Round to nearest even. A carry out of the mantissa correctly moves on
+  // to the exponent.
+  unsigned int h = sign | (e << 10) | (mant >> 13);
+  unsigned int rem = mant & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+    h++;
+  }
+  return h;
+}
+
+/**
+ * Converts an IEEE half precision value to a float.
+ *
+ * @param unsigned short h
+ *
+ * @return float
+ */
+static float half_to_float(unsigned short h) {
+  unsigned int sign = (unsigned int) (h & 0x8000) << 16;
+  int exp = (h >> 10) & 0x1f;
+  unsigned int mant = h & 0x3ff;
+  unsigned int x;
+  float f;
+
+  if (exp == 0) {
+    f = ldexpf((float) mant, -24);
+    return sign ? -f : f;
+  }
+  if (exp == 31) {
+    x = sign | 0x7f800000 | (mant << 13);
+  }
+  else {
+    x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+  }
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+// Every half precision value converted to a float. Decoding a row is then
+// a single table lookup per value. The table is filled before main() runs,
+// so it is safe to use from any thread.
+static float half_table[65536];
+static int init_half_table() {
+  for (int i = 0; i < 65536; i++) {
+    half_table[i] = half_to_float((unsigned short) i);
+  }
+  return 1;
+}
+static int half_table_ready = init_half_table();
+
+/**
+ * Retrieves the size in bytes of a value of the given data type.
+ *
+ * @param int dtype
+ *   One of the SIMMATRIX_DTYPE values.
+ *
+ * @return int
+ */
+int simmatrix_dtype_size(int dtype) {
+  if (dtype == SIMMATRIX_DTYPE_FLOAT16 || dtype == SIMMATRIX_DTYPE_INT16) {
+    return 2;
+  }
+  return sizeof(float);
+}
+
+/**
+ * Retrieves the data type with the given name.
+ *
+ * @param char * name
+ *   float32, float16 or int16.
+ *
+ * @return int
+ *   One of the SIMMATRIX_DTYPE values or -1 if the name is not known.
+ */
+int simmatrix_dtype_parse(char * name) {
+  if (strcmp(name, "float32") == 0) {
+    return SIMMATRIX_DTYPE_FLOAT32;
+  }
+  if (strcmp(name, "float16") == 0) {
+    return SIMMATRIX_DTYPE_FLOAT16;
+  }
+  if (strcmp(name, "int16") == 0) {
+    return SIMMATRIX_DTYPE_INT16;
+  }
+  return -1;
+}
+
+/**
+ * Converts floats to the given data type.
+ *
+ * @param float * values
+ *   The values to convert.
+ * @param int n
+ *   The number of values.
+ * @param int dtype
+ *   One of the SIMMATRIX_DTYPE values.
+ * @param float scale
+ *   For SIMMATRIX_DTYPE_INT16, the value stored as 32767. Larger values
+ *   are clamped.
+ * @param void * out
+ *   An array of n values of the data type.
+ */
+void simmatrix_encode(float * values, int n, int dtype, float scale, void * out) {
+  if (dtype == SIMMATRIX_DTYPE_FLOAT16) {
+    unsigned short * h = (unsigned short *) out;
+    for (int i = 0; i < n; i++) {
+      h[i] = float_to_half(values[i]);
+    }
+  }
+  else if (dtype == SIMMATRIX_DTYPE_INT16) {
+    short * q = (short *) out;
+    float factor = 32767 / scale;
+    for (int i = 0; i < n; i++) {
+      if (isnan(values[i])) {
+        q[i] = SIMMATRIX_INT16_NAN;
+        continue;
+      }
+      float v = values[i] * factor;
+      if (v > 32767) {
+        v = 32767;
+      }
+      if (v < -32767) {
+        v = -32767;
+      }
+      q[i] = (short) lrintf(v);
+    }
+  }
+  else {
+    memcpy(out, values, sizeof(float) * n);
+  }
+}
+
+/**
+ * Converts values of the given data type to floats.
+ *
+ * @param void * in
+ *   An array of n values of the data type.
+ * @param int n
+ *   The number of values.
+ * @param int dtype
+ *   One of the SIMMATRIX_DTYPE values.
+ * @param float scale
+ *   For SIMMATRIX_DTYPE_INT16, the value stored as 32767.
+ * @param float * values
+ *   An array of n floats.
+ */
+void simmatrix_decode(void * in, int n, int dtype, float scale, float * values) {
+  if (dtype == SIMMATRIX_DTYPE_FLOAT16) {
+    unsigned short * h = (unsigned short *) in;
+    for (int i = 0; i < n; i++) {
+      values[i] = half_table[h[i]];
+    }
+  }
+  else if (dtype == SIMMATRIX_DTYPE_INT16) {
+    short * q = (short *) in;
+    float factor = scale / 32767;
+    for (int i = 0; i < n; i++) {
+      values[i] = q[i] == SIMMATRIX_INT16_NAN ? NAN : q[i] * factor;
+    }
+  }
+  else {
+    memcpy(values, in, sizeof(float) * n);
+  }
+}
+
+/**
+ * Retrieves the number of tiles on or below the diagonal of a matrix.
+ *
+ * @param int num_genes
+ * @param int tile_size
+ *
+ * @return long long int
+ */
+long long int simmatrix_num_tiles(int num_genes, int tile_size) {
+  long long int num_bands = (num_genes + tile_size - 1) / tile_size;
+  return num_bands * (num_bands + 1) / 2;
+}
+
+/**
+ * Compresses a tile.
+ *
+ * @param void * values
+ *   The n values of the tile, already converted to the data type.
+ * @param int n
+ *   The number of values.
+ * @param int size
+ *   The size of a value in bytes.
+ * @param unsigned char * scratch
+ *   A buffer of n * size bytes.
+ * @param unsigned char * out
+ *   Receives the tile. It must hold lz_bound(n * size) bytes.
+ *
+ * @return int
+ *   The number of bytes to store. If it equals n * size the tile is not
+ *   compressed.
+ */
+int simmatrix_pack_tile(void * values, int n, int size, unsigned char * scratch, unsigned char * out) {
+  int raw_size = n * size;
+
+  byte_shuffle((unsigned char *) values, n, size, scratch);
+  int out_size = lz_compress(scratch, raw_size, out);
+  if (out_size >= raw_size) {
+    memcpy(out, scratch, raw_size);
+    return raw_size;
+  }
+  return out_size;
+}
+
+/**
+ * Decompresses a tile and converts its values to floats.
+ *
+ * @param unsigned char * in
+ *   The stored tile.
+ * @param int in_size
+ *   The stored size of the tile.
+ * @param int n
+ *   The number of values in the tile.
+ * @param int dtype
+ *   One of the SIMMATRIX_DTYPE values.
+ * @param float scale
+ *   The fixed point scale.
+ * @param unsigned char * scratch1
+ * @param unsigned char * scratch2
+ *   Two buffers of n * 4 bytes.
+ * @param float * values
+ *   Receives the n values.
+ *
+ * @return int
+ *   0 on success or -1 if the tile is corrupt.
+ */
+int simmatrix_unpack_tile(unsigned char * in, int in_size, int n, int dtype, float scale,
+    unsigned char * scratch1, unsigned char * scratch2, float * values) {
+  int size = simmatrix_dtype_size(dtype);
+  int raw_size = n * size;
+  unsigned char * shuffled = in;
+
+  if (in_size != raw_size) {
+    if (lz_decompress(in, in_size, scratch1, raw_size) != raw_size) {
+      return -1;
+    }
+    shuffled = scratch1;
+  }
+  byte_unshuffle(shuffled, n, size, scratch2);
+  simmatrix_decode(scratch2, n, dtype, scale, values);
+  return 0;
+}
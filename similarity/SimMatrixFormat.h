@@ -0,0 +1,136 @@
+#ifndef _SIMMATRIXFORMAT_
+#define _SIMMATRIXFORMAT_
+
+// The file formats for similarity matrices.
+// The original format: a directory of <prefix>.<method><N>.bin files.
+#define SIMMATRIX_FORMAT_BIN 0
+// A single indexed file: <prefix>.<method>.sim
+#define SIMMATRIX_FORMAT_SIM 1
+
+// The magic string at the start of a .sim file and its format version.
+// Version 1 files have only the first 64 bytes of the header and always
+// store rows.
+#define SIMMATRIX_MAGIC "RMTGNSIM"
+#define SIMMATRIX_VERSION 2
+#define SIMMATRIX_HEADER_V1_SIZE 64
+
+// The layouts of the values in a .sim file.
+// The lower triangle row by row.
+#define SIMMATRIX_LAYOUT_ROWS 0
+// Compressed square tiles of the lower triangle.
+#define SIMMATRIX_LAYOUT_TILES 1
+// The number of rows and columns of a tile.
+#define SIMMATRIX_TILE_SIZE 256
+
+// The index of the tile that holds rows bi * tile_size and on and columns
+// bj * tile_size and on, where bj <= bi.
+#define SIMMATRIX_TILE_INDEX(bi, bj) ((long long int) (bi) * ((bi) + 1) / 2 + (bj))
+
+// The data types of the stored similarity values.
+// 4-byte IEEE floats.
+#define SIMMATRIX_DTYPE_FLOAT32 0
+// 2-byte IEEE half precision floats.
+#define SIMMATRIX_DTYPE_FLOAT16 1
+// 2-byte fixed point: the value x is stored as round(x / scale * 32767).
+// SIMMATRIX_INT16_NAN is reserved for missing (NaN) values.
+#define SIMMATRIX_DTYPE_INT16 2
+#define SIMMATRIX_INT16_NAN -32768
+
+/**
+ * The header of a .sim similarity matrix file.
+ *
+ * A .sim file holds the lower triangle of the matrix, including the
+ * diagonal, directly after the header.  The values are followed by the
+ * gene-name table, which holds each gene name terminated by a zero byte,
+ * and by the index.  Because the table and index come after the values,
+ * rows for new genes can be appended without moving the existing rows.  In
+ * the rows layout the new rows, table and index follow the old table and
+ * index, which are left unused, so rows need not be next to each other.
+ *
+ * In the rows layout the values are stored row by row and the index holds
+ * num_genes + 1 file offsets: the offset of each row and the offset just
+ * past the last row.
+ *
+ * In the tiles layout the matrix is divided in squares of tile_size rows
+ * and columns.  The tiles on or below the diagonal are stored in the order
+ * of SIMMATRIX_TILE_INDEX, so all tiles of a band of rows are next to each
+ * other.  Each tile holds its values row by row, with NaN above the
+ * diagonal, with the bytes shuffled (see byte_shuffle()) and compressed
+ * with the LZ codec.  A tile that would not become smaller is stored
+ * uncompressed.  The index holds the offset of every tile and the offset
+ * just past the last tile, so the size of a tile tells whether it is
+ * compressed.
+ *
+ * The index may be followed by a zone map: one simmatrix_zone_t for every
+ * square of zone_size rows and columns on or below the diagonal, in the
+ * order of SIMMATRIX_TILE_INDEX.  Readers use it to skip the parts of the
+ * matrix that cannot hold a value above a threshold.
+ *
+ * The header is written last, so a file that was not completely written
+ * has no magic string and is rejected by the reader.
+ */
+typedef struct {
+  // SIMMATRIX_MAGIC, not zero terminated.
+  char magic[8];
+  // SIMMATRIX_VERSION
+  int version;
+  // One of the SIMMATRIX_DTYPE values.
+  int dtype;
+  // The similarity method: pc, sc, kc, bc or mi. Zero terminated.
+  char method[8];
+  // The number of genes (rows) in the matrix.
+  int num_genes;
+  // For SIMMATRIX_DTYPE_INT16, the value that is stored as 32767.
+  // Otherwise zero.
+  float scale;
+  // The file offsets of the first row, the gene-name table and the row
+  // index, and the size of the gene-name table in bytes.
+  long long int rows_offset;
+  long long int genes_offset;
+  long long int genes_size;
+  long long int index_offset;
+
+  // The fields below were added in version 2.
+  // SIMMATRIX_LAYOUT_ROWS or SIMMATRIX_LAYOUT_TILES.
+  int layout;
+  // For the tiles layout, the number of rows and columns of a tile.
+  int tile_size;
+  // The file offset of the zone map, or 0 if there is none.
+  long long int zones_offset;
+  // The number of rows and columns of a zone.
+  int zone_size;
+  // Unused. Set to zero.
+  int reserved1;
+  long long int reserved[5];
+} simmatrix_header_t;
+
+/**
+ * A zone map entry.  It summarizes the values of a zone of the matrix,
+ * leaving out the diagonal.
+ */
+typedef struct {
+  // An upper bound of the absolute values, as they are read back.
+  float max_abs;
+  // The number of values that are not NaN.
+  int num_values;
+} simmatrix_zone_t;
+
+// Retrieves the size in bytes of a value of the given data type.
+int simmatrix_dtype_size(int dtype);
+// Retrieves the data type with the given name (float32, float16 or int16)
+// or -1 if there is none.
+int simmatrix_dtype_parse(char * name);
+// Converts n floats to the given data type.
+void simmatrix_encode(float * values, int n, int dtype, float scale, void * out);
+// Converts n values of the given data type to floats.
+void simmatrix_decode(void * in, int n, int dtype, float scale, float * values);
+
+// Retrieves the number of tiles of a matrix.
+long long int simmatrix_num_tiles(int num_genes, int tile_size);
+// Compresses a tile of n values of size bytes each. Returns the stored size.
+int simmatrix_pack_tile(void * values, int n, int size, unsigned char * scratch, unsigned char * out);
+// Decompresses a tile of n values to floats. Returns 0 or -1 if it is corrupt.
+int simmatrix_unpack_tile(unsigned char * in, int in_size, int n, int dtype, float scale,
+    unsigned char * scratch1, unsigned char * scratch2, float * values);
+
+#endif
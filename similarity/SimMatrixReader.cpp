@@ -0,0 +1,863 @@
+#include "SimMatrixReader.h"
+#include "../general/lz.h"
+
+/**
+ * Constructor.
+ *
+ * @param char * dir
+ *   The directory of the similarity matrix.
+ * @param char * prefix
+ *   The file prefix, usually the expression matrix file name without the
+ *   extension.
+ * @param char * method
+ *   The similarity method: pc, sc, kc, bc or mi.
+ */
+SimMatrixReader::SimMatrixReader(char * dir, char * prefix, char * method) {
+  char filename[1024];
+
+  this->dir = dir;
+  this->prefix = prefix;
+  this->method = method;
+  this->genes = NULL;
+  this->gene_table = NULL;
+  this->row_offsets = NULL;
+  this->rows_per_file = 0;
+  this->dtype = SIMMATRIX_DTYPE_FLOAT32;
+  this->dtype_size = sizeof(float);
+  this->scale = 0;
+  this->layout = SIMMATRIX_LAYOUT_ROWS;
+  this->tile_size = 0;
+  this->num_tiles = 0;
+  this->tile_offsets = NULL;
+  this->cur_band = -1;
+  this->cur_band_min = 0;
+  this->band_rows = NULL;
+  this->cur_tile = -1;
+  this->tile_values = NULL;
+  this->scratch = NULL;
+  this->num_threads = 0;
+  this->zones = NULL;
+  this->zone_size = 0;
+  this->num_maps = 0;
+  this->maps = NULL;
+  this->map_sizes = NULL;
+
+  SimMatrixWriter::getSimFileName(dir, prefix, method, filename);
+  if (access(filename, F_OK) == 0) {
+    format = SIMMATRIX_FORMAT_SIM;
+    openSim(filename);
+  }
+  else {
+    format = SIMMATRIX_FORMAT_BIN;
+    openBins();
+  }
+
+  int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  setNumThreads(num_cpus > 0 ? num_cpus : 1);
+}
+
+/**
+ * Destructor.
+ */
+SimMatrixReader::~SimMatrixReader() {
+  for (int i = 0; i < num_maps; i++) {
+    munmap(maps[i], map_sizes[i]);
+  }
+  free(maps);
+  free(map_sizes);
+  free(genes);
+  free(gene_table);
+  free(row_offsets);
+  free(tile_offsets);
+  free(band_rows);
+  free(tile_values);
+  free(zones);
+  setNumThreads(0);
+}
+
+/**
+ * Sets the number of threads that decompress the tiles of a band or scan
+ * the rows of the matrix.
+ *
+ * @param int num_threads
+ */
+void SimMatrixReader::setNumThreads(int num_threads) {
+  for (int i = 0; i < this->num_threads; i++) {
+    free(scratch[2 * i]);
+    free(scratch[2 * i + 1]);
+  }
+  free(scratch);
+  scratch = NULL;
+
+  this->num_threads = num_threads;
+  if (num_threads > 0) {
+    scratch = (unsigned char **) malloc(sizeof(unsigned char *) * 2 * num_threads);
+    for (int i = 0; i < 2 * num_threads; i++) {
+      scratch[i] = (unsigned char *) malloc(sizeof(float) * tile_size * tile_size);
+    }
+  }
+}
+
+/**
+ * Maps a file into memory for reading.  The mapping is advised for
+ * sequential access.
+ *
+ * @param char * filename
+ * @param long long int * size
+ *   Set to the size of the file.
+ *
+ * @return unsigned char *
+ */
+unsigned char * SimMatrixReader::mapFile(char * filename, long long int * size) {
+  struct stat st;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+    fprintf(stderr, "ERROR: could not open similarity matrix file: '%s'\n", filename);
+    exit(-1);
+  }
+  void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "ERROR: could not map similarity matrix file: '%s'\n", filename);
+    exit(-1);
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  *size = st.st_size;
+  return (unsigned char *) map;
+}
+
+/**
+ * Asks the kernel to read part of a mapping ahead of its use.
+ *
+ * @param unsigned char * start
+ * @param long long int size
+ */
+static void advise_willneed(unsigned char * start, long long int size) {
+  long long int page = sysconf(_SC_PAGESIZE);
+  long long int skew = (long long int) ((size_t) start % page);
+
+  if (size > 0) {
+    madvise(start - skew, size + skew, MADV_WILLNEED);
+  }
+}
+
+/**
+ * Opens a .sim file: reads its header, gene names, index and zone map, and
+ * maps it.
+ *
+ * @param char * filename
+ */
+void SimMatrixReader::openSim(char * filename) {
+  simmatrix_header_t header;
+
+  FILE * fh = fopen(filename, "rb");
+  if (!fh) {
+    fprintf(stderr, "ERROR: could not open sim file: '%s'\n", filename);
+    exit(-1);
+  }
+  // Version 1 files have a shorter header and always store rows.
+  memset(&header, 0, sizeof(header));
+  if (fread(&header, SIMMATRIX_HEADER_V1_SIZE, 1, fh) != 1 ||
+      memcmp(header.magic, SIMMATRIX_MAGIC, 8) != 0 ||
+      (header.version >= 2 &&
+       fread((char *) &header + SIMMATRIX_HEADER_V1_SIZE, sizeof(header) - SIMMATRIX_HEADER_V1_SIZE, 1, fh) != 1)) {
+    fprintf(stderr, "ERROR: '%s' is not a similarity matrix or was not completely written.\n", filename);
+    exit(-1);
+  }
+  if (header.version > SIMMATRIX_VERSION ||
+      (header.layout != SIMMATRIX_LAYOUT_ROWS && header.layout != SIMMATRIX_LAYOUT_TILES) ||
+      (header.dtype != SIMMATRIX_DTYPE_FLOAT32 &&
+       header.dtype != SIMMATRIX_DTYPE_FLOAT16 &&
+       header.dtype != SIMMATRIX_DTYPE_INT16)) {
+    fprintf(stderr, "ERROR: The sim file '%s' has an unsupported version (%d) or data type (%d).\n",
+        filename, header.version, header.dtype);
+    exit(-1);
+  }
+  num_genes = header.num_genes;
+  dtype = header.dtype;
+  dtype_size = simmatrix_dtype_size(dtype);
+  scale = header.scale;
+  layout = header.layout;
+
+  // Read the gene names.
+  gene_table = (char *) malloc(sizeof(char) * header.genes_size);
+  genes = (char **) malloc(sizeof(char *) * num_genes);
+  fseek(fh, header.genes_offset, SEEK_SET);
+  if (fread(gene_table, sizeof(char), header.genes_size, fh) != (size_t) header.genes_size) {
+    fprintf(stderr, "ERROR: cannot read the gene names of the sim file: '%s'\n", filename);
+    exit(-1);
+  }
+  long long int pos = 0;
+  for (int i = 0; i < num_genes; i++) {
+    genes[i] = &gene_table[pos];
+    pos += strlen(genes[i]) + 1;
+  }
+
+  // Read the index of the rows or tiles.
+  long long int end;
+  fseek(fh, header.index_offset, SEEK_SET);
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    tile_size = header.tile_size;
+    num_tiles = simmatrix_num_tiles(num_genes, tile_size);
+    tile_offsets = (long long int *) malloc(sizeof(long long int) * (num_tiles + 1));
+    if (tile_size <= 0 ||
+        fread(tile_offsets, sizeof(long long int), num_tiles + 1, fh) != (size_t) num_tiles + 1) {
+      fprintf(stderr, "ERROR: cannot read the tile index of the sim file: '%s'\n", filename);
+      exit(-1);
+    }
+    band_rows = (float *) malloc(sizeof(float) * tile_size * num_genes);
+    tile_values = (float *) malloc(sizeof(float) * tile_size * tile_size);
+    end = tile_offsets[num_tiles];
+  }
+  else {
+    row_offsets = (long long int *) malloc(sizeof(long long int) * (num_genes + 1));
+    if (fread(row_offsets, sizeof(long long int), num_genes + 1, fh) != (size_t) num_genes + 1) {
+      fprintf(stderr, "ERROR: cannot read the row index of the sim file: '%s'\n", filename);
+      exit(-1);
+    }
+    end = row_offsets[num_genes];
+  }
+
+  // Read the zone map.
+  if (header.version >= 2 && header.zones_offset != 0) {
+    zone_size = header.zone_size;
+    long long int num_zones = simmatrix_num_tiles(num_genes, zone_size);
+    zones = (simmatrix_zone_t *) malloc(sizeof(simmatrix_zone_t) * num_zones);
+    fseek(fh, header.zones_offset, SEEK_SET);
+    if (zone_size <= 0 || fread(zones, sizeof(simmatrix_zone_t), num_zones, fh) != (size_t) num_zones) {
+      fprintf(stderr, "ERROR: cannot read the zone map of the sim file: '%s'\n", filename);
+      exit(-1);
+    }
+  }
+  fclose(fh);
+
+  num_maps = 1;
+  maps = (unsigned char **) malloc(sizeof(unsigned char *));
+  map_sizes = (long long int *) malloc(sizeof(long long int));
+  maps[0] = mapFile(filename, &map_sizes[0]);
+  if (end > map_sizes[0]) {
+    fprintf(stderr, "ERROR: The sim file '%s' is shorter than its index.\n", filename);
+    exit(-1);
+  }
+
+  printf("  Reading similarity matrix: %s (%d genes%s)\n", filename, num_genes,
+      layout == SIMMATRIX_LAYOUT_TILES ? ", compressed tiles" : "");
+}
+
+/**
+ * Maps the .bin files and checks their headers and sizes.
+ */
+void SimMatrixReader::openBins() {
+  char filename[1024];
+
+  sprintf(filename, "%s/%s.%s%d.bin", dir, prefix, method, 0);
+  FILE * fh = fopen(filename, "rb");
+  if (!fh) {
+    fprintf(stderr, "ERROR: Could not find a similarity matrix: there is no '%s/%s.%s.sim'\n", dir, prefix, method);
+    fprintf(stderr, "or '%s' file.\n", filename);
+    exit(-1);
+  }
+  if (fread(&num_genes, sizeof(int), 1, fh) != 1 ||
+      fread(&rows_per_file, sizeof(int), 1, fh) != 1 ||
+      num_genes <= 0 || rows_per_file <= 0) {
+    fprintf(stderr, "ERROR: cannot read bin file: '%s'\n", filename);
+    exit(-1);
+  }
+  fclose(fh);
+
+  num_maps = (num_genes - 1) / rows_per_file + 1;
+  maps = (unsigned char **) malloc(sizeof(unsigned char *) * num_maps);
+  map_sizes = (long long int *) malloc(sizeof(long long int) * num_maps);
+  for (int bin = 0; bin < num_maps; bin++) {
+    sprintf(filename, "%s/%s.%s%d.bin", dir, prefix, method, bin);
+    maps[bin] = mapFile(filename, &map_sizes[bin]);
+
+    // Row i of the matrix holds i + 1 values, so the size of each file is
+    // known.
+    long long int first = (long long int) bin * rows_per_file;
+    long long int lines = num_genes - first < rows_per_file ? num_genes - first : rows_per_file;
+    long long int num_values = lines * (2 * first + lines + 1) / 2;
+    if (map_sizes[bin] != 2 * (long long int) sizeof(int) + num_values * (long long int) sizeof(float) ||
+        ((int *) maps[bin])[0] != num_genes) {
+      fprintf(stderr, "ERROR: The bin file '%s' does not belong to a %d gene matrix.\n", filename, num_genes);
+      exit(-1);
+    }
+  }
+
+  printf("  Reading similarity matrix: %s/%s.%s*.bin (%d genes, %d files)\n", dir, prefix,
+      method, num_genes, num_maps);
+}
+
+/**
+ * Retrieves the address of the first value of a row in the mapping.
+ *
+ * @param int j
+ *   The row.
+ *
+ * @return unsigned char *
+ */
+unsigned char * SimMatrixReader::rowBytes(int j) {
+  if (format == SIMMATRIX_FORMAT_SIM) {
+    return maps[0] + row_offsets[j];
+  }
+
+  // The position of row j in its file follows from the first row of the
+  // file.
+  int bin = j / rows_per_file;
+  long long int first = (long long int) bin * rows_per_file;
+  long long int pos = ((long long int) j * (j + 1) - first * (first + 1)) / 2;
+  return maps[bin] + 2 * sizeof(int) + pos * sizeof(float);
+}
+
+/**
+ * Asks the kernel to read a range of rows ahead of their use.
+ *
+ * @param int first
+ * @param int last
+ *   The first and last row.
+ */
+void SimMatrixReader::adviseRows(int first, int last) {
+  int j = first;
+
+  while (j <= last) {
+    // The rows of .bin files are only contiguous within a file.
+    int end = last;
+    if (format == SIMMATRIX_FORMAT_BIN && end >= (j / rows_per_file + 1) * rows_per_file) {
+      end = (j / rows_per_file + 1) * rows_per_file - 1;
+    }
+    unsigned char * start = rowBytes(j);
+    advise_willneed(start, rowBytes(end) + (long long int) (end + 1) * dtype_size - start);
+    j = end + 1;
+  }
+}
+
+/**
+ * Indicates if a zone may hold a value whose absolute value is at least
+ * min_abs.  Without a zone map or a threshold, every zone may.
+ *
+ * @param int zi
+ * @param int zj
+ *   The row and column of the zone.
+ * @param float min_abs
+ *
+ * @return int
+ */
+int SimMatrixReader::zoneMayHold(int zi, int zj, float min_abs) {
+  if (!zones || min_abs <= 0) {
+    return 1;
+  }
+  simmatrix_zone_t * zone = &zones[SIMMATRIX_TILE_INDEX(zi, zj)];
+  return zone->num_values > 0 && zone->max_abs >= min_abs;
+}
+
+/**
+ * Indicates if a tile may hold a value whose absolute value is at least
+ * min_abs.  Zones that do not line up with the tiles are not used.
+ *
+ * @param int bi
+ * @param int bj
+ *   The band and column of the tile.
+ * @param float min_abs
+ *
+ * @return int
+ */
+int SimMatrixReader::tileMayHold(int bi, int bj, float min_abs) {
+  if (zone_size != tile_size) {
+    return 1;
+  }
+  return zoneMayHold(bi, bj, min_abs);
+}
+
+/**
+ * Indicates if a row may hold a value whose absolute value is at least
+ * min_abs.
+ *
+ * @param int j
+ * @param float min_abs
+ *
+ * @return int
+ */
+int SimMatrixReader::rowMayHold(int j, float min_abs) {
+  if (!zones || min_abs <= 0) {
+    return 1;
+  }
+  for (int zj = 0; zj <= j / zone_size; zj++) {
+    if (zoneMayHold(j / zone_size, zj, min_abs)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Decompresses a tile from the mapping.
+ *
+ * @param int bi
+ * @param int bj
+ *   The band and column of the tile.
+ * @param unsigned char * scratch1
+ * @param unsigned char * scratch2
+ *   Buffers to decompress a tile.
+ * @param float * values
+ *   Receives the values of the tile, row by row.
+ */
+void SimMatrixReader::unpackTile(int bi, int bj, unsigned char * scratch1, unsigned char * scratch2,
+    float * values) {
+  long long int t = SIMMATRIX_TILE_INDEX(bi, bj);
+  int h = num_genes - bi * tile_size < tile_size ? num_genes - bi * tile_size : tile_size;
+  int w = num_genes - bj * tile_size < tile_size ? num_genes - bj * tile_size : tile_size;
+
+  if (simmatrix_unpack_tile(maps[0] + tile_offsets[t], tile_offsets[t + 1] - tile_offsets[t], h * w,
+      dtype, scale, scratch1, scratch2, values) != 0) {
+    fprintf(stderr, "ERROR: tile (%d, %d) of the similarity matrix is corrupt.\n", bi, bj);
+    exit(-1);
+  }
+}
+
+/**
+ * Decompresses every step-th tile of a band, starting with tile first, into
+ * the rows of the band.  Tiles that cannot hold a value of at least min_abs
+ * are set to NaN instead.
+ *
+ * @param int bi
+ *   The band.
+ * @param float min_abs
+ * @param int first
+ * @param int step
+ * @param float * rows
+ *   The rows of the band, each num_genes values apart.
+ * @param unsigned char * scratch1
+ * @param unsigned char * scratch2
+ *   Buffers to decompress a tile.
+ * @param float * values
+ *   A buffer for the values of a tile.
+ */
+void SimMatrixReader::unpackBand(int bi, float min_abs, int first, int step, float * rows,
+    unsigned char * scratch1, unsigned char * scratch2, float * values) {
+  int T = tile_size;
+  int h = num_genes - bi * T < T ? num_genes - bi * T : T;
+
+  for (int bj = first; bj <= bi; bj += step) {
+    int w = num_genes - bj * T < T ? num_genes - bj * T : T;
+    if (!tileMayHold(bi, bj, min_abs)) {
+      for (int i = 0; i < h; i++) {
+        float * dst = rows + (long long int) i * num_genes + bj * T;
+        for (int c = 0; c < w; c++) {
+          dst[c] = NAN;
+        }
+      }
+      continue;
+    }
+    unpackTile(bi, bj, scratch1, scratch2, values);
+    for (int i = 0; i < h; i++) {
+      memcpy(rows + (long long int) i * num_genes + bj * T, values + i * w, sizeof(float) * w);
+    }
+  }
+}
+
+// The arguments of a thread that decompresses part of a band.
+typedef struct {
+  SimMatrixReader * reader;
+  int bi;
+  int thread;
+} unpack_band_arg_t;
+
+/**
+ * Decompresses every num_threads-th tile of the current band, starting
+ * with the thread number, into the rows of the band.
+ *
+ * @param void * arg
+ *   An unpack_band_arg_t.
+ */
+void * SimMatrixReader::unpackBandThread(void * arg) {
+  unpack_band_arg_t * a = (unpack_band_arg_t *) arg;
+  SimMatrixReader * r = a->reader;
+  float * values = (float *) malloc(sizeof(float) * r->tile_size * r->tile_size);
+
+  r->unpackBand(a->bi, r->cur_band_min, a->thread, r->num_threads, r->band_rows,
+      r->scratch[2 * a->thread], r->scratch[2 * a->thread + 1], values);
+  free(values);
+  return NULL;
+}
+
+/**
+ * Decompresses the tiles of a band of rows.
+ *
+ * @param int bi
+ *   The band.
+ * @param float min_abs
+ *   The tiles that cannot hold a value of at least min_abs are set to NaN
+ *   instead.
+ */
+void SimMatrixReader::loadBand(int bi, float min_abs) {
+  long long int first = SIMMATRIX_TILE_INDEX(bi, 0);
+  long long int last = SIMMATRIX_TILE_INDEX(bi, bi);
+
+  // The tiles of a band are next to each other. Request the ones from the
+  // first to the last tile that is needed at once.
+  cur_band_min = min_abs;
+  long long int from = first;
+  long long int to = last;
+  while (from <= last && !tileMayHold(bi, from - first, min_abs)) {
+    from++;
+  }
+  while (to >= from && !tileMayHold(bi, to - first, min_abs)) {
+    to--;
+  }
+  if (from <= to) {
+    advise_willneed(maps[0] + tile_offsets[from], tile_offsets[to + 1] - tile_offsets[from]);
+  }
+
+  int n = num_threads < bi + 1 ? num_threads : bi + 1;
+  pthread_t * threads = (pthread_t *) malloc(sizeof(pthread_t) * n);
+  unpack_band_arg_t * args = (unpack_band_arg_t *) malloc(sizeof(unpack_band_arg_t) * n);
+  for (int i = 0; i < n; i++) {
+    args[i].reader = this;
+    args[i].bi = bi;
+    args[i].thread = i;
+    if (i > 0) {
+      pthread_create(&threads[i], NULL, unpackBandThread, &args[i]);
+    }
+  }
+  unpackBandThread(&args[0]);
+  for (int i = 1; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(args);
+  cur_band = bi;
+}
+
+/**
+ * Reads a row of the lower triangle of the matrix.
+ *
+ * @param int j
+ *   The row, starting at zero.
+ * @param float * row
+ *   An array of at least j + 1 floats. Upon return it holds the similarity
+ *   of gene j with genes 0 to j.
+ */
+void SimMatrixReader::readRow(int j, float * row) {
+  readRow(j, row, 0);
+}
+
+/**
+ * Reads a row of the lower triangle of the matrix, leaving out the zones
+ * that cannot hold a value of at least a threshold.
+ *
+ * @param int j
+ *   The row, starting at zero.
+ * @param float * row
+ *   An array of at least j + 1 floats. Upon return it holds the similarity
+ *   of gene j with genes 0 to j. Values of zones that were left out are
+ *   NaN, and so may be the value on the diagonal.
+ * @param float min_abs
+ *   The threshold. Use 0 to read every value.
+ *
+ * @return int
+ *   0 if no value of the row can be at least min_abs, in which case the row
+ *   is not read.
+ */
+int SimMatrixReader::readRow(int j, float * row, float min_abs) {
+  if (j < 0 || j >= num_genes) {
+    fprintf(stderr, "ERROR: row %d is not in the similarity matrix.\n", j + 1);
+    exit(-1);
+  }
+
+  // Find the zones of the row that are needed.
+  int zi = zones ? j / zone_size : 0;
+  int num_needed = zi + 1;
+  if (zones && min_abs > 0) {
+    num_needed = 0;
+    for (int zj = 0; zj <= zi; zj++) {
+      num_needed += zoneMayHold(zi, zj, min_abs);
+    }
+  }
+  if (num_needed == 0) {
+    return 0;
+  }
+
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    // A band read with a higher threshold lacks values that are needed now.
+    if (j / tile_size != cur_band || min_abs < cur_band_min) {
+      loadBand(j / tile_size, min_abs);
+    }
+    memcpy(row, band_rows + (long long int) (j % tile_size) * num_genes, sizeof(float) * (j + 1));
+    return 1;
+  }
+
+  unsigned char * in = rowBytes(j);
+  if (num_needed == zi + 1) {
+    simmatrix_decode(in, j + 1, dtype, scale, row);
+    return 1;
+  }
+
+  // Read only the zones that are needed.
+  for (int zj = 0; zj <= zi; zj++) {
+    int start = zj * zone_size;
+    int end = start + zone_size < j + 1 ? start + zone_size : j + 1;
+    if (zoneMayHold(zi, zj, min_abs)) {
+      simmatrix_decode(in + (long long int) start * dtype_size, end - start, dtype, scale, row + start);
+      continue;
+    }
+    for (int c = start; c < end; c++) {
+      row[c] = NAN;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Retrieves a row of the lower triangle in place, without copying it.
+ * This is only possible for rows of 4-byte floats.
+ *
+ * @param int j
+ *   The row, starting at zero.
+ *
+ * @return float *
+ *   The j + 1 values of the row, which must not be changed, or NULL if the
+ *   row is not stored as floats.
+ */
+float * SimMatrixReader::getRowSpan(int j) {
+  if (layout != SIMMATRIX_LAYOUT_ROWS || dtype != SIMMATRIX_DTYPE_FLOAT32 || j < 0 || j >= num_genes) {
+    return NULL;
+  }
+  return (float *) rowBytes(j);
+}
+
+// The state shared by the threads of scanRows().
+typedef struct {
+  SimMatrixReader * reader;
+  float min_abs;
+  simmatrix_row_func func;
+  void * arg;
+  // The rows are handed out in blocks, the last, longest rows first.
+  int block_rows;
+  int next_block;
+  pthread_mutex_t lock;
+} scan_state_t;
+
+// The arguments of a thread of scanRows().
+typedef struct {
+  scan_state_t * state;
+  int thread;
+} scan_arg_t;
+
+/**
+ * Reads blocks of rows until none are left and calls the row function for
+ * each row that may hold a value of at least the threshold.
+ *
+ * @param void * arg
+ *   A scan_arg_t.
+ */
+void * SimMatrixReader::scanThread(void * arg) {
+  scan_arg_t * a = (scan_arg_t *) arg;
+  scan_state_t * s = a->state;
+  SimMatrixReader * r = s->reader;
+  float * row = (float *) malloc(sizeof(float) * r->num_genes);
+  float * band = NULL;
+  float * values = NULL;
+
+  if (r->layout == SIMMATRIX_LAYOUT_TILES) {
+    band = (float *) malloc(sizeof(float) * r->tile_size * r->num_genes);
+    values = (float *) malloc(sizeof(float) * r->tile_size * r->tile_size);
+  }
+
+  while (1) {
+    pthread_mutex_lock(&s->lock);
+    int block = s->next_block--;
+    pthread_mutex_unlock(&s->lock);
+    if (block < 0) {
+      break;
+    }
+    int first = block * s->block_rows;
+    int last = first + s->block_rows < r->num_genes ? first + s->block_rows - 1 : r->num_genes - 1;
+
+    if (band) {
+      // A block is a band of tiles.
+      long long int t = SIMMATRIX_TILE_INDEX(block, 0);
+      advise_willneed(r->maps[0] + r->tile_offsets[t], r->tile_offsets[t + block + 1] - r->tile_offsets[t]);
+      r->unpackBand(block, s->min_abs, 0, 1, band, r->scratch[2 * a->thread], r->scratch[2 * a->thread + 1], values);
+      for (int j = first; j <= last; j++) {
+        if (r->rowMayHold(j, s->min_abs)) {
+          s->func(j, band + (long long int) (j - first) * r->num_genes, a->thread, s->arg);
+        }
+      }
+      continue;
+    }
+
+    r->adviseRows(first, last);
+    for (int j = first; j <= last; j++) {
+      if (!r->rowMayHold(j, s->min_abs)) {
+        continue;
+      }
+      float * span = r->getRowSpan(j);
+      if (!span) {
+        simmatrix_decode(r->rowBytes(j), j + 1, r->dtype, r->scale, row);
+        span = row;
+      }
+      s->func(j, span, a->thread, s->arg);
+    }
+  }
+  free(row);
+  free(band);
+  free(values);
+  return NULL;
+}
+
+/**
+ * Reads the rows of the matrix with several threads.  Each thread reads
+ * blocks of rows, a band of tiles at a time for the tiles layout, and calls
+ * a function for every row.  Rows of 4-byte floats are passed in place.
+ * The rows are not passed in order, and the function is called by the
+ * threads at the same time, so it may only change data of its own row or
+ * thread.
+ *
+ * @param float min_abs
+ *   Rows without a zone that may hold a value of at least min_abs are not
+ *   read.  In the rows that are, values that cannot be at least min_abs may
+ *   be NaN.  Use 0 to read every row and value.
+ * @param simmatrix_row_func func
+ *   Called with the row number, its j + 1 values, the thread number (below
+ *   getNumThreads()) and arg.
+ * @param void * arg
+ */
+void SimMatrixReader::scanRows(float min_abs, simmatrix_row_func func, void * arg) {
+  scan_state_t state;
+  int n = num_threads > 0 ? num_threads : 1;
+
+  state.reader = this;
+  state.min_abs = min_abs;
+  state.func = func;
+  state.arg = arg;
+  state.block_rows = layout == SIMMATRIX_LAYOUT_TILES ? tile_size : SIMMATRIX_TILE_SIZE;
+  state.next_block = (num_genes - 1) / state.block_rows;
+  pthread_mutex_init(&state.lock, NULL);
+  if (num_threads < 1) {
+    setNumThreads(1);
+  }
+
+  pthread_t * threads = (pthread_t *) malloc(sizeof(pthread_t) * n);
+  scan_arg_t * args = (scan_arg_t *) malloc(sizeof(scan_arg_t) * n);
+  for (int i = 0; i < n; i++) {
+    args[i].state = &state;
+    args[i].thread = i;
+    if (i > 0) {
+      pthread_create(&threads[i], NULL, scanThread, &args[i]);
+    }
+  }
+  scanThread(&args[0]);
+  for (int i = 1; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(args);
+  pthread_mutex_destroy(&state.lock);
+}
+
+/**
+ * Reads a single value of the matrix.
+ *
+ * @param int x
+ *   The row, starting at zero.
+ * @param int y
+ *   The column, starting at zero. It must not be larger than x.
+ *
+ * @return float
+ */
+float SimMatrixReader::getValue(int x, int y) {
+  float value;
+
+  if (x < 0 || x >= num_genes || y < 0 || y > x) {
+    fprintf(stderr, "ERROR: (%d, %d) is not in the similarity matrix.\n", x + 1, y + 1);
+    exit(-1);
+  }
+
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    int bi = x / tile_size;
+    int bj = y / tile_size;
+    if (bi == cur_band && tileMayHold(bi, bj, cur_band_min)) {
+      return band_rows[(long long int) (x % tile_size) * num_genes + y];
+    }
+    // Only the tile that holds the value is decompressed.
+    long long int t = SIMMATRIX_TILE_INDEX(bi, bj);
+    if (t != cur_tile) {
+      unpackTile(bi, bj, scratch[0], scratch[1], tile_values);
+      cur_tile = t;
+    }
+    int w = num_genes - bj * tile_size < tile_size ? num_genes - bj * tile_size : tile_size;
+    return tile_values[(x % tile_size) * w + y % tile_size];
+  }
+
+  simmatrix_decode(rowBytes(x) + (long long int) y * dtype_size, 1, dtype, scale, &value);
+  return value;
+}
+
+/**
+ * Makes sure the matrix belongs to an expression matrix.  The number of
+ * genes must match and, if the file stores gene names, the names as well.
+ *
+ * @param char ** genes
+ *   The gene names of the expression matrix.
+ * @param int num_genes
+ *   The number of genes in the expression matrix.
+ */
+void SimMatrixReader::checkGenes(char ** genes, int num_genes) {
+  if (num_genes != this->num_genes) {
+    fprintf(stderr, "ERROR: The similarity matrix has %d genes but the expression matrix has %d.\n",
+        this->num_genes, num_genes);
+    exit(-1);
+  }
+  for (int i = 0; this->genes && i < num_genes; i++) {
+    if (strcmp(genes[i], this->genes[i]) != 0) {
+      fprintf(stderr, "ERROR: Gene %d of the similarity matrix is '%s' but in the expression matrix it is '%s'.\n",
+          i + 1, this->genes[i], genes[i]);
+      exit(-1);
+    }
+  }
+}
+
+/**
+ * Indicates if a similarity matrix exists in either format.
+ *
+ * @param char * dir
+ * @param char * prefix
+ * @param char * method
+ *
+ * @return int
+ *   SIMMATRIX_FORMAT_SIM or SIMMATRIX_FORMAT_BIN if the matrix exists in
+ *   that format, or -1 if it does not exist.
+ */
+int SimMatrixReader::exists(char * dir, char * prefix, char * method) {
+  char filename[1024];
+
+  SimMatrixWriter::getSimFileName(dir, prefix, method, filename);
+  if (access(filename, F_OK) == 0) {
+    return SIMMATRIX_FORMAT_SIM;
+  }
+  sprintf(filename, "%s/%s.%s%d.bin", dir, prefix, method, 0);
+  if (access(filename, F_OK) == 0) {
+    return SIMMATRIX_FORMAT_BIN;
+  }
+  return -1;
+}
+
+/**
+ * Sets the name of the file a similarity matrix is read from: the .sim
+ * file if there is one, or else the first .bin file.
+ *
+ * @param char * dir
+ * @param char * prefix
+ * @param char * method
+ * @param char * filename
+ *   Receives the file name.
+ */
+void SimMatrixReader::getFileName(char * dir, char * prefix, char * method, char * filename) {
+  if (exists(dir, prefix, method) == SIMMATRIX_FORMAT_SIM) {
+    SimMatrixWriter::getSimFileName(dir, prefix, method, filename);
+  }
+  else {
+    sprintf(filename, "%s/%s.%s%d.bin", dir, prefix, method, 0);
+  }
+}
@@ -0,0 +1,154 @@
+#ifndef _SIMMATRIXREADER_
+#define _SIMMATRIXREADER_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SimMatrixFormat.h"
+#include "SimMatrixWriter.h"
+
+// A function called by SimMatrixReader::scanRows() for each row.  It is
+// called by several threads at once, each with its own rows.
+typedef void (*simmatrix_row_func)(int j, float * row, int thread, void * arg);
+
+/**
+ * Reads a similarity matrix written by SimMatrixWriter.
+ *
+ * If the directory holds a .sim file for the prefix and method it is used.
+ * Otherwise the matrix is read from the original .bin files, which are
+ * found by their exact names.  Values stored in a .sim file as 2-byte
+ * numbers are converted to floats as they are read.
+ *
+ * The files are memory mapped, so reading a row does not need a system
+ * call and rows of 4-byte floats can be used in place (see getRowSpan()).
+ * The mappings are advised for sequential access and the rows about to be
+ * scanned are requested ahead of time.  For the tiles layout, the band of
+ * tiles that holds a row is decompressed as a whole, straight from the
+ * mapping, by several threads, and kept until a row of another band is
+ * read.  A single value outside of that band only requires its own tile to
+ * be decompressed.
+ *
+ * readRow() and getValue() keep the current band and must be called by one
+ * thread.  scanRows() reads the rows with several threads, each with its
+ * own buffers.
+ *
+ * If the .sim file has a zone map, a row can be read with a threshold.  The
+ * zones that cannot hold a value of at least the threshold are then not
+ * read or decompressed, and their values are NaN.
+ */
+class SimMatrixReader {
+
+  private:
+    // The directory, file prefix and method used to name the files.
+    char * dir;
+    char * prefix;
+    char * method;
+    // The file format: SIMMATRIX_FORMAT_BIN or SIMMATRIX_FORMAT_SIM.
+    int format;
+    // The data type of the values, its size in bytes and the fixed point
+    // scale.
+    int dtype;
+    int dtype_size;
+    float scale;
+
+    // For the tiles layout: the tile size, the number of tiles and the file
+    // offset of each.
+    int layout;
+    int tile_size;
+    long long int num_tiles;
+    long long int * tile_offsets;
+    // The current band, the threshold it was read with and its values, row
+    // by row.
+    int cur_band;
+    float cur_band_min;
+    float * band_rows;
+    // The values of the last single tile that was read.
+    long long int cur_tile;
+    float * tile_values;
+    // The number of threads that decompress a band or scan rows, and the
+    // buffers of each to decompress a tile.
+    int num_threads;
+    unsigned char ** scratch;
+    // The zone map, or NULL if the file has none, and the zone size.
+    simmatrix_zone_t * zones;
+    int zone_size;
+    // The number of genes (rows) in the matrix.
+    int num_genes;
+    // The names of the genes. Only .sim files store them.
+    char ** genes;
+    char * gene_table;
+
+    // For .sim files, the file offset of each row.
+    long long int * row_offsets;
+    // For .bin files, the number of rows per file.
+    int rows_per_file;
+
+    // The mapped files: the .sim file or each .bin file, and their sizes.
+    int num_maps;
+    unsigned char ** maps;
+    long long int * map_sizes;
+
+    void openSim(char * filename);
+    void openBins();
+    unsigned char * mapFile(char * filename, long long int * size);
+    unsigned char * rowBytes(int j);
+    void adviseRows(int first, int last);
+    int zoneMayHold(int zi, int zj, float min_abs);
+    int tileMayHold(int bi, int bj, float min_abs);
+    int rowMayHold(int j, float min_abs);
+    void unpackTile(int bi, int bj, unsigned char * scratch1, unsigned char * scratch2, float * values);
+    void unpackBand(int bi, float min_abs, int first, int step, float * rows, unsigned char * scratch1,
+        unsigned char * scratch2, float * values);
+    void loadBand(int bi, float min_abs);
+    static void * unpackBandThread(void * arg);
+    static void * scanThread(void * arg);
+
+  public:
+    SimMatrixReader(char * dir, char * prefix, char * method);
+    ~SimMatrixReader();
+
+    // Retrieves the number of genes in the matrix.
+    int getNumGenes() { return num_genes; }
+    // Retrieves the gene names or NULL if the format does not store them.
+    char ** getGenes() { return genes; }
+    // Retrieves the file format.
+    int getFormat() { return format; }
+    // Retrieves the data type of the stored values.
+    int getDtype() { return dtype; }
+    // Retrieves the fixed point scale of the stored values.
+    float getScale() { return scale; }
+    // Retrieves the layout of the values.
+    int getLayout() { return layout; }
+    // Retrieves the number of threads that decompress tiles and scan rows.
+    int getNumThreads() { return num_threads; }
+    // Sets the number of threads that decompress tiles and scan rows.
+    void setNumThreads(int num_threads);
+
+    // Reads the j + 1 values of row j of the lower triangle.
+    void readRow(int j, float * row);
+    // Reads the values of row j that may be at least min_abs. Returns 0 if
+    // the row has no such values.
+    int readRow(int j, float * row, float min_abs);
+    // Retrieves row j in place if it is stored as floats, or NULL.
+    float * getRowSpan(int j);
+    // Reads every row that may hold a value of at least min_abs with
+    // several threads, and calls func for each.
+    void scanRows(float min_abs, simmatrix_row_func func, void * arg);
+    // Reads the value at row x and column y, where y <= x.
+    float getValue(int x, int y);
+    // Makes sure the matrix has the given genes.
+    void checkGenes(char ** genes, int num_genes);
+
+    // Indicates if a similarity matrix exists.
+    static int exists(char * dir, char * prefix, char * method);
+    // Retrieves the name of the .sim file or the first .bin file.
+    static void getFileName(char * dir, char * prefix, char * method, char * filename);
+};
+
+#endif
@@ -0,0 +1,898 @@
+#include "SimMatrixWriter.h"
+#include "SimMatrixReader.h"
+#include "../general/lz.h"
+
+/**
+ * Constructor.
+ *
+ * @param char * outdir
+ *   The directory where the files are written. It must exist.
+ * @param char * prefix
+ *   The file prefix, usually the expression matrix file name without the
+ *   extension.
+ * @param char * method
+ *   The similarity method: pc, sc, kc, bc or mi.
+ * @param int num_genes
+ *   The number of genes (rows) in the similarity matrix.
+ * @param char ** genes
+ *   The names of the genes. They are stored in .sim files.
+ * @param int format
+ *   SIMMATRIX_FORMAT_BIN or SIMMATRIX_FORMAT_SIM.
+ * @param int dtype
+ *   One of the SIMMATRIX_DTYPE values. The .bin format only supports
+ *   SIMMATRIX_DTYPE_FLOAT32.
+ * @param int layout
+ *   For the .sim format, SIMMATRIX_LAYOUT_ROWS or SIMMATRIX_LAYOUT_TILES.
+ */
+SimMatrixWriter::SimMatrixWriter(char * outdir, char * prefix, char * method, int num_genes,
+    char ** genes, int format, int dtype, int layout) {
+  this->outdir = outdir;
+  this->prefix = prefix;
+  this->method = method;
+  this->num_genes = num_genes;
+  this->genes = genes;
+  this->format = format;
+  this->dtype = dtype;
+  this->scale = dtype == SIMMATRIX_DTYPE_INT16 ? 1 : 0;
+  this->deferred = 0;
+  this->max_abs = 0;
+  this->num_clamped = 0;
+  this->layout = layout;
+  this->tile_size = SIMMATRIX_TILE_SIZE;
+  this->band = NULL;
+  this->tile_offsets = NULL;
+  this->num_threads = 0;
+  this->tile = NULL;
+  this->scratch = NULL;
+  this->packed = NULL;
+  this->packed_sizes = NULL;
+  this->zones = NULL;
+  this->zone_size = SIMMATRIX_TILE_SIZE;
+  this->num_bins = (num_genes - 1) / ROWS_PER_OUTPUT_FILE;
+  this->outfile = NULL;
+  this->out = NULL;
+  this->row = 0;
+  this->col = 0;
+  this->row_offsets = NULL;
+  this->start_row = 0;
+  this->append_pos = 0;
+  this->tmpfilename[0] = '\0';
+
+  if (format == SIMMATRIX_FORMAT_SIM) {
+    openSim(0);
+  }
+}
+
+/**
+ * Constructor for adding rows to an existing similarity matrix.
+ *
+ * @param char * outdir
+ * @param char * prefix
+ * @param char * method
+ * @param int num_genes
+ *   The number of genes in the similarity matrix once the new rows are
+ *   added.
+ * @param char ** genes
+ * @param int format
+ *   The format of the existing similarity matrix.
+ * @param int dtype
+ *   The data type of a new matrix. An existing .sim file keeps its own.
+ * @param int layout
+ *   The layout of a new matrix. An existing .sim file keeps its own.
+ * @param int start_row
+ *   The number of rows already stored.  Writing continues with this row.
+ */
+SimMatrixWriter::SimMatrixWriter(char * outdir, char * prefix, char * method, int num_genes,
+    char ** genes, int format, int dtype, int layout, int start_row) {
+  this->outdir = outdir;
+  this->prefix = prefix;
+  this->method = method;
+  this->num_genes = num_genes;
+  this->genes = genes;
+  this->format = format;
+  this->dtype = dtype;
+  this->scale = dtype == SIMMATRIX_DTYPE_INT16 ? 1 : 0;
+  this->deferred = 0;
+  this->max_abs = 0;
+  this->num_clamped = 0;
+  this->layout = layout;
+  this->tile_size = SIMMATRIX_TILE_SIZE;
+  this->band = NULL;
+  this->tile_offsets = NULL;
+  this->num_threads = 0;
+  this->tile = NULL;
+  this->scratch = NULL;
+  this->packed = NULL;
+  this->packed_sizes = NULL;
+  this->zones = NULL;
+  this->zone_size = SIMMATRIX_TILE_SIZE;
+  this->num_bins = (num_genes - 1) / ROWS_PER_OUTPUT_FILE;
+  this->outfile = NULL;
+  this->out = NULL;
+  this->row = start_row;
+  this->col = 0;
+  this->row_offsets = NULL;
+  this->start_row = start_row;
+  this->append_pos = 0;
+  this->tmpfilename[0] = '\0';
+
+  if (format == SIMMATRIX_FORMAT_SIM) {
+    openSim(start_row);
+  }
+  else if (start_row > 0) {
+    checkBins();
+  }
+}
+
+/**
+ * Destructor.
+ */
+SimMatrixWriter::~SimMatrixWriter() {
+  if (format == SIMMATRIX_FORMAT_SIM) {
+    closeSim();
+  }
+  else {
+    if (outfile) {
+      finishValues();
+      fclose(outfile);
+    }
+    // The existing files only become part of the larger matrix once all
+    // of its rows are written.
+    if (start_row > 0) {
+      if (row == num_genes) {
+        updateHeaders();
+      }
+      else {
+        fprintf(stderr, "ERROR: only %d of the %d rows were written to the bin files.\n", row, num_genes);
+        undoAppend();
+      }
+    }
+  }
+}
+
+/**
+ * Starts writing values at the current position of outfile.
+ *
+ * @param char * filename
+ *   The name of the file, for messages.
+ */
+void SimMatrixWriter::startValues(char * filename) {
+  fflush(outfile);
+  out = new AsyncWriter(fileno(outfile), ftell(outfile), filename);
+}
+
+/**
+ * Waits until every value is written.  The position of outfile is not
+ * moved, so it must be set before outfile is used again.
+ */
+void SimMatrixWriter::finishValues() {
+  if (out) {
+    out->close();
+    delete out;
+    out = NULL;
+  }
+}
+
+/**
+ * Copies bytes from the current position of one file to another.
+ *
+ * @param FILE * in
+ * @param FILE * out
+ * @param long long int size
+ *   The number of bytes.
+ * @param char * filename
+ *   The name of the input file, for messages.
+ */
+static void copy_bytes(FILE * in, FILE * out, long long int size, char * filename) {
+  int chunk = 1 << 20;
+  char * buffer = (char *) malloc(chunk);
+
+  while (size > 0) {
+    int n = size < chunk ? size : chunk;
+    if (fread(buffer, 1, n, in) != (size_t) n) {
+      fprintf(stderr, "ERROR: cannot read the sim file: '%s'\n", filename);
+      exit(-1);
+    }
+    if (fwrite(buffer, 1, n, out) != (size_t) n) {
+      fprintf(stderr, "ERROR: could not write a copy of the sim file: '%s'\n", filename);
+      exit(-1);
+    }
+    size -= n;
+  }
+  free(buffer);
+}
+
+/**
+ * Opens the .sim file.  A new file starts with an empty header, which is
+ * filled in by closeSim().  For an existing file the index is read and
+ * writing continues after the end of the file, or, for tiles, in a copy of
+ * the file.
+ *
+ * @param int start_row
+ *   The number of rows already stored in the file.
+ */
+void SimMatrixWriter::openSim(int start_row) {
+  char outfilename[1024];
+  simmatrix_header_t header;
+
+  getSimFileName(outdir, prefix, method, outfilename);
+  memset(&header, 0, sizeof(header));
+
+  if (start_row == 0) {
+    printf("Writing file: %s... \n", outfilename);
+    if (dtype == SIMMATRIX_DTYPE_INT16 && strcmp(method, "mi") == 0) {
+      deferred = 1;
+    }
+    if (deferred && layout == SIMMATRIX_LAYOUT_TILES) {
+      fprintf(stderr, "ERROR: The int16 data type of an 'mi' matrix cannot be used with tiles.\n");
+      exit(-1);
+    }
+    outfile = fopen(outfilename, "w+b");
+    if (!outfile) {
+      fprintf(stderr, "ERROR: could not open sim file: '%s'\n", outfilename);
+      exit(-1);
+    }
+    fwrite(&header, sizeof(header), 1, outfile);
+    startValues(outfilename);
+    zones = (simmatrix_zone_t *) calloc(simmatrix_num_tiles(num_genes, zone_size), sizeof(simmatrix_zone_t));
+    if (layout == SIMMATRIX_LAYOUT_TILES) {
+      initTiles();
+      tile_offsets[0] = sizeof(header);
+    }
+    else {
+      row_offsets = (long long int *) malloc(sizeof(long long int) * (num_genes + 1));
+      row_offsets[0] = sizeof(header);
+    }
+    return;
+  }
+
+  printf("Appending to file: %s... \n", outfilename);
+  outfile = fopen(outfilename, "r+b");
+  if (!outfile) {
+    fprintf(stderr, "ERROR: could not open sim file: '%s'\n", outfilename);
+    exit(-1);
+  }
+  if (fread(&header, sizeof(header), 1, outfile) != 1 ||
+      memcmp(header.magic, SIMMATRIX_MAGIC, 8) != 0 ||
+      header.num_genes != start_row) {
+    fprintf(stderr, "ERROR: The sim file '%s' is not a complete %d gene similarity matrix.\n",
+        outfilename, start_row);
+    exit(-1);
+  }
+  if (header.version != SIMMATRIX_VERSION) {
+    fprintf(stderr, "ERROR: The sim file '%s' was written by an earlier version. Rows can only be\n", outfilename);
+    fprintf(stderr, "added to a file of the current version.\n");
+    exit(-1);
+  }
+  // New rows are stored like the existing ones.
+  dtype = header.dtype;
+  scale = header.scale;
+  layout = header.layout;
+
+  // Read the index and the zone map. The zones of new rows start empty. If
+  // the file has no zone map, the updated file has none either.
+  long long int num_index = layout == SIMMATRIX_LAYOUT_TILES ?
+      simmatrix_num_tiles(start_row, header.tile_size) + 1 : start_row + 1;
+  fseek(outfile, header.index_offset, SEEK_SET);
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    tile_size = header.tile_size;
+    initTiles();
+    if (fread(tile_offsets, sizeof(long long int), num_index, outfile) != (size_t) num_index) {
+      fprintf(stderr, "ERROR: cannot read the tile index of the sim file: '%s'\n", outfilename);
+      exit(-1);
+    }
+  }
+  else {
+    row_offsets = (long long int *) malloc(sizeof(long long int) * (num_genes + 1));
+    if (fread(row_offsets, sizeof(long long int), num_index, outfile) != (size_t) num_index) {
+      fprintf(stderr, "ERROR: cannot read the row index of the sim file: '%s'\n", outfilename);
+      exit(-1);
+    }
+  }
+  long long int old_end = header.genes_offset + header.genes_size;
+  if (header.index_offset + (long long int) sizeof(long long int) * num_index > old_end) {
+    old_end = header.index_offset + sizeof(long long int) * num_index;
+  }
+  if (header.zones_offset != 0) {
+    zone_size = header.zone_size;
+    zones = (simmatrix_zone_t *) calloc(simmatrix_num_tiles(num_genes, zone_size), sizeof(simmatrix_zone_t));
+    long long int num_zones = simmatrix_num_tiles(start_row, zone_size);
+    fseek(outfile, header.zones_offset, SEEK_SET);
+    if (fread(zones, sizeof(simmatrix_zone_t), num_zones, outfile) != (size_t) num_zones) {
+      fprintf(stderr, "ERROR: cannot read the zone map of the sim file: '%s'\n", outfilename);
+      exit(-1);
+    }
+    if (header.zones_offset + (long long int) sizeof(simmatrix_zone_t) * num_zones > old_end) {
+      old_end = header.zones_offset + sizeof(simmatrix_zone_t) * num_zones;
+    }
+  }
+
+  // The header, gene-name table, index and zone map of the file are left
+  // as they are until closeSim() has written every new row.
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    // The size of a tile follows from the offset of the next one, so the
+    // new tiles must directly follow the old ones. They are written to a
+    // copy of the file without its tail, starting with the last band if it
+    // is not complete.
+    long long int write_pos = tile_offsets[num_index - 1];
+    if (start_row % tile_size != 0) {
+      readBand(start_row);
+      write_pos = tile_offsets[SIMMATRIX_TILE_INDEX(start_row / tile_size, 0)];
+    }
+    sprintf(tmpfilename, "%s.tmp", outfilename);
+    FILE * tmpfile = fopen(tmpfilename, "w+b");
+    if (!tmpfile) {
+      fprintf(stderr, "ERROR: could not open sim file: '%s'\n", tmpfilename);
+      exit(-1);
+    }
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, tmpfile);
+    fseek(outfile, sizeof(header), SEEK_SET);
+    copy_bytes(outfile, tmpfile, write_pos - sizeof(header), outfilename);
+    fclose(outfile);
+    outfile = tmpfile;
+  }
+  else {
+    // Rows are found through the index, so the new rows follow the old
+    // tail of the file.  Anything past it was left by an append that did
+    // not finish and is cut off.
+    fflush(outfile);
+    if (ftruncate(fileno(outfile), old_end) != 0) {
+      fprintf(stderr, "ERROR: could not set the size of the sim file: '%s'\n", outfilename);
+      exit(-1);
+    }
+    row_offsets[start_row] = old_end;
+    append_pos = old_end;
+    fseek(outfile, old_end, SEEK_SET);
+  }
+  startValues(tmpfilename[0] ? tmpfilename : outfilename);
+}
+
+/**
+ * Allocates the buffers for the tiles layout, with one set of compression
+ * buffers per CPU.
+ */
+void SimMatrixWriter::initTiles() {
+  int size = simmatrix_dtype_size(dtype);
+  int tile_bytes = tile_size * tile_size * size;
+  int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  band = (unsigned char *) malloc((long long int) tile_size * num_genes * size);
+  tile_offsets = (long long int *) malloc(sizeof(long long int) * (simmatrix_num_tiles(num_genes, tile_size) + 1));
+  num_threads = num_cpus > 0 ? num_cpus : 1;
+  tile = (unsigned char **) malloc(sizeof(unsigned char *) * num_threads);
+  scratch = (unsigned char **) malloc(sizeof(unsigned char *) * num_threads);
+  packed = (unsigned char **) malloc(sizeof(unsigned char *) * num_threads);
+  packed_sizes = (int *) malloc(sizeof(int) * num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    tile[i] = (unsigned char *) malloc(tile_bytes);
+    scratch[i] = (unsigned char *) malloc(tile_bytes);
+    packed[i] = (unsigned char *) malloc(lz_bound(tile_bytes));
+  }
+}
+
+/**
+ * Reads the rows of the last, incomplete, band of an existing file so that
+ * its tiles can be written again with the new rows.
+ *
+ * @param int start_row
+ *   The number of rows in the file.
+ */
+void SimMatrixWriter::readBand(int start_row) {
+  int size = simmatrix_dtype_size(dtype);
+  float * values = (float *) malloc(sizeof(float) * start_row);
+  SimMatrixReader * reader = new SimMatrixReader(outdir, prefix, method);
+
+  for (int j = start_row - start_row % tile_size; j < start_row; j++) {
+    reader->readRow(j, values);
+    simmatrix_encode(values, j + 1, dtype, scale, band + (long long int) (j % tile_size) * num_genes * size);
+  }
+  delete reader;
+  free(values);
+}
+
+/**
+ * Copies a tile out of the band buffer and compresses it into the buffers
+ * of a thread.
+ *
+ * @param int bi
+ *   The band.
+ * @param int bj
+ *   The column of the tile.
+ * @param int thread
+ *   The thread whose buffers are used.
+ */
+void SimMatrixWriter::packTile(int bi, int bj, int thread) {
+  int size = simmatrix_dtype_size(dtype);
+  int r0 = bi * tile_size;
+  int h = num_genes - r0 < tile_size ? num_genes - r0 : tile_size;
+  int c0 = bj * tile_size;
+  int w = num_genes - c0 < tile_size ? num_genes - c0 : tile_size;
+  unsigned char * t = tile[thread];
+  float nan = NAN;
+  char nan_value[sizeof(float)];
+
+  simmatrix_encode(&nan, 1, dtype, scale, nan_value);
+
+  // Copy the tile out of the band. Above the diagonal there are no values.
+  for (int r = 0; r < h; r++) {
+    int n = r0 + r - c0 + 1;
+    if (n > w) {
+      n = w;
+    }
+    memcpy(t + r * w * size, band + ((long long int) r * num_genes + c0) * size, n * size);
+    for (int c = n; c < w; c++) {
+      memcpy(t + (r * w + c) * size, nan_value, size);
+    }
+  }
+  packed_sizes[thread] = simmatrix_pack_tile(t, h * w, size, scratch[thread], packed[thread]);
+}
+
+// The arguments of a thread that compresses a tile.
+typedef struct {
+  SimMatrixWriter * writer;
+  int bi;
+  int bj;
+  int thread;
+} pack_tile_arg_t;
+
+/**
+ * Compresses a tile.
+ *
+ * @param void * arg
+ *   A pack_tile_arg_t.
+ */
+void * SimMatrixWriter::packTileThread(void * arg) {
+  pack_tile_arg_t * a = (pack_tile_arg_t *) arg;
+
+  a->writer->packTile(a->bi, a->bj, a->thread);
+  return NULL;
+}
+
+/**
+ * Compresses and writes the tiles of a band of rows.  The tiles are
+ * compressed by num_threads threads at a time and written in order.
+ *
+ * @param int bi
+ *   The band. Its rows must all be in the band buffer.
+ */
+void SimMatrixWriter::writeBand(int bi) {
+  pthread_t * threads = (pthread_t *) malloc(sizeof(pthread_t) * num_threads);
+  pack_tile_arg_t * args = (pack_tile_arg_t *) malloc(sizeof(pack_tile_arg_t) * num_threads);
+
+  for (int first = 0; first <= bi; first += num_threads) {
+    int n = bi + 1 - first < num_threads ? bi + 1 - first : num_threads;
+    for (int i = 0; i < n; i++) {
+      args[i].writer = this;
+      args[i].bi = bi;
+      args[i].bj = first + i;
+      args[i].thread = i;
+      if (i > 0) {
+        pthread_create(&threads[i], NULL, packTileThread, &args[i]);
+      }
+    }
+    packTileThread(&args[0]);
+    for (int i = 1; i < n; i++) {
+      pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < n; i++) {
+      out->write(packed[i], packed_sizes[i]);
+      long long int t = SIMMATRIX_TILE_INDEX(bi, first + i);
+      tile_offsets[t + 1] = tile_offsets[t] + packed_sizes[i];
+    }
+  }
+  free(threads);
+  free(args);
+}
+
+/**
+ * Writes the gene-name table, the row index and the header of the .sim
+ * file and closes it.  The copy of an appended tiled file then replaces
+ * the file.  If not every row was written, an existing file is left as it
+ * was.
+ */
+void SimMatrixWriter::closeSim() {
+  simmatrix_header_t header;
+  char outfilename[1024];
+
+  finishValues();
+  if (row != num_genes) {
+    fprintf(stderr, "ERROR: only %d of the %d rows were written to the sim file.\n", row, num_genes);
+    if (tmpfilename[0]) {
+      remove(tmpfilename);
+    }
+    else if (append_pos > 0) {
+      fflush(outfile);
+      if (ftruncate(fileno(outfile), append_pos) != 0) {
+        fprintf(stderr, "ERROR: could not set the size of the sim file.\n");
+      }
+    }
+    fclose(outfile);
+    free(row_offsets);
+    free(tile_offsets);
+    free(zones);
+    return;
+  }
+
+  if (deferred) {
+    quantizeSim();
+  }
+  if (num_clamped > 0) {
+    fprintf(stderr, "WARNING: %lld values were larger than the scale of the matrix (%f) and were\n", num_clamped, scale);
+    fprintf(stderr, "stored as %f.\n", scale);
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SIMMATRIX_MAGIC, 8);
+  header.version = SIMMATRIX_VERSION;
+  header.dtype = dtype;
+  header.scale = scale;
+  strncpy(header.method, method, sizeof(header.method) - 1);
+  header.num_genes = num_genes;
+  header.layout = layout;
+
+  // The index holds the offset of each row or tile and the offset past the
+  // last one.
+  long long int * index = row_offsets;
+  long long int index_size = num_genes + 1;
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    header.tile_size = tile_size;
+    index = tile_offsets;
+    index_size = simmatrix_num_tiles(num_genes, tile_size) + 1;
+  }
+  header.rows_offset = index[0];
+  header.genes_offset = index[index_size - 1];
+
+  fseek(outfile, header.genes_offset, SEEK_SET);
+  header.genes_size = 0;
+  for (int i = 0; i < num_genes; i++) {
+    int len = strlen(genes[i]) + 1;
+    fwrite(genes[i], sizeof(char), len, outfile);
+    header.genes_size += len;
+  }
+  header.index_offset = header.genes_offset + header.genes_size;
+  fwrite(index, sizeof(long long int), index_size, outfile);
+  long long int end = header.index_offset + sizeof(long long int) * index_size;
+
+  if (zones) {
+    long long int num_zones = simmatrix_num_tiles(num_genes, zone_size);
+    header.zones_offset = end;
+    header.zone_size = zone_size;
+    fwrite(zones, sizeof(simmatrix_zone_t), num_zones, outfile);
+    end += sizeof(simmatrix_zone_t) * num_zones;
+  }
+
+  // The floats of a quantized matrix took more space. Cut them off.
+  fflush(outfile);
+  if (ftruncate(fileno(outfile), end) != 0) {
+    fprintf(stderr, "ERROR: could not set the size of the sim file.\n");
+    exit(-1);
+  }
+
+  fseek(outfile, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, outfile);
+  fclose(outfile);
+  if (tmpfilename[0]) {
+    getSimFileName(outdir, prefix, method, outfilename);
+    if (rename(tmpfilename, outfilename) != 0) {
+      fprintf(stderr, "ERROR: could not replace the sim file: '%s'\n", outfilename);
+      exit(-1);
+    }
+  }
+  free(row_offsets);
+  free(tile_offsets);
+  free(band);
+  for (int i = 0; i < num_threads; i++) {
+    free(tile[i]);
+    free(scratch[i]);
+    free(packed[i]);
+  }
+  free(tile);
+  free(scratch);
+  free(packed);
+  free(packed_sizes);
+  free(zones);
+}
+
+/**
+ * Converts the floats written to the .sim file to fixed point, using the
+ * largest absolute value as the scale.  Each fixed point value is smaller
+ * than a float, so the conversion is done in place from the first row on.
+ */
+void SimMatrixWriter::quantizeSim() {
+  int chunk = 65536;
+  float * values = (float *) malloc(sizeof(float) * chunk);
+  short * q = (short *) malloc(sizeof(short) * chunk);
+  long long int num_values = (long long int) num_genes * (num_genes + 1) / 2;
+  long long int start = row_offsets[0];
+
+  scale = max_abs > 0 ? max_abs : 1;
+  for (long long int i = 0; i < num_values; i += chunk) {
+    int n = num_values - i < chunk ? num_values - i : chunk;
+    fseek(outfile, start + i * sizeof(float), SEEK_SET);
+    if (fread(values, sizeof(float), n, outfile) != (size_t) n) {
+      fprintf(stderr, "ERROR: cannot read back the similarity matrix.\n");
+      exit(-1);
+    }
+    simmatrix_encode(values, n, dtype, scale, q);
+    fseek(outfile, start + i * sizeof(short), SEEK_SET);
+    fwrite(q, sizeof(short), n, outfile);
+  }
+  for (int j = 0; j <= num_genes; j++) {
+    row_offsets[j] = start + (long long int) j * (j + 1) / 2 * sizeof(short);
+  }
+  // A value may be rounded up by up to half a step, so the zone map stays
+  // an upper bound when it is raised by one step.
+  for (long long int z = 0; zones && z < simmatrix_num_tiles(num_genes, zone_size); z++) {
+    if (zones[z].num_values > 0) {
+      zones[z].max_abs += scale / 32767;
+    }
+  }
+  deferred = 0;
+  free(values);
+  free(q);
+}
+
+/**
+ * Opens a .bin file and writes its header.
+ *
+ * @param int bin
+ *   The number of the .bin file.
+ */
+void SimMatrixWriter::openBin(int bin) {
+  char outfilename[1024];
+
+  if (outfile) {
+    finishValues();
+    fclose(outfile);
+  }
+
+  sprintf(outfilename, "%s/%s.%s%d.bin", outdir, prefix, method, bin);
+  printf("Writing file %d of %d: %s... \n", bin + 1, num_bins + 1, outfilename);
+  outfile = fopen(outfilename, "wb");
+  if (!outfile) {
+    fprintf(stderr, "ERROR: could not open bin file: '%s'\n", outfilename);
+    exit(-1);
+  }
+
+  // write the size of the matrix.
+  fwrite(&num_genes, sizeof(num_genes), 1, outfile);
+  // write the number of lines in this file
+  int num_lines = ROWS_PER_OUTPUT_FILE;
+  if (bin == num_bins) {
+    num_lines = num_genes - bin * ROWS_PER_OUTPUT_FILE;
+  }
+  fwrite(&num_lines, sizeof(num_lines), 1, outfile);
+  startValues(outfilename);
+}
+
+/**
+ * Retrieves the number of rows of a .bin file of a matrix, and the size
+ * of the file.
+ *
+ * @param int bin
+ * @param int rows
+ *   The number of rows of the matrix.
+ * @param long long int * size
+ *   Set to the size, in bytes, of the file.
+ *
+ * @return int
+ */
+static int bin_lines(int bin, int rows, long long int * size) {
+  int first = bin * ROWS_PER_OUTPUT_FILE;
+  int lines = rows - first;
+  if (lines > ROWS_PER_OUTPUT_FILE) {
+    lines = ROWS_PER_OUTPUT_FILE;
+  }
+  // Row i of the matrix holds i + 1 values.
+  long long int num_values = (long long int) lines * (2 * (long long int) first + lines + 1) / 2;
+  *size = 2 * (long long int) sizeof(int) + num_values * (long long int) sizeof(float);
+  return lines;
+}
+
+/**
+ * Makes sure the existing .bin files hold exactly start_row rows.  Their
+ * headers are not changed until the new rows are written.  The last file
+ * may be longer if an earlier append did not finish: the rows it added are
+ * cut off.
+ */
+void SimMatrixWriter::checkBins() {
+  char outfilename[1024];
+  int last = (start_row - 1) / ROWS_PER_OUTPUT_FILE;
+
+  for (int bin = 0; bin <= last; bin++) {
+    sprintf(outfilename, "%s/%s.%s%d.bin", outdir, prefix, method, bin);
+    FILE * fh = fopen(outfilename, "r+b");
+    if (!fh) {
+      fprintf(stderr, "ERROR: could not open bin file: '%s'\n", outfilename);
+      exit(-1);
+    }
+
+    // The size of a complete file is known. Anything else means an earlier
+    // run did not finish.
+    long long int expected;
+    int old_lines = bin_lines(bin, start_row, &expected);
+    int file_genes, file_lines;
+    if (fread(&file_genes, sizeof(int), 1, fh) != 1 ||
+        fread(&file_lines, sizeof(int), 1, fh) != 1) {
+      fprintf(stderr, "ERROR: cannot read bin file: '%s'\n", outfilename);
+      exit(-1);
+    }
+    fseek(fh, 0, SEEK_END);
+    long long int size = ftell(fh);
+    if (bin == last && size > expected && file_genes == start_row && file_lines == old_lines) {
+      printf("Removing the rows of an unfinished append from: %s\n", outfilename);
+      fflush(fh);
+      if (ftruncate(fileno(fh), expected) != 0) {
+        fprintf(stderr, "ERROR: could not set the size of the bin file: '%s'\n", outfilename);
+        exit(-1);
+      }
+      size = expected;
+    }
+    if (file_genes != start_row || file_lines != old_lines || size != expected) {
+      fprintf(stderr, "ERROR: The bin file '%s' does not hold the expected %d rows\n", outfilename, old_lines);
+      fprintf(stderr, "of a %d gene matrix.\n", start_row);
+      exit(-1);
+    }
+    fclose(fh);
+  }
+}
+
+/**
+ * Updates the headers of the existing .bin files with the new size of the
+ * matrix.  The size of the matrix is read from the first file, so it is
+ * updated last.
+ */
+void SimMatrixWriter::updateHeaders() {
+  char outfilename[1024];
+
+  for (int bin = (start_row - 1) / ROWS_PER_OUTPUT_FILE; bin >= 0; bin--) {
+    sprintf(outfilename, "%s/%s.%s%d.bin", outdir, prefix, method, bin);
+    FILE * fh = fopen(outfilename, "r+b");
+    if (!fh) {
+      fprintf(stderr, "ERROR: could not open bin file: '%s'\n", outfilename);
+      exit(-1);
+    }
+    long long int size;
+    int num_lines = bin_lines(bin, num_genes, &size);
+    fwrite(&num_genes, sizeof(num_genes), 1, fh);
+    fwrite(&num_lines, sizeof(num_lines), 1, fh);
+    fclose(fh);
+  }
+}
+
+/**
+ * Restores the .bin files of the matrix before an append that did not
+ * finish: the last existing file is cut back to its old size and the new
+ * files are removed.
+ */
+void SimMatrixWriter::undoAppend() {
+  char outfilename[1024];
+  int last = (start_row - 1) / ROWS_PER_OUTPUT_FILE;
+  long long int size;
+
+  bin_lines(last, start_row, &size);
+  sprintf(outfilename, "%s/%s.%s%d.bin", outdir, prefix, method, last);
+  if (truncate(outfilename, size) != 0) {
+    fprintf(stderr, "ERROR: could not set the size of the bin file: '%s'\n", outfilename);
+  }
+  for (int bin = last + 1; bin <= num_bins; bin++) {
+    sprintf(outfilename, "%s/%s.%s%d.bin", outdir, prefix, method, bin);
+    remove(outfilename);
+  }
+}
+
+/**
+ * Opens an existing .bin file to add rows to the end of it.  The header is
+ * updated by updateHeaders() once every row is written.
+ *
+ * @param int bin
+ *   The number of the .bin file.
+ */
+void SimMatrixWriter::appendBin(int bin) {
+  char outfilename[1024];
+
+  sprintf(outfilename, "%s/%s.%s%d.bin", outdir, prefix, method, bin);
+  printf("Appending to file %d of %d: %s... \n", bin + 1, num_bins + 1, outfilename);
+  outfile = fopen(outfilename, "r+b");
+  if (!outfile) {
+    fprintf(stderr, "ERROR: could not open bin file: '%s'\n", outfilename);
+    exit(-1);
+  }
+  fseek(outfile, 0, SEEK_END);
+  startValues(outfilename);
+}
+
+/**
+ * Writes the next value of the lower triangle of the matrix.
+ *
+ * @param float score
+ */
+void SimMatrixWriter::write(float score) {
+  if (format == SIMMATRIX_FORMAT_BIN) {
+    if (col == 0 && row % ROWS_PER_OUTPUT_FILE == 0) {
+      openBin(row / ROWS_PER_OUTPUT_FILE);
+    }
+    else if (!outfile) {
+      appendBin(row / ROWS_PER_OUTPUT_FILE);
+    }
+  }
+
+  // Convert the value to the stored data type. The value as it will be
+  // read back is kept for the zone map.
+  unsigned char value[sizeof(float)];
+  float stored = score;
+  int size = sizeof(float);
+  if (deferred) {
+    memcpy(value, &score, size);
+    if (fabsf(score) > max_abs) {
+      max_abs = fabsf(score);
+    }
+  }
+  else {
+    if (dtype == SIMMATRIX_DTYPE_INT16 && fabsf(score) > scale) {
+      num_clamped++;
+    }
+    size = simmatrix_dtype_size(dtype);
+    simmatrix_encode(&score, 1, dtype, scale, value);
+    simmatrix_decode(value, 1, dtype, scale, &stored);
+  }
+
+  if (layout == SIMMATRIX_LAYOUT_TILES) {
+    memcpy(band + ((long long int) (row % tile_size) * num_genes + col) * size, value, size);
+  }
+  else {
+    out->write(value, size);
+  }
+
+  if (zones && col != row && !isnan(stored)) {
+    simmatrix_zone_t * zone = &zones[SIMMATRIX_TILE_INDEX(row / zone_size, col / zone_size)];
+    zone->num_values++;
+    if (fabsf(stored) > zone->max_abs) {
+      zone->max_abs = fabsf(stored);
+    }
+  }
+
+  col++;
+  if (col > row) {
+    row++;
+    col = 0;
+    if (row_offsets) {
+      row_offsets[row] = row_offsets[row - 1] + (long long int) row * size;
+    }
+    if (band && (row % tile_size == 0 || row == num_genes)) {
+      writeBand((row - 1) / tile_size);
+    }
+  }
+}
+
+/**
+ * Retrieves the name of the gene index file of a similarity matrix.
+ *
+ * The gene index lists the genes of the matrix, one per line, in the order
+ * of its rows.  It is used to find the genes that are already stored when
+ * new genes are added to the expression matrix.
+ *
+ * @param char * outdir
+ * @param char * prefix
+ * @param char * method
+ * @param char * filename
+ *   A string large enough to hold the file name.
+ */
+void SimMatrixWriter::getGeneIndexFileName(char * outdir, char * prefix, char * method, char * filename) {
+  sprintf(filename, "%s/%s.%s.genes.txt", outdir, prefix, method);
+}
+
+/**
+ * Retrieves the name of the .sim file of a similarity matrix.
+ *
+ * @param char * outdir
+ * @param char * prefix
+ * @param char * method
+ * @param char * filename
+ *   A string large enough to hold the file name.
+ */
+void SimMatrixWriter::getSimFileName(char * outdir, char * prefix, char * method, char * filename) {
+  sprintf(filename, "%s/%s.%s.sim", outdir, prefix, method);
+}
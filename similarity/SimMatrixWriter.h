@@ -0,0 +1,146 @@
+#ifndef _SIMMATRIXWRITER_
+#define _SIMMATRIXWRITER_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "SimMatrixFormat.h"
+#include "AsyncWriter.h"
+
+// a global variable for the number of rows in each output file
+#define ROWS_PER_OUTPUT_FILE 10000
+
+/**
+ * Writes a similarity matrix in one of the RMTGeneNet file formats.
+ *
+ * The lower triangle of the matrix, including the diagonal, is written row
+ * by row.  In the .bin format, every ROWS_PER_OUTPUT_FILE rows a new .bin
+ * file is started.  Each file begins with the number of genes in the matrix
+ * and the number of rows stored in the file.  In the .sim format, all rows
+ * are written to a single file described in SimMatrixFormat.h.  The .sim
+ * format can store the values as 2-byte half precision floats or as 2-byte
+ * fixed point numbers.  The fixed point scale is 1 for the correlation
+ * methods.  For mutual information, which has no fixed upper bound, the
+ * values are first written as floats and converted using the largest value
+ * once the matrix is complete.
+ *
+ * In the tiles layout of the .sim format the rows of a band of tiles are
+ * kept in memory until the band is complete.  Its tiles are then
+ * compressed by several threads, one tile each, and written in order.
+ *
+ * The values, or the compressed tiles, are not written directly but handed
+ * to an AsyncWriter, so that the calculation does not wait for the disk.
+ *
+ * For the .sim format, a zone map with the largest absolute value and the
+ * number of values of every zone is written as well.
+ *
+ * A writer can also continue an existing matrix after new genes were added
+ * to the end of the expression matrix.  Only the new rows are written: the
+ * last, partially filled, .bin file is extended and new files are started
+ * as needed, or the rows are added to the end of the .sim file.  The rows
+ * already on disk are left in place and only the headers, and for .sim
+ * files the gene-name table and row index, are updated.  The headers of
+ * the existing .bin files are only updated once every new row is written,
+ * so an append that does not finish leaves the files of the old matrix as
+ * they were, apart from rows past the end of the last one, which are cut
+ * off again.  The same holds for a .sim file: the new rows, gene-name
+ * table, index and zone map are written after its end and the header is
+ * written last.  The tiles of a .sim file cannot be separated by the old
+ * table and index, so a tiled file is copied to <file>.tmp, which replaces
+ * it once it is complete.
+ */
+class SimMatrixWriter {
+
+  private:
+    // The directory, file prefix and method used to name the files.
+    char * outdir;
+    char * prefix;
+    char * method;
+    // The number of genes in the matrix and their names.
+    int num_genes;
+    char ** genes;
+    // The file format: SIMMATRIX_FORMAT_BIN or SIMMATRIX_FORMAT_SIM.
+    int format;
+    // The data type of the values in a .sim file and the fixed point scale.
+    int dtype;
+    float scale;
+    // Set to 1 if the values are written as floats and converted to
+    // fixed point when the file is closed. The largest absolute value
+    // seen so far becomes the scale.
+    int deferred;
+    float max_abs;
+    // The number of values clamped to the fixed point scale.
+    long long int num_clamped;
+    // SIMMATRIX_LAYOUT_ROWS or SIMMATRIX_LAYOUT_TILES and the tile size.
+    int layout;
+    int tile_size;
+    // For the tiles layout, the values of the current band of rows and the
+    // file offset of each tile.
+    unsigned char * band;
+    long long int * tile_offsets;
+    // The number of threads that compress tiles, the buffers each uses to
+    // compress a tile and the size of the tile it compressed last.
+    int num_threads;
+    unsigned char ** tile;
+    unsigned char ** scratch;
+    unsigned char ** packed;
+    int * packed_sizes;
+    // The zone map of a .sim file, or NULL if the existing file has none,
+    // and the zone size.
+    simmatrix_zone_t * zones;
+    int zone_size;
+    // The number of .bin files needed to store the matrix.
+    int num_bins;
+    // The current .bin file or the .sim file.
+    FILE * outfile;
+    // Writes the values to outfile in the background.
+    AsyncWriter * out;
+    // The current row and column of the matrix.
+    int row;
+    int col;
+    // The file offset of each row of a .sim file.
+    long long int * row_offsets;
+    // The number of rows the existing .bin files held before the append.
+    int start_row;
+    // For an append to a .sim file, the old end of the file, where the new
+    // rows start, and the name of the temporary copy of a tiled file, or an
+    // empty string.
+    long long int append_pos;
+    char tmpfilename[1040];
+
+    void openBin(int bin);
+    void appendBin(int bin);
+    void checkBins();
+    void updateHeaders();
+    void undoAppend();
+    void openSim(int start_row);
+    void closeSim();
+    void quantizeSim();
+    void initTiles();
+    void readBand(int start_row);
+    void writeBand(int bi);
+    void packTile(int bi, int bj, int thread);
+    static void * packTileThread(void * arg);
+    void startValues(char * filename);
+    void finishValues();
+
+  public:
+    SimMatrixWriter(char * outdir, char * prefix, char * method, int num_genes,
+        char ** genes, int format, int dtype, int layout);
+    SimMatrixWriter(char * outdir, char * prefix, char * method, int num_genes,
+        char ** genes, int format, int dtype, int layout, int start_row);
+    ~SimMatrixWriter();
+
+    // Writes the next value of the lower triangle.
+    void write(float score);
+
+    // Retrieves the name of the gene index file of a similarity matrix.
+    static void getGeneIndexFileName(char * outdir, char * prefix, char * method, char * filename);
+    // Retrieves the name of the .sim file of a similarity matrix.
+    static void getSimFileName(char * outdir, char * prefix, char * method, char * filename);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "SketchFilter.h"
+
+/**
+ * Constructor.
+ *
+ * @param EMatrix * ematrix
+ *   The expression matrix.
+ * @param int num_bits
+ *   The number of random projections (bits) per sketch.
+ * @param double cutoff
+ *   The absolute correlation of interest. Pairs that are certainly below
+ *   this value are pruned.
+ * @param double margin
+ *   The safety margin below the cutoff.  A pair is a candidate if its
+ *   estimated absolute correlation is at least cutoff - margin.
+ * @param int recall
+ *   Set to 1 for the high-recall mode. The margin is widened to at least
+ *   five standard errors of the estimator at the cutoff and pairs with
+ *   missing values, whose sketches do not reflect the pair-wise complete
+ *   samples, are never pruned.  Pairs are still pruned on an estimate, so
+ *   a pair at the cutoff is missed with a probability of about 3 in 10
+ *   million (the normal tail beyond five standard errors), and a stronger
+ *   pair less often.
+ */
+SketchFilter::SketchFilter(EMatrix * ematrix, int num_bits, double cutoff, double margin, int recall) {
+  this->num_genes = ematrix->getNumGenes();
+  this->num_samples = ematrix->getNumSamples();
+  this->num_words = (num_bits + 63) / 64;
+  this->num_bits = this->num_words * 64;
+  this->cutoff = cutoff;
+  this->margin = margin;
+  this->recall = recall;
+
+  num_pruned = 0;
+  num_candidates = 0;
+  num_kept_missing = 0;
+  num_above = 0;
+
+  // Convert the margin into the largest number of differing bits that
+  // is still a candidate.  The expected fraction of differing bits for a
+  // correlation r is acos(r) / pi.
+  double lower = cutoff - margin;
+  if (lower < -1) {
+    lower = -1;
+  }
+  max_diff = (int) floor(this->num_bits * acos(lower) / M_PI);
+  if (recall) {
+    double p = acos(cutoff) / M_PI;
+    double se = sqrt(p * (1 - p) / this->num_bits);
+    int recall_diff = (int) ceil(this->num_bits * (p + 5 * se));
+    if (recall_diff > max_diff) {
+      max_diff = recall_diff;
+    }
+  }
+
+  printf("  Building %d-bit sketches for candidate pruning...\n", this->num_bits);
+  buildSketches(ematrix);
+}
+
+/**
+ * Destructor.
+ */
+SketchFilter::~SketchFilter() {
+  free(sketches);
+  free(has_missing);
+}
+
+/**
+ * Standardizes each gene and stores the signs of its random projections.
+ */
+void SketchFilter::buildSketches(EMatrix * ematrix) {
+  int i, j, b;
+
+  // Generate the random projection vectors. A fixed seed keeps the
+  // pruning reproducible between runs.
+  double * proj = (double *) malloc(sizeof(double) * num_bits * num_samples);
+  srand48(1);
+  for (i = 0; i < num_bits * num_samples; i++) {
+    // Box-Muller transform for a standard normal deviate.
+    double u1 = 1.0 - drand48();
+    double u2 = drand48();
+    proj[i] = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+  }
+
+  sketches = (unsigned long long *) calloc(num_genes * num_words, sizeof(unsigned long long));
+  has_missing = (int *) calloc(num_genes, sizeof(int));
+
+  double * z = (double *) malloc(sizeof(double) * num_samples);
+  for (j = 0; j < num_genes; j++) {
+    double * x = ematrix->getRow(j);
+
+    // Standardize the gene. Missing values are set to the mean (zero).
+    double sum = 0;
+    double sum2 = 0;
+    int n = 0;
+    for (i = 0; i < num_samples; i++) {
+      if (isnan(x[i]) || isinf(x[i])) {
+        has_missing[j] = 1;
+        continue;
+      }
+      sum += x[i];
+      n++;
+    }
+    double mean = n > 0 ? sum / n : 0;
+    for (i = 0; i < num_samples; i++) {
+      if (isnan(x[i]) || isinf(x[i])) {
+        z[i] = 0;
+        continue;
+      }
+      z[i] = x[i] - mean;
+      sum2 += z[i] * z[i];
+    }
+    double sd = sqrt(sum2);
+    if (sd > 0) {
+      for (i = 0; i < num_samples; i++) {
+        z[i] /= sd;
+      }
+    }
+
+    // Store the sign of each projection as a bit.
+    unsigned long long * sketch = &sketches[(long long int) j * num_words];
+    for (b = 0; b < num_bits; b++) {
+      double * r = &proj[(long long int) b * num_samples];
+      double dot = 0;
+      for (i = 0; i < num_samples; i++) {
+        dot += r[i] * z[i];
+      }
+      if (dot >= 0) {
+        sketch[b / 64] |= 1ULL << (b % 64);
+      }
+    }
+  }
+  free(z);
+  free(proj);
+}
+
+/**
+ * Indicates if the pair (j, k) may have an absolute correlation above the
+ * cutoff and should be computed exactly.
+ *
+ * @param int j
+ * @param int k
+ *
+ * @return int
+ *   1 if the pair is a candidate, 0 if it can be pruned.
+ */
+int SketchFilter::isCandidate(int j, int k) {
+  if (recall && (has_missing[j] || has_missing[k])) {
+    num_kept_missing++;
+    num_candidates++;
+    return 1;
+  }
+
+  unsigned long long * sj = &sketches[(long long int) j * num_words];
+  unsigned long long * sk = &sketches[(long long int) k * num_words];
+  int diff = 0;
+  for (int w = 0; w < num_words; w++) {
+    diff += __builtin_popcountll(sj[w] ^ sk[w]);
+  }
+
+  // Few differing bits means a strong positive correlation and many
+  // differing bits means a strong negative correlation.
+  if (diff <= max_diff || diff >= num_bits - max_diff) {
+    num_candidates++;
+    return 1;
+  }
+  num_pruned++;
+  return 0;
+}
+
+/**
+ * Records the exact score of a candidate pair so that the number of
+ * candidates that pass the cutoff can be reported.
+ *
+ * @param double score
+ */
+void SketchFilter::addResult(double score) {
+  if (fabs(score) >= cutoff) {
+    num_above++;
+  }
+}
+
+/**
+ * Prints the pruning statistics.
+ */
+void SketchFilter::printStats() {
+  long long int total = num_pruned + num_candidates;
+  printf("  Sketch prefilter (%d bits, cutoff %f, margin %f%s):\n", num_bits,
+      cutoff, margin, recall ? ", high recall" : "");
+  printf("    Pairs examined: %lld\n", total);
+  printf("    Pairs pruned: %lld (%.2f%%)\n", num_pruned,
+      total > 0 ? (num_pruned / (double) total) * 100 : 0.0);
+  printf("    Pairs computed exactly: %lld\n", num_candidates);
+  if (recall) {
+    printf("    Pairs kept due to missing values: %lld\n", num_kept_missing);
+  }
+  printf("    Computed pairs at or above the cutoff: %lld\n", num_above);
+}
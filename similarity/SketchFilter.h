@@ -0,0 +1,62 @@
+#ifndef _SKETCHFILTER_
+#define _SKETCHFILTER_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../ematrix/EMatrix.h"
+
+/**
+ * A candidate pair prefilter based on sign random projections (SimHash).
+ *
+ * Each gene is standardized and projected onto a set of random Gaussian
+ * vectors. The signs of the projections form a compact bit sketch of the
+ * gene.  The fraction of bits that differ between two sketches estimates
+ * the angle between the genes, and the cosine of that angle estimates
+ * their Pearson correlation.  Pairs whose estimate is not within a margin
+ * of the cutoff can be skipped.
+ */
+class SketchFilter {
+
+  private:
+    // The number of genes and samples.
+    int num_genes;
+    int num_samples;
+    // The number of bits per sketch and the number of 64-bit words they use.
+    int num_bits;
+    int num_words;
+    // The sketches for all genes, num_words per gene.
+    unsigned long long * sketches;
+    // Set to 1 for genes with missing values.
+    int * has_missing;
+    // The cutoff and safety margin on the correlation.
+    double cutoff;
+    double margin;
+    // Set to 1 to widen the margin to five standard errors and to keep
+    // pairs with missing values.
+    int recall;
+    // A pair is a candidate if its sketches differ in at most max_diff or
+    // at least num_bits - max_diff bits.
+    int max_diff;
+
+    // Statistics.
+    long long int num_pruned;
+    long long int num_candidates;
+    long long int num_kept_missing;
+    long long int num_above;
+
+    void buildSketches(EMatrix * ematrix);
+
+  public:
+    SketchFilter(EMatrix * ematrix, int num_bits, double cutoff, double margin, int recall);
+    ~SketchFilter();
+
+    // Returns 1 if the exact similarity of genes j and k should be computed.
+    int isCandidate(int j, int k);
+    // Records the exact score of a candidate pair.
+    void addResult(double score);
+    // Prints the pruning statistics.
+    void printStats();
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "BicorSimilarity.h"
+
+/**
+ * Returns the median of the values in x that are not missing.
+ *
+ * @param double *x
+ * @param int n
+ * @param double *work
+ *   A work array at least the size of n.
+ *
+ * @return double
+ *   The median or NaN if all values are missing.
+ */
+static double median(double *x, int n, double *work) {
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (!isnan(x[i]) && !isinf(x[i])) {
+      work[m++] = x[i];
+    }
+  }
+  if (m == 0) {
+    return NAN;
+  }
+  quickSortD(work, m);
+  if (m % 2 == 1) {
+    return work[m / 2];
+  }
+  return (work[m / 2 - 1] + work[m / 2]) / 2.0;
+}
+
+/**
+ * Calculates the biweight vector of an array of expression values.
+ *
+ * Values are centered on the median and weighted by (1 - u^2)^2 where
+ * u = (x - median) / (9 * MAD).  Values further than 9 MADs from the median
+ * receive a weight of zero.  If the MAD is zero the values are mean centered
+ * without weighting, which makes bicor fall back to Pearson's correlation
+ * for that gene.
+ *
+ * @param double *x
+ *   The expression values.  May contain missing values.
+ * @param int n
+ *   The size of x.
+ * @param double *w
+ *   The array for the biweight vector, at least the size of n. Missing
+ *   values in x are missing in w.
+ */
+static void biweight(double *x, int n, double *w) {
+  double * work = (double *) malloc(sizeof(double) * n);
+  double med = median(x, n, work);
+
+  for (int i = 0; i < n; i++) {
+    w[i] = fabs(x[i] - med);
+  }
+  double mad = median(w, n, work);
+  free(work);
+
+  if (mad == 0 || isnan(mad)) {
+    double sum = 0;
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+      if (!isnan(x[i]) && !isinf(x[i])) {
+        sum += x[i];
+        m++;
+      }
+    }
+    double mean = sum / m;
+    for (int i = 0; i < n; i++) {
+      w[i] = x[i] - mean;
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    double u = (x[i] - med) / (9 * mad);
+    if (fabs(u) < 1) {
+      w[i] = (x[i] - med) * (1 - u * u) * (1 - u * u);
+    }
+    else if (isnan(u) || isinf(u)) {
+      w[i] = NAN;
+    }
+    else {
+      w[i] = 0;
+    }
+  }
+}
+
+/**
+ * Constructor.
+ */
+BicorSimilarity::BicorSimilarity(PairWiseSet * pws, int min_obs)
+  :PairWiseSimilarity(pws, min_obs) {
+
+  strcpy(this->type, "bc");
+  weightPaired();
+}
+/**
+ * Constructor.
+ */
+BicorSimilarity::BicorSimilarity(PairWiseSet * pws, int min_obs, int * samples)
+  :PairWiseSimilarity(pws, min_obs, samples) {
+
+  strcpy(this->type, "bc");
+  weightPaired();
+}
+/**
+ * Constructor.
+ *
+ * @param PairWiseSet *pws
+ * @param int min_obs
+ * @param int * samples
+ *   Optional. The samples inclusion array.  Set to NULL to use the samples
+ *   of the pws argument.
+ * @param double * wx
+ *   The biweight vector of the first gene as returned by getWeightedRow().
+ * @param double * wy
+ *   The biweight vector of the second gene as returned by getWeightedRow().
+ *
+ * The median and MAD of the weighted vectors are computed over all of the
+ * samples of a gene rather than only those shared with the other gene. This
+ * allows them to be calculated once per gene instead of once per pair.
+ */
+BicorSimilarity::BicorSimilarity(PairWiseSet * pws, int min_obs, int * samples, double * wx, double * wy)
+  :PairWiseSimilarity(pws, min_obs, samples) {
+
+  strcpy(this->type, "bc");
+
+  int m = 0;
+  for (int i = 0; i < pws->n_orig; i++) {
+    if (pws->samples[i] != 1 || (samples && samples[i] != 1)) {
+      continue;
+    }
+    this->a[m] = wx[i];
+    this->b[m] = wy[i];
+    m++;
+  }
+}
+
+BicorSimilarity::~BicorSimilarity() {
+
+}
+
+/**
+ * Calculates the biweight vector of a gene.
+ *
+ * @param double *x
+ *   The expression values for a gene.
+ * @param int n
+ *   The number of samples.
+ *
+ * @return double *
+ *   The biweight vector. The caller is responsible for freeing it.
+ */
+double * BicorSimilarity::getWeightedRow(double * x, int n) {
+  double * w = (double *) malloc(sizeof(double) * n);
+  biweight(x, n, w);
+  return w;
+}
+
+/**
+ * Replaces the values in the a and b arrays with their biweight vectors
+ * using the median and MAD of only the samples in this pair.
+ */
+void BicorSimilarity::weightPaired() {
+  double * w = (double *) malloc(sizeof(double) * this->n);
+  biweight(this->a, this->n, w);
+  memcpy(this->a, w, sizeof(double) * this->n);
+  biweight(this->b, this->n, w);
+  memcpy(this->b, w, sizeof(double) * this->n);
+  free(w);
+}
+
+/**
+ * Performs biweight midcorrelation on two arrays.
+ */
+void BicorSimilarity::run() {
+  // Make sure we have the correct number of observations before performing
+  // the comparision.
+  if (this->n < this->min_obs) {
+    score = NAN;
+    return;
+  }
+
+  // The weighted vectors are already centered, so the correlation is the
+  // normalized dot product.
+  double ab = 0;
+  double aa = 0;
+  double bb = 0;
+  for (int i = 0; i < this->n; i++) {
+    ab += this->a[i] * this->b[i];
+    aa += this->a[i] * this->a[i];
+    bb += this->b[i] * this->b[i];
+  }
+  if (aa == 0 || bb == 0) {
+    score = NAN;
+    return;
+  }
+  score = ab / sqrt(aa * bb);
+}
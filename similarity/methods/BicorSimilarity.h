@@ -0,0 +1,31 @@
+#ifndef _BICOR_
+#define _BICOR_
+
+#include "../../general/vector.h"
+#include "PairWiseSimilarity.h"
+
+/**
+ * Class for biweight midcorrelation (bicor) similarity.
+ *
+ * Each gene is transformed into a vector of median centered values that are
+ * down-weighted by Tukey's biweight.  The bicor of two genes is then the
+ * cosine similarity of their weighted vectors.
+ */
+class BicorSimilarity : public PairWiseSimilarity {
+  private:
+    // Replaces the values in a and b with their biweight vectors.
+    void weightPaired();
+
+  public:
+    BicorSimilarity(PairWiseSet * pws, int min_obs);
+    BicorSimilarity(PairWiseSet * pws, int min_obs, int * samples);
+    BicorSimilarity(PairWiseSet * pws, int min_obs, int * samples, double * wx, double * wy);
+    ~BicorSimilarity();
+
+    void run();
+
+    // Calculates the biweight vector of a gene.
+    static double * getWeightedRow(double * x, int n);
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "KendallSimilarity.h"
+
+/**
+ * Sorts two arrays together by the values in x, breaking ties by the values
+ * in y.  This is a stable merge sort.
+ *
+ * @param double *x
+ * @param double *y
+ * @param double *wx
+ *   A work array at least the size of n.
+ * @param double *wy
+ *   A work array at least the size of n.
+ * @param int n
+ *   The size of the arrays.
+ */
+static void mergeSortPaired(double *x, double *y, double *wx, double *wy, int n) {
+  if (n < 2) {
+    return;
+  }
+  int mid = n / 2;
+  mergeSortPaired(x, y, wx, wy, mid);
+  mergeSortPaired(x + mid, y + mid, wx, wy, n - mid);
+
+  int i = 0, j = mid, k = 0;
+  while (i < mid && j < n) {
+    if (x[i] < x[j] || (x[i] == x[j] && y[i] <= y[j])) {
+      wx[k] = x[i];
+      wy[k] = y[i];
+      i++;
+    }
+    else {
+      wx[k] = x[j];
+      wy[k] = y[j];
+      j++;
+    }
+    k++;
+  }
+  while (i < mid) {
+    wx[k] = x[i];
+    wy[k] = y[i];
+    i++;
+    k++;
+  }
+  while (j < n) {
+    wx[k] = x[j];
+    wy[k] = y[j];
+    j++;
+    k++;
+  }
+  for (i = 0; i < n; i++) {
+    x[i] = wx[i];
+    y[i] = wy[i];
+  }
+}
+
+/**
+ * Sorts an array of sample indexes by the expression values they point to.
+ * Missing values (NaN or INF) are placed at the end.
+ *
+ * @param int *idx
+ * @param int *work
+ *   A work array at least the size of n.
+ * @param double *x
+ *   The expression values.
+ * @param int n
+ *   The size of the index array.
+ */
+static void mergeSortOrder(int *idx, int *work, double *x, int n) {
+  if (n < 2) {
+    return;
+  }
+  int mid = n / 2;
+  mergeSortOrder(idx, work, x, mid);
+  mergeSortOrder(idx + mid, work, x, n - mid);
+
+  int i = 0, j = mid, k = 0;
+  while (i < mid && j < n) {
+    double xi = x[idx[i]];
+    double xj = x[idx[j]];
+    int mi = isnan(xi) || isinf(xi);
+    int mj = isnan(xj) || isinf(xj);
+    if (mj || (!mi && xi <= xj)) {
+      work[k++] = idx[i++];
+    }
+    else {
+      work[k++] = idx[j++];
+    }
+  }
+  while (i < mid) {
+    work[k++] = idx[i++];
+  }
+  while (j < n) {
+    work[k++] = idx[j++];
+  }
+  for (i = 0; i < n; i++) {
+    idx[i] = work[i];
+  }
+}
+
+/**
+ * Constructor.
+ */
+KendallSimilarity::KendallSimilarity(PairWiseSet * pws, int min_obs)
+  :PairWiseSimilarity(pws, min_obs) {
+
+  this->order = NULL;
+  strcpy(this->type, "kc");
+}
+/**
+ * Constructor.
+ */
+KendallSimilarity::KendallSimilarity(PairWiseSet * pws, int min_obs, int * samples)
+  :PairWiseSimilarity(pws, min_obs, samples) {
+
+  this->order = NULL;
+  strcpy(this->type, "kc");
+}
+/**
+ * Constructor.
+ *
+ * @param PairWiseSet *pws
+ * @param int min_obs
+ * @param int * samples
+ *   Optional. The samples inclusion array.  Set to NULL to use the samples
+ *   of the pws argument.
+ * @param int * order
+ *   The sort order of the first gene of the pair as returned by
+ *   getSortOrder().  Because the same gene is compared with every other
+ *   gene, the caller can compute this once per gene and avoid sorting
+ *   the samples again for every pair.
+ */
+KendallSimilarity::KendallSimilarity(PairWiseSet * pws, int min_obs, int * samples, int * order)
+  :PairWiseSimilarity(pws, min_obs, samples) {
+
+  this->order = order;
+  strcpy(this->type, "kc");
+}
+
+KendallSimilarity::~KendallSimilarity() {
+
+}
+
+/**
+ * Returns the indexes of the samples of a gene in ascending order of
+ * expression level.  Missing values are placed at the end.
+ *
+ * @param double *x
+ *   The expression values for a gene.
+ * @param int n
+ *   The number of samples.
+ *
+ * @return int *
+ *   An array of sample indexes. The caller is responsible for freeing it.
+ */
+int * KendallSimilarity::getSortOrder(double * x, int n) {
+  int * order = (int *) malloc(sizeof(int) * n);
+  int * work = (int *) malloc(sizeof(int) * n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  mergeSortOrder(order, work, x, n);
+  free(work);
+  return order;
+}
+
+/**
+ * Sorts the a and b arrays together by a, breaking ties by b.
+ *
+ * If a cached sort order is available for the first gene the included
+ * samples are simply read in that order and only runs of tied values need
+ * to be sorted.
+ */
+void KendallSimilarity::sortPaired() {
+  double * wa = (double *) malloc(sizeof(double) * this->n);
+  double * wb = (double *) malloc(sizeof(double) * this->n);
+
+  if (this->order) {
+    int m = 0;
+    for (int i = 0; i < pws->n_orig; i++) {
+      int s = this->order[i];
+      if (pws->samples[s] != 1 || (this->samples && this->samples[s] != 1)) {
+        continue;
+      }
+      this->a[m] = pws->x_orig[s];
+      this->b[m] = pws->y_orig[s];
+      m++;
+    }
+    // Sort the runs of ties in a by the values in b.
+    int i = 0;
+    while (i < m) {
+      int j = i + 1;
+      while (j < m && this->a[j] == this->a[i]) {
+        j++;
+      }
+      if (j - i > 1) {
+        mergeSortPaired(&this->b[i], &this->a[i], wb, wa, j - i);
+      }
+      i = j;
+    }
+  }
+  else {
+    mergeSortPaired(this->a, this->b, wa, wb, this->n);
+  }
+
+  free(wa);
+  free(wb);
+}
+
+/**
+ * Sorts the array y with merge sort and returns the number of swaps
+ * (i.e. the number of discordant pairs) that were needed.
+ *
+ * @param double *y
+ * @param double *work
+ *   A work array at least the size of n.
+ * @param int n
+ */
+long long int KendallSimilarity::countSwaps(double * y, double * work, int n) {
+  if (n < 2) {
+    return 0;
+  }
+  int mid = n / 2;
+  long long int swaps = countSwaps(y, work, mid) + countSwaps(y + mid, work, n - mid);
+
+  int i = 0, j = mid, k = 0;
+  while (i < mid && j < n) {
+    if (y[i] <= y[j]) {
+      work[k++] = y[i++];
+    }
+    else {
+      // Every remaining element on the left is greater than y[j].
+      swaps += mid - i;
+      work[k++] = y[j++];
+    }
+  }
+  while (i < mid) {
+    work[k++] = y[i++];
+  }
+  while (j < n) {
+    work[k++] = y[j++];
+  }
+  for (i = 0; i < n; i++) {
+    y[i] = work[i];
+  }
+  return swaps;
+}
+
+/**
+ * Performs Kendall's tau-b correlation on two arrays using Knight's
+ * algorithm.
+ */
+void KendallSimilarity::run() {
+  // Make sure we have the correct number of observations before performing
+  // the comparision.
+  if (this->n < this->min_obs || this->n < 2) {
+    score = NAN;
+    return;
+  }
+
+  int n = this->n;
+  sortPaired();
+
+  // Count the pairs tied in a (n1) and the pairs tied in both a and b (n3).
+  // Because b is sorted within each run of ties in a the joint ties are
+  // adjacent.
+  long long int n0 = (long long int) n * (n - 1) / 2;
+  long long int n1 = 0;
+  long long int n2 = 0;
+  long long int n3 = 0;
+  int i = 0;
+  while (i < n) {
+    int j = i + 1;
+    while (j < n && this->a[j] == this->a[i]) {
+      j++;
+    }
+    n1 += (long long int) (j - i) * (j - i - 1) / 2;
+    int k = i;
+    while (k < j) {
+      int l = k + 1;
+      while (l < j && this->b[l] == this->b[k]) {
+        l++;
+      }
+      n3 += (long long int) (l - k) * (l - k - 1) / 2;
+      k = l;
+    }
+    i = j;
+  }
+
+  // Sorting b now counts the discordant pairs.
+  double * work = (double *) malloc(sizeof(double) * n);
+  long long int swaps = countSwaps(this->b, work, n);
+  free(work);
+
+  // Count the pairs tied in b.
+  i = 0;
+  while (i < n) {
+    int j = i + 1;
+    while (j < n && this->b[j] == this->b[i]) {
+      j++;
+    }
+    n2 += (long long int) (j - i) * (j - i - 1) / 2;
+    i = j;
+  }
+
+  double denom = sqrt((double) (n0 - n1) * (double) (n0 - n2));
+  if (denom == 0) {
+    score = NAN;
+    return;
+  }
+  score = (double) (n0 - n1 - n2 + n3 - 2 * swaps) / denom;
+}
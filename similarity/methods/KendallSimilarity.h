@@ -0,0 +1,35 @@
+#ifndef _KENDALL_
+#define _KENDALL_
+
+#include "PairWiseSimilarity.h"
+
+/**
+ * Class for Kendall's tau-b rank correlation similarity.
+ *
+ * The coefficient is calculated with Knight's O(n log n) merge sort
+ * algorithm rather than by comparing all n^2 pairs of samples.
+ */
+class KendallSimilarity : public PairWiseSimilarity {
+  private:
+    // Optional. The order of the samples of the first gene (pws->gene1)
+    // when sorted by expression level, as returned by getSortOrder().
+    int * order;
+
+    // Sorts the a and b arrays together by a, breaking ties by b.
+    void sortPaired();
+    // Counts the number of swaps needed to sort an array with merge sort.
+    long long int countSwaps(double * y, double * work, int n);
+
+  public:
+    KendallSimilarity(PairWiseSet * pws, int min_obs);
+    KendallSimilarity(PairWiseSet * pws, int min_obs, int * samples);
+    KendallSimilarity(PairWiseSet * pws, int min_obs, int * samples, int * order);
+    ~KendallSimilarity();
+
+    void run();
+
+    // Returns the indexes of a gene's samples in order of expression level.
+    static int * getSortOrder(double * x, int n);
+};
+
+#endif
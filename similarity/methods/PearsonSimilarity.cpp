@@ -41,6 +41,84 @@ void PearsonSimilarity::run() {
   }
 }
 
+/**
+ * Retrieves the sufficient statistics of the pair.  Pearson's correlation
+ * can be calculated from these, and they can be updated when new samples
+ * are added with addSample().
+ *
+ * The statistics are centered: sums of squared deviations from the mean
+ * rather than raw sums of squares, which lose their precision when the
+ * variance is small compared to the mean.
+ *
+ * @param double *sums
+ *   An array of six doubles. Upon return it contains n, mean(a), mean(b),
+ *   the sums of squared deviations of a and of b from their means and the
+ *   sum of the products of the deviations of a and b.
+ */
+void PearsonSimilarity::getSums(double * sums) {
+  for (int i = 0; i < 6; i++) {
+    sums[i] = 0;
+  }
+  for (int i = 0; i < this->n; i++) {
+    addSample(sums, this->a[i], this->b[i]);
+  }
+}
+
+/**
+ * Adds a sample to the sufficient statistics of a pair.  The means and
+ * sums of deviations are updated as in Welford's method, which is also how
+ * gsl_stats_correlation() calculates them, so statistics updated sample by
+ * sample give the correlation of run() up to rounding.
+ *
+ * @param double *sums
+ *   The sufficient statistics as returned by getSums().
+ * @param double a
+ * @param double b
+ */
+void PearsonSimilarity::addSample(double * sums, double a, double b) {
+  double n = sums[0] + 1;
+  double ratio = sums[0] / n;
+  double da = a - sums[1];
+  double db = b - sums[2];
+
+  sums[3] += da * da * ratio;
+  sums[4] += db * db * ratio;
+  sums[5] += da * db * ratio;
+  sums[1] += da / n;
+  sums[2] += db / n;
+  sums[0] = n;
+}
+
+/**
+ * Calculates Pearson's correlation from sufficient statistics.
+ *
+ * @param double *sums
+ *   The sufficient statistics as returned by getSums().
+ * @param int min_obs
+ *   The minimum number of observations required.
+ *
+ * @return double
+ *   The correlation or NaN if there are too few observations.
+ */
+double PearsonSimilarity::getScoreFromSums(double * sums, int min_obs) {
+  double n = sums[0];
+  if (n < min_obs) {
+    return NAN;
+  }
+  // A gene without variance has no correlation.
+  if (!(sums[3] > 0) || !(sums[4] > 0)) {
+    return NAN;
+  }
+  double r = sums[5] / (sqrt(sums[3]) * sqrt(sums[4]));
+  if (r > 1) {
+    r = 1;
+  }
+  else if (r < -1) {
+    r = -1;
+  }
+  return r;
+}
+
 /**
  * Calculates the Pearson correlation matrix
  *
@@ -4,6 +4,10 @@
 #include <gsl/gsl_statistics.h>
 #include "PairWiseSimilarity.h"
 
+// The version of the statistics of getSums(), stored in the statistics
+// file. Version 1 files held the raw sums.
+#define PEARSON_SUMS_VERSION 2
+
 /**
  *
  */
@@ -14,6 +18,13 @@ class PearsonSimilarity: public PairWiseSimilarity {
     ~PearsonSimilarity();
 
     void run();
+
+    // Retrieves the sufficient statistics of the pair.
+    void getSums(double * sums);
+    // Adds a sample to sufficient statistics.
+    static void addSample(double * sums, double a, double b);
+    // Calculates Pearson's correlation from sufficient statistics.
+    static double getScoreFromSums(double * sums, int min_obs);
 };
 
 #endif
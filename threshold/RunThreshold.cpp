@@ -10,7 +10,8 @@ void RunThreshold::printUsage() {
   printf("  --ematrix|-e     The file name that contains the expression matrix.\n");
   printf("                   The rows must be genes or probe sets and columns are samples\n");
   printf("  --method|-m      The correlation method used. Supported methods include\n");
-  printf("                   Pearson's correlation ('pc'), Spearman's rank ('sc')\n");
+  printf("                   Pearson's correlation ('pc'), Spearman's rank ('sc'),\n");
+  printf("                   Kendall's tau ('kc'), biweight midcorrelation ('bc')\n");
   printf("                   and Mutual Information ('mi').\n");
   printf("  --rows|-r        The number of lines in the input file including the header\n");
   printf("                   column if it exists\n");
@@ -27,17 +28,57 @@ void RunThreshold::printUsage() {
   printf("                   any transformation.\n");
   printf("  --headers        Provide this flag if the first line of the matrix contains\n");
   printf("                   headers.\n");
+  printf("  --group|-G       The sample group of the similarity matrix when it was created\n");
+  printf("                   with the --groups option of the similarity command.\n");
   printf("\n");
   printf("Optional RMT arguments:\n");
-  printf("  --th|-t          A decimal indicating the start threshold. For Pearson's.\n");
-  printf("                   and Spearman's, the default is 0.99. For Mutual\n");
+  printf("  --th|-t          A decimal indicating the start threshold. For Pearson's,\n");
+  printf("                   Spearman's, Kendall's and bicor the default is 0.99. For Mutual\n");
   printf("                   information (--method mi), the default is the maximum MI value\n");
   printf("                   in the similarity matrix\n");
   printf("  --step|-s        The threshold step size, to subtract at each iteration of RMT.\n");
   printf("                   The default is 0.001\n");
+  printf("  --coarse|-C      A larger step for a first pass of the search, e.g. 0.01. The\n");
+  printf("                   thresholds around the one found are then tested at --step.\n");
+  printf("                   The default is 0, to test every step.\n");
   printf("  --chi|-i         The Chi-square test value which when encountered RMT will stop.\n");
   printf("                   The algorithm will only stop if it first encounters a Chi-square\n");
   printf("                   value of 99.607 (df = 60, p-value = 0.001).\n");
+  printf("  --edge_floor|-E  Keep the pairs whose absolute similarity is at least this\n");
+  printf("                   value in a sorted edge index next to the similarity matrix,\n");
+  printf("                   and find the cut matrices of thresholds down to it in the\n");
+  printf("                   index. The index is built on first use.\n");
+  printf("  --edge_memory|-M The memory, in MB, for keeping the highest pairs of the\n");
+  printf("                   similarity matrix in memory for the whole search. The\n");
+  printf("                   floor of the kept pairs is chosen from a histogram of the\n");
+  printf("                   matrix so they fit. The default is 1024. Use 0 to read the\n");
+  printf("                   matrix for every threshold.\n");
+  printf("  --window|-w      The number of thresholds whose eigenvalues are calculated\n");
+  printf("                   at the same time, each on its own thread. The default is\n");
+  printf("                   the number of CPU cores. Use 1 to test one at a time.\n");
+  printf("  --window_memory|-W The memory, in MB, for the cut matrices of the thresholds\n");
+  printf("                   calculated at the same time. Fewer thresholds are\n");
+  printf("                   calculated at once if their matrices do not fit. The\n");
+  printf("                   default is 1024.\n");
+  printf("  --solver|-S      The LAPACK algorithm for the eigenvalues: ssyev, ssyevd\n");
+  printf("                   (divide and conquer), ssyevr (MRRR) or auto. The default,\n");
+  printf("                   auto, uses ssyev, which --solver_bench found the fastest\n");
+  printf("                   at every matrix size.\n");
+  printf("  --solver_bench   Time each algorithm on random matrices and exit.\n");
+  printf("  --spectrum_cache|-K The memory, in MB, for the eigenvalues of the connected\n");
+  printf("                   components of recent cut matrices, which are reused when a\n");
+  printf("                   component does not change. The default is 256. Use 0 to\n");
+  printf("                   calculate every component.\n");
+  printf("  --nnsd_bin|-B    The width of the bins of the histogram of nearest neighbor\n");
+  printf("                   spacings, from 0 to 3. The default is 0.05 (61 bins).\n");
+  printf("  --chi_test|-T    The Chi-square value below which a threshold passes the\n");
+  printf("                   test. The default is 99.607 (df = 60, p-value = 0.001).\n");
+  printf("  --min_pace|-p    The smallest unfolding pace. The default is 10.\n");
+  printf("  --max_pace|-P    The largest unfolding pace. The default is 40. The\n");
+  printf("                   Chi-square values of the paces are averaged.\n");
+  printf("  --from_spectra   Repeat the search with the eigenvalues that an earlier\n");
+  printf("                   search wrote to the .spectra file, instead of reading the\n");
+  printf("                   similarity matrix. Use the same --th and --step.\n");
   printf("\n");
   printf("For Help:\n");
   printf("  --help|-h     Print these usage instructions\n");
@@ -51,7 +92,21 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
 
   thresholdStart = 0.99;
   thresholdStep  = 0.001;
+  coarseStep     = 0;
   chiSoughtValue = 200;
+  edgeFloor = 0;
+  edgeMemory = 1024;
+  window = 0;
+  windowMemory = 1024;
+  eigenMethod = EIGEN_SOLVER_AUTO;
+  spectrumMemory = 256;
+  nnsdBin = 0.05;
+  chiTest = 99.607;
+  minPace = 10;
+  maxPace = 40;
+  fromSpectra = 0;
+  int solver_bench = 0;
+  group = NULL;
 
   // The value returned by getopt_long.
   int c;
@@ -76,17 +131,31 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
       {"func",         required_argument, 0,  'f' },
       {"na_val",       required_argument, 0,  'n' },
       {"ematrix",      required_argument, 0,  'e' },
+      {"group",        required_argument, 0,  'G' },
       // RMT Threshold options.
       {"chi",          required_argument, 0,  'i' },
       {"th",           required_argument, 0,  't' },
       {"step",         required_argument, 0,  's' },
+      {"coarse",       required_argument, 0,  'C' },
+      {"edge_floor",   required_argument, 0,  'E' },
+      {"edge_memory",  required_argument, 0,  'M' },
+      {"window",       required_argument, 0,  'w' },
+      {"window_memory", required_argument, 0, 'W' },
+      {"solver",       required_argument, 0,  'S' },
+      {"solver_bench", no_argument,       &solver_bench,  1 },
+      {"spectrum_cache", required_argument, 0, 'K' },
+      {"nnsd_bin",     required_argument, 0,  'B' },
+      {"chi_test",     required_argument, 0,  'T' },
+      {"min_pace",     required_argument, 0,  'p' },
+      {"max_pace",     required_argument, 0,  'P' },
+      {"from_spectra", no_argument,       &fromSpectra,  1 },
 
       // Last element required to be all zeros.
       {0, 0, 0,  0 }
     };
 
     // get the next option
-    c = getopt_long(argc, argv, "m:g:z:r:c:f:n:e:t:d:l:h", long_options, &option_index);
+    c = getopt_long(argc, argv, "m:g:z:r:c:f:n:e:t:d:l:G:C:E:M:w:W:S:K:B:T:p:P:h", long_options, &option_index);
 
     // if the index is -1 then we have reached the end of the options list
     // and we break out of the while loop
@@ -111,6 +180,43 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
       case 's':
         thresholdStep = atof(optarg);
         break;
+      case 'C':
+        coarseStep = atof(optarg);
+        break;
+      case 'E':
+        edgeFloor = atof(optarg);
+        break;
+      case 'M':
+        edgeMemory = atof(optarg);
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      case 'W':
+        windowMemory = atof(optarg);
+        break;
+      case 'K':
+        spectrumMemory = atof(optarg);
+        break;
+      case 'B':
+        nnsdBin = atof(optarg);
+        break;
+      case 'T':
+        chiTest = atof(optarg);
+        break;
+      case 'p':
+        minPace = atoi(optarg);
+        break;
+      case 'P':
+        maxPace = atoi(optarg);
+        break;
+      case 'S':
+        eigenMethod = EigenSolver::getMethod(optarg);
+        if (eigenMethod < 0) {
+          fprintf(stderr, "Error: The eigenvalue solver must be ssyev, ssyevd, ssyevr or auto (--solver option).\n");
+          exit(-1);
+        }
+        break;
       // Expression matrix options.
       case 'e':
         infilename = optarg;
@@ -127,6 +233,9 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
       case 'f':
         strcpy(func, optarg);
         break;
+      case 'G':
+        group = optarg;
+        break;
       // Help and catch-all options.
       case 'h':
         printUsage();
@@ -144,6 +253,12 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
     }
   }
 
+  // The benchmark of the eigenvalue solvers needs no similarity matrix.
+  if (solver_bench) {
+    EigenSolver::benchmark();
+    exit(0);
+  }
+
   // Make sure the similarity method is valid.
   if (!cmethod) {
     fprintf(stderr,"Please provide the method (--method option).\n");
@@ -174,6 +289,23 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
   }
 
 
+  if (nnsdBin <= 0 || nnsdBin > 3) {
+    fprintf(stderr, "Error: The NNSD bin width must be between 0 and 3 (--nnsd_bin option).\n");
+    exit(-1);
+  }
+  if (minPace < 1 || maxPace < minPace) {
+    fprintf(stderr, "Error: The unfolding paces must be at least 1 and --max_pace must not be\n");
+    fprintf(stderr, "smaller than --min_pace.\n");
+    exit(-1);
+  }
+
+  // The search from the spectra file does not read the similarity matrix.
+  if (fromSpectra) {
+    edgeFloor = 0;
+    edgeMemory = 0;
+    spectrumMemory = 0;
+  }
+
   // TODO: make sure the th_method is in the method array.
 
   if (headers == 1) {
@@ -184,9 +316,37 @@ RunThreshold::RunThreshold(int argc, char *argv[]) {
     printf("  Missing values are: '%s'\n", na_val);
   }
   printf("  Correlation Method: %s\n", cmethod);
+  if (group) {
+    printf("  Sample group: %s\n", group);
+  }
   printf("  Start threshold: %f\n", thresholdStart);
   printf("  Stopping Chi-square %f\n", chiSoughtValue);
   printf("  Step per iteration: %f\n", thresholdStep);
+  if (coarseStep > 0) {
+    printf("  Coarse step: %f\n", coarseStep);
+  }
+  if (edgeFloor > 0) {
+    printf("  Edge index floor: %f\n", edgeFloor);
+  }
+  else if (edgeMemory > 0) {
+    printf("  Memory for pairs: %.0f MB\n", edgeMemory);
+  }
+  if (window > 0) {
+    printf("  Thresholds at once: %d\n", window);
+  }
+  printf("  Memory for cut matrices: %.0f MB\n", windowMemory);
+  if (fromSpectra) {
+    printf("  Eigenvalues: from the spectra file\n");
+  }
+  else {
+    printf("  Eigenvalue solver: %s\n", EigenSolver::getName(eigenMethod));
+  }
+  if (spectrumMemory > 0) {
+    printf("  Memory for component eigenvalues: %.0f MB\n", spectrumMemory);
+  }
+  printf("  NNSD bin width: %f\n", nnsdBin);
+  printf("  Chi-square test: %f\n", chiTest);
+  printf("  Unfolding paces: %d to %d\n", minPace, maxPace);
 
   // Load the input expression matrix.
   printf("  Reading expression matrix...\n");
@@ -206,8 +366,10 @@ RunThreshold::~RunThreshold() {
 void RunThreshold::execute() {
 
   // Find the RMT threshold.
-  RMTThreshold * rmt = new RMTThreshold(ematrix, cmethod, thresholdStart,
-      thresholdStep, chiSoughtValue);
+  RMTThreshold * rmt = new RMTThreshold(ematrix, cmethod, group, thresholdStart,
+      thresholdStep, chiSoughtValue, edgeFloor, edgeMemory, window, windowMemory,
+      coarseStep, eigenMethod, spectrumMemory, nnsdBin, chiTest, minPace,
+      maxPace, fromSpectra);
   rmt->findThreshold();
   printf("Done.\n");
 }
@@ -12,6 +12,8 @@ class RunThreshold {
     char * cmethod;
     // The directory where the binary similarity matrix is found
     char * bin_dir;
+    // The sample group of the similarity matrix or NULL.
+    char * group;
 
     // Variables for the expression matrix
     // -----------------------------------
@@ -36,8 +38,32 @@ class RunThreshold {
     double thresholdStart;
     // The step size for decreasing threshold value.
     double thresholdStep;
+    // The step of the first pass of the search, or 0 for a single pass.
+    double coarseStep;
     // The Chi-square value being sought.
     double chiSoughtValue;
+    // The floor of the edge index, or 0 to not use one.
+    double edgeFloor;
+    // The memory, in MB, for the pairs kept in memory, or 0 to keep none.
+    double edgeMemory;
+    // The number of thresholds tested at once, or 0 for one per CPU core.
+    int window;
+    // The memory, in MB, for the cut matrices of the thresholds tested at once.
+    double windowMemory;
+    // The eigenvalue algorithm, one of EIGEN_SOLVER_*.
+    int eigenMethod;
+    // The memory, in MB, for the eigenvalues of recent components, or 0.
+    double spectrumMemory;
+    // The width of the bins of the NNSD histogram.
+    double nnsdBin;
+    // The Chi-square value below which a threshold passes the test.
+    double chiTest;
+    // The range of unfolding paces whose Chi-square values are averaged.
+    int minPace;
+    int maxPace;
+    // Indicates if the eigenvalues are read from the spectra file of an
+    // earlier search.
+    int fromSpectra;
 
 
     void parseMethods(char * methods_str);
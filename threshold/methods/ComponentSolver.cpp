@@ -0,0 +1,321 @@
+#include "ComponentSolver.h"
+
+/**
+ * Orders eigenvalues in ascending order.
+ */
+static int compare_values(const void * a, const void * b) {
+  float fa = *(float *) a;
+  float fb = *(float *) b;
+  return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+/**
+ * Orders the keys of components.
+ */
+static int compare_keys(const void * a, const void * b) {
+  long long int ka = *(long long int *) a;
+  long long int kb = *(long long int *) b;
+  return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+/**
+ * Constructor.
+ *
+ * @param int method
+ *   The eigenvalue algorithm, one of EIGEN_SOLVER_*.
+ * @param int num_threads
+ *   The number of threads that solve components at the same time.
+ * @param SpectrumCache * cache
+ *   The eigenvalues of recent components, or NULL to solve every component.
+ */
+ComponentSolver::ComponentSolver(int method, int num_threads, SpectrumCache * cache) {
+  this->cache = cache;
+  this->num_threads = num_threads > 0 ? num_threads : 1;
+  solvers = (EigenSolver **) malloc(sizeof(EigenSolver *) * this->num_threads);
+  for (int i = 0; i < this->num_threads; i++) {
+    solvers[i] = new EigenSolver(method);
+  }
+  matrix = NULL;
+  size = 0;
+  ids = NULL;
+  tick = 0;
+  genes = NULL;
+  starts = NULL;
+  num_components = 0;
+  values = NULL;
+  next_component = 0;
+  pthread_mutex_init(&lock, NULL);
+}
+
+/**
+ * Destructor.
+ */
+ComponentSolver::~ComponentSolver() {
+  for (int i = 0; i < num_threads; i++) {
+    delete solvers[i];
+  }
+  free(solvers);
+  pthread_mutex_destroy(&lock);
+}
+
+/**
+ * Finds the root of a gene in a union-find forest, halving the path to it.
+ */
+static int find_root(int * parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+/**
+ * Mixes the bits of a 64-bit number.
+ */
+static unsigned long long component_mix(unsigned long long x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * Calculates the fingerprint of a component: a hash of its genes and of
+ * the values of its upper triangle, in order.
+ *
+ * @param float * block
+ *   The n x n block of the component, of which the upper triangle is read.
+ * @param int * g
+ *   The rows of the genes of the component in the matrix.
+ * @param int n
+ *
+ * @return unsigned long long
+ */
+unsigned long long ComponentSolver::fingerprint(float * block, int * g, int n) {
+  unsigned long long h = component_mix(n);
+  unsigned int bits;
+
+  for (int c = 0; c < n; c++) {
+    h = component_mix(h ^ (unsigned int) ids[g[c]]);
+    float * column = block + (long long int) n * c;
+    for (int r = 0; r < c; r++) {
+      memcpy(&bits, &column[r], sizeof(bits));
+      h = component_mix(h ^ bits);
+    }
+  }
+  return h;
+}
+
+/**
+ * Finds the connected components of the matrix and orders the genes by
+ * component, the largest component first.
+ */
+void ComponentSolver::findComponents() {
+  int * parent = (int *) malloc(sizeof(int) * size);
+  int * count = (int *) malloc(sizeof(int) * size);
+
+  // Join the genes of every value of the upper triangle, the smaller tree
+  // under the larger.
+  for (int i = 0; i < size; i++) {
+    parent[i] = i;
+    count[i] = 1;
+  }
+  for (int c = 1; c < size; c++) {
+    float * column = matrix + (long long int) c * size;
+    for (int r = 0; r < c; r++) {
+      if (column[r] == 0) {
+        continue;
+      }
+      int a = find_root(parent, r);
+      int b = find_root(parent, c);
+      if (a == b) {
+        continue;
+      }
+      if (count[a] < count[b]) {
+        int t = a;
+        a = b;
+        b = t;
+      }
+      parent[b] = a;
+      count[a] += count[b];
+    }
+  }
+
+  // Number the components from the largest down, and those of the same
+  // size by their root.  count[] of a root is the size of its component.
+  long long int * keys = (long long int *) malloc(sizeof(long long int) * size);
+  num_components = 0;
+  for (int i = 0; i < size; i++) {
+    if (find_root(parent, i) == i) {
+      keys[num_components++] = ((long long int) (size - count[i]) << 32) | i;
+    }
+  }
+  qsort(keys, num_components, sizeof(long long int), compare_keys);
+
+  // Place the genes of each component, in gene order.
+  starts[0] = 0;
+  for (int k = 0; k < num_components; k++) {
+    int root = (int) (keys[k] & 0xffffffff);
+    starts[k + 1] = starts[k] + count[root];
+    // The component number of the root, kept in count[] from now on.
+    count[root] = -(k + 1);
+  }
+  int * fill = (int *) malloc(sizeof(int) * (num_components + 1));
+  memcpy(fill, starts, sizeof(int) * (num_components + 1));
+  for (int i = 0; i < size; i++) {
+    int k = -count[find_root(parent, i)] - 1;
+    genes[fill[k]++] = i;
+  }
+
+  free(fill);
+  free(keys);
+  free(count);
+  free(parent);
+}
+
+// The arguments of a thread of solve().
+typedef struct {
+  ComponentSolver * solver;
+  int thread;
+} component_arg_t;
+
+/**
+ * Solves components until none are left.  Each thread copies a component
+ * into a matrix of its own.
+ *
+ * @param void * arg
+ *   A component_arg_t.
+ */
+void * ComponentSolver::solveThread(void * arg) {
+  component_arg_t * a = (component_arg_t *) arg;
+  ComponentSolver * s = a->solver;
+  float * block = NULL;
+  long long int block_size = 0;
+
+  while (1) {
+    pthread_mutex_lock(&s->lock);
+    int k = s->next_component++;
+    pthread_mutex_unlock(&s->lock);
+    if (k >= s->num_components) {
+      break;
+    }
+    int first = s->starts[k];
+    int n = s->starts[k + 1] - first;
+    int * g = s->genes + first;
+
+    // A gene on its own only has its diagonal.
+    if (n == 1) {
+      s->values[first] = s->matrix[g[0] + (long long int) s->size * g[0]];
+      continue;
+    }
+
+    // Copy the upper triangle of the component.  Its genes are in gene
+    // order, so it comes from the upper triangle of the matrix.
+    if ((long long int) n * n > block_size) {
+      free(block);
+      block_size = (long long int) n * n;
+      block = (float *) malloc(sizeof(float) * block_size);
+    }
+    for (int c = 0; c < n; c++) {
+      float * column = s->matrix + (long long int) s->size * g[c];
+      float * to = block + (long long int) n * c;
+      for (int r = 0; r <= c; r++) {
+        to[r] = column[g[r]];
+      }
+    }
+    unsigned long long key = 0;
+    if (s->cache) {
+      key = s->fingerprint(block, g, n);
+      if (s->cache->get(key, n, s->tick, s->values + first)) {
+        continue;
+      }
+    }
+    float * W = s->solvers[a->thread]->solve(block, n);
+    memcpy(s->values + first, W, sizeof(float) * n);
+    if (s->cache) {
+      s->cache->put(key, n, s->tick, W);
+    }
+    free(W);
+  }
+  free(block);
+  return NULL;
+}
+
+/**
+ * Calculates the eigenvalues of a cut matrix.
+ *
+ * @param float * smatrix
+ *   The n x n matrix, of which the upper triangle is read.  Values that are
+ *   0 are not in the cut matrix.  It may be overwritten.
+ * @param int size
+ *   The size, n, of the n x n matrix.
+ * @param int * ids
+ *   The gene of each row of the matrix, which is part of the fingerprint of
+ *   a component.
+ *
+ * @return
+ *   The n eigenvalues, in ascending order.
+ */
+float * ComponentSolver::solve(float * smatrix, int size, int * ids) {
+  this->matrix = smatrix;
+  this->size = size;
+  this->ids = ids;
+  genes = (int *) malloc(sizeof(int) * (size > 0 ? size : 1));
+  starts = (int *) malloc(sizeof(int) * (size + 1));
+  findComponents();
+  if (cache) {
+    tick = cache->nextTick();
+  }
+
+  // A connected matrix is solved whole.
+  if (num_components <= 1) {
+    unsigned long long key = 0;
+    float * W = (float *) malloc(sizeof(float) * (size > 0 ? size : 1));
+    if (cache) {
+      key = fingerprint(smatrix, genes, size);
+      if (cache->get(key, size, tick, W)) {
+        free(genes);
+        free(starts);
+        return W;
+      }
+    }
+    free(W);
+    free(genes);
+    free(starts);
+    W = solvers[0]->solve(smatrix, size);
+    if (cache) {
+      cache->put(key, size, tick, W);
+    }
+    return W;
+  }
+
+  values = (float *) malloc(sizeof(float) * size);
+  next_component = 0;
+  int n = num_threads < num_components ? num_threads : num_components;
+  pthread_t * threads = (pthread_t *) malloc(sizeof(pthread_t) * n);
+  component_arg_t * args = (component_arg_t *) malloc(sizeof(component_arg_t) * n);
+  for (int i = 0; i < n; i++) {
+    args[i].solver = this;
+    args[i].thread = i;
+    if (i > 0) {
+      pthread_create(&threads[i], NULL, solveThread, &args[i]);
+    }
+  }
+  solveThread(&args[0]);
+  for (int i = 1; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(args);
+
+  qsort(values, size, sizeof(float), compare_values);
+  float * W = values;
+  values = NULL;
+  free(genes);
+  free(starts);
+  genes = NULL;
+  starts = NULL;
+  return W;
+}
@@ -0,0 +1,70 @@
+#ifndef _COMPONENTSOLVER_
+#define _COMPONENTSOLVER_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "EigenSolver.h"
+#include "SpectrumCache.h"
+
+/**
+ * Calculates the eigenvalues of a cut matrix from those of its connected
+ * components.
+ *
+ * Two genes of a cut matrix are connected if their similarity is in it, so
+ * at high thresholds the matrix falls apart into many small groups of genes
+ * with no similarity between the groups.  Ordered by group, the matrix is
+ * block diagonal, and its eigenvalues are those of the blocks together.  The
+ * groups are found with a union-find over the values of the matrix, and
+ * each is solved on its own, the largest first, by several threads that
+ * each have their own EigenSolver.  A matrix that is a single group is
+ * solved whole, as before.
+ *
+ * With a SpectrumCache, each component is looked up by a fingerprint of its
+ * genes and values first, so only the components that changed since a
+ * recent cut matrix are solved.  The eigenvalues that are reused are the
+ * ones the solver would calculate again.
+ */
+class ComponentSolver {
+
+  private:
+    // The eigenvalue solvers, one per thread.
+    int num_threads;
+    EigenSolver ** solvers;
+    // The eigenvalues of recent components, or NULL.
+    SpectrumCache * cache;
+    // The matrix being solved and its size.
+    float * matrix;
+    int size;
+    // The gene of each row of the matrix, and the tick of the matrix in the
+    // cache.
+    int * ids;
+    int tick;
+    // The genes of the matrix ordered by component, in gene order within
+    // each, and the first of each component, with one more start at the
+    // end.  The components are numbered from the largest down.
+    int * genes;
+    int * starts;
+    int num_components;
+    // The eigenvalues, at the place of the genes of their component.
+    float * values;
+    // The next component to solve.
+    int next_component;
+    pthread_mutex_t lock;
+
+    void findComponents();
+    unsigned long long fingerprint(float * block, int * g, int n);
+    static void * solveThread(void * arg);
+
+  public:
+    ComponentSolver(int method, int num_threads, SpectrumCache * cache);
+    ~ComponentSolver();
+
+    // Calculates the eigenvalues of a cut matrix, in ascending order.
+    float * solve(float * smatrix, int size, int * ids);
+    // Retrieves the number of components of the last matrix solved.
+    int getNumComponents() { return num_components; }
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include "EigenSolver.h"
+
+// The thread setting of OpenBLAS, which is NULL if another LAPACK is linked.
+extern "C" void openblas_set_num_threads(int num_threads) __attribute__((weak));
+
+/**
+ * Constructor.
+ *
+ * @param int method
+ *   One of EIGEN_SOLVER_*.
+ */
+EigenSolver::EigenSolver(int method) {
+  this->method = method;
+  work = NULL;
+  lwork = 0;
+  iwork = NULL;
+  liwork = 0;
+  isuppz = NULL;
+  isuppz_size = 0;
+  query_method = -1;
+  query_size = -1;
+}
+
+/**
+ * Destructor.
+ */
+EigenSolver::~EigenSolver() {
+  free(work);
+  free(iwork);
+  free(isuppz);
+}
+
+/**
+ * Retrieves the algorithm used for a matrix of the given size.
+ *
+ * Without eigenvectors, all three algorithms reduce the matrix to a
+ * tridiagonal one the same way and differ only in the last, cheap, step.
+ * benchmark() found ssyev as fast as the others at every size from 100 to
+ * 4000 with OpenBLAS, and clearly faster for the largest, so EIGEN_SOLVER_AUTO
+ * uses it for every size.
+ *
+ * @param int size
+ *
+ * @return int
+ */
+int EigenSolver::getMethod(int size) {
+  if (method != EIGEN_SOLVER_AUTO) {
+    return method;
+  }
+  return EIGEN_SOLVER_SSYEV;
+}
+
+/**
+ * Asks LAPACK for the optimal size of the work arrays of an algorithm and a
+ * matrix size, and enlarges the arrays to it.
+ *
+ * @param int method
+ * @param int size
+ */
+void EigenSolver::query(int method, int size) {
+  char jobz = 'N';
+  char uplo = 'U';
+  char range = 'A';
+  int query_lwork = -1;
+  int query_liwork = -1;
+  int lda = size > 0 ? size : 1;
+  int ldz = 1;
+  float vl = 0, vu = 0, abstol = 0;
+  int il = 0, iu = 0, m;
+  float a, w, z, optimal_work = 0;
+  int optimal_iwork = 0;
+  int rc = 0;
+
+  if (method == query_method && size == query_size) {
+    return;
+  }
+
+  switch (method) {
+    case EIGEN_SOLVER_SSYEVD:
+      ssyevd_(&jobz, &uplo, &size, &a, &lda, &w, &optimal_work, &query_lwork,
+          &optimal_iwork, &query_liwork, &rc);
+      break;
+    case EIGEN_SOLVER_SSYEVR:
+      ssyevr_(&jobz, &range, &uplo, &size, &a, &lda, &vl, &vu, &il, &iu,
+          &abstol, &m, &w, &z, &ldz, isuppz, &optimal_work, &query_lwork,
+          &optimal_iwork, &query_liwork, &rc);
+      break;
+    default:
+      ssyev_(&jobz, &uplo, &size, &a, &lda, &w, &optimal_work, &query_lwork, &rc);
+      break;
+  }
+  if (rc != 0) {
+    fprintf(stderr, "ERROR: the workspace query of %s failed (%d).\n", getName(method), rc);
+    exit(-1);
+  }
+
+  // Never give LAPACK less than the minimum ssyev has always been given.
+  int needed = (int) optimal_work;
+  if (needed < 5 * size) {
+    needed = 5 * size;
+  }
+  if (needed > lwork) {
+    free(work);
+    lwork = needed;
+    work = (float *) malloc(sizeof(float) * lwork);
+  }
+  if (optimal_iwork > liwork) {
+    free(iwork);
+    liwork = optimal_iwork;
+    iwork = (int *) malloc(sizeof(int) * liwork);
+  }
+  if (2 * size > isuppz_size) {
+    free(isuppz);
+    isuppz_size = 2 * size;
+    isuppz = (int *) malloc(sizeof(int) * isuppz_size);
+  }
+  query_method = method;
+  query_size = size;
+}
+
+/**
+ * Calculates the eigenvalues of a symmetric matrix.
+ *
+ * @param float * smatrix
+ *   The n x n matrix, of which the upper triangle is read.  It is
+ *   overwritten.
+ * @param int size
+ *   The size, n, of the n x n matrix.
+ *
+ * @return
+ *   The n eigenvalues, in ascending order.
+ */
+float * EigenSolver::solve(float * smatrix, int size) {
+  char jobz = 'N';      // N means don't compute eigenvectors, just eigenvalues
+  char uplo = 'U';      // U means the upper matrix is stored
+  char range = 'A';     // A means all eigenvalues are found
+  int lda = size > 0 ? size : 1;
+  int ldz = 1;
+  float vl = 0, vu = 0, abstol = 0;
+  int il = 0, iu = 0, m;
+  float z;
+  int rc = 0;           // indicates the success of the LAPACK function
+  int method = getMethod(size);
+
+  float * W = (float *) malloc(sizeof(float) * (size > 0 ? size : 1));
+  query(method, size);
+
+  switch (method) {
+    case EIGEN_SOLVER_SSYEVD:
+      ssyevd_(&jobz, &uplo, &size, smatrix, &lda, W, work, &lwork, iwork,
+          &liwork, &rc);
+      break;
+    case EIGEN_SOLVER_SSYEVR:
+      ssyevr_(&jobz, &range, &uplo, &size, smatrix, &lda, &vl, &vu, &il, &iu,
+          &abstol, &m, W, &z, &ldz, isuppz, work, &lwork, iwork, &liwork, &rc);
+      break;
+    default:
+      ssyev_(&jobz, &uplo, &size, smatrix, &lda, W, work, &lwork, &rc);
+      break;
+  }
+
+  // report any errors
+  if (rc < 0) {
+    printf("\nERROR: During eigenvalue calculation, the %d argument had an illegal value. Continuing anyway...\n", rc);
+  }
+  else if (rc > 0) {
+    printf("\nERROR: The eigenvalue algorithm %s failed to converge (%d). Continuing anyway...\n", getName(method), rc);
+  }
+  return W;
+}
+
+/**
+ * Retrieves the algorithm of a name.
+ *
+ * @param char * name
+ *   ssyev, ssyevd, ssyevr or auto.
+ *
+ * @return int
+ *   One of EIGEN_SOLVER_*, or -1 if the name is not known.
+ */
+int EigenSolver::getMethod(char * name) {
+  if (strcmp(name, "auto") == 0) {
+    return EIGEN_SOLVER_AUTO;
+  }
+  if (strcmp(name, "ssyev") == 0) {
+    return EIGEN_SOLVER_SSYEV;
+  }
+  if (strcmp(name, "ssyevd") == 0) {
+    return EIGEN_SOLVER_SSYEVD;
+  }
+  if (strcmp(name, "ssyevr") == 0) {
+    return EIGEN_SOLVER_SSYEVR;
+  }
+  return -1;
+}
+
+/**
+ * Retrieves the name of an algorithm.
+ *
+ * @param int method
+ *
+ * @return const char *
+ */
+const char * EigenSolver::getName(int method) {
+  switch (method) {
+    case EIGEN_SOLVER_SSYEV:
+      return "ssyev";
+    case EIGEN_SOLVER_SSYEVD:
+      return "ssyevd";
+    case EIGEN_SOLVER_SSYEVR:
+      return "ssyevr";
+    default:
+      return "auto";
+  }
+}
+
+/**
+ * Sets the number of threads a multithreaded LAPACK uses for each matrix.
+ * Does nothing if the linked LAPACK does not provide the setting.
+ *
+ * @param int num_threads
+ */
+void EigenSolver::setNumThreads(int num_threads) {
+  if (openblas_set_num_threads) {
+    openblas_set_num_threads(num_threads > 0 ? num_threads : 1);
+  }
+}
+
+/**
+ * Retrieves the current time in seconds.
+ *
+ * @return double
+ */
+double EigenSolver::now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * Times each algorithm on random symmetric matrices of several sizes and
+ * prints the seconds each took per matrix, to choose the algorithms of
+ * EIGEN_SOLVER_AUTO for the LAPACK that is linked.  Each algorithm solves the same matrices, and the
+ * largest difference of their eigenvalues from those of ssyev is printed
+ * as well.
+ */
+void EigenSolver::benchmark() {
+  int sizes[] = {100, 200, 500, 1000, 2000, 4000};
+  int num_sizes = sizeof(sizes) / sizeof(int);
+  int methods[] = {EIGEN_SOLVER_SSYEV, EIGEN_SOLVER_SSYEVD, EIGEN_SOLVER_SSYEVR};
+  unsigned int seed = 1;
+
+  printf("%8s %12s %12s %12s %12s\n", "size", "ssyev", "ssyevd", "ssyevr", "difference");
+  for (int s = 0; s < num_sizes; s++) {
+    int n = sizes[s];
+    float * matrix = (float *) malloc(sizeof(float) * n * n);
+    float * copy = (float *) malloc(sizeof(float) * n * n);
+    float * expected = NULL;
+    double difference = 0;
+
+    for (int c = 0; c < n; c++) {
+      for (int r = 0; r <= c; r++) {
+        matrix[r + n * c] = r == c ? 1 : 2.0 * rand_r(&seed) / RAND_MAX - 1;
+      }
+    }
+
+    printf("%8d", n);
+    for (int i = 0; i < 3; i++) {
+      EigenSolver solver(methods[i]);
+      float * W = NULL;
+      int repeats = 0;
+      double start = now();
+      double elapsed;
+      // Small matrices are solved repeatedly, for at least a tenth of a
+      // second, with the work arrays kept as in a search.
+      do {
+        free(W);
+        memcpy(copy, matrix, sizeof(float) * n * n);
+        W = solver.solve(copy, n);
+        repeats++;
+        elapsed = now() - start;
+      }
+      while (elapsed < 0.1);
+      printf(" %12.6f", elapsed / repeats);
+      fflush(stdout);
+      if (!expected) {
+        expected = W;
+        continue;
+      }
+      for (int k = 0; k < n; k++) {
+        if (fabs(W[k] - expected[k]) > difference) {
+          difference = fabs(W[k] - expected[k]);
+        }
+      }
+      free(W);
+    }
+    printf(" %12g\n", difference);
+    free(expected);
+    free(copy);
+    free(matrix);
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef _EIGENSOLVER_
+#define _EIGENSOLVER_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+// The LAPACK routines for the eigenvalues of a symmetric matrix.
+extern "C" void ssyev_(char* jobz, char* uplo, int* n, float* a, int* lda,
+                       float* w, float* work, int* lwork, int* info);
+extern "C" void ssyevd_(char* jobz, char* uplo, int* n, float* a, int* lda,
+                        float* w, float* work, int* lwork, int* iwork,
+                        int* liwork, int* info);
+extern "C" void ssyevr_(char* jobz, char* range, char* uplo, int* n, float* a,
+                        int* lda, float* vl, float* vu, int* il, int* iu,
+                        float* abstol, int* m, float* w, float* z, int* ldz,
+                        int* isuppz, float* work, int* lwork, int* iwork,
+                        int* liwork, int* info);
+
+// The eigenvalue algorithms.  EIGEN_SOLVER_AUTO chooses by the size of the
+// matrix.
+#define EIGEN_SOLVER_AUTO   0
+#define EIGEN_SOLVER_SSYEV  1
+#define EIGEN_SOLVER_SSYEVD 2
+#define EIGEN_SOLVER_SSYEVR 3
+
+/**
+ * Calculates the eigenvalues of symmetric matrices with one of the LAPACK
+ * algorithms: ssyev (QR), ssyevd (divide and conquer) or ssyevr (MRRR).
+ *
+ * The size of the work arrays is queried from LAPACK, and the arrays are
+ * kept for the next matrix, so a solver that is used for every threshold
+ * of a search allocates them only when the matrix grows.  A solver must only
+ * be used by one thread at a time.
+ *
+ * Only the eigenvalues are calculated.  The upper triangle of the matrix, in
+ * column-major order, is read and overwritten.
+ */
+class EigenSolver {
+
+  private:
+    // The algorithm, one of EIGEN_SOLVER_*.
+    int method;
+    // The work arrays and their sizes.
+    float * work;
+    int lwork;
+    int * iwork;
+    int liwork;
+    int * isuppz;
+    int isuppz_size;
+    // The algorithm and the matrix size of the last workspace query.
+    int query_method;
+    int query_size;
+
+    void query(int method, int size);
+    static double now();
+
+  public:
+    EigenSolver(int method);
+    ~EigenSolver();
+
+    // Calculates the eigenvalues of a matrix, in ascending order.
+    float * solve(float * smatrix, int size);
+    // Retrieves the algorithm used for a matrix of the given size.
+    int getMethod(int size);
+
+    // Retrieves the algorithm of a name: ssyev, ssyevd, ssyevr or auto.
+    static int getMethod(char * name);
+    // Retrieves the name of an algorithm.
+    static const char * getName(int method);
+    // Sets the number of threads of a multithreaded LAPACK, if linked.
+    static void setNumThreads(int num_threads);
+    // Times each algorithm on random matrices of several sizes.
+    static void benchmark();
+};
+
+#endif
@@ -1,35 +1,94 @@
 #include "RMTThreshold.h"
 
-RMTThreshold::RMTThreshold(EMatrix * ematrix,
-    char * cmethod, double thresholdStart, double thresholdStep, double chiSoughtValue)
-  : ThresholdMethod(ematrix, cmethod) {
+RMTThreshold::RMTThreshold(EMatrix * ematrix, char * cmethod, char * group,
+    double thresholdStart, double thresholdStep, double chiSoughtValue,
+    double edgeFloor, double edgeMemory, int window, double windowMemory,
+    double coarseStep, int eigenMethod, double spectrumMemory,
+    double nnsdBin, double chiTest, int minPace, int maxPace,
+    int fromSpectra)
+  : ThresholdMethod(ematrix, cmethod, group) {
 
   this->thresholdStart = thresholdStart;
   this->thresholdStep  = thresholdStep;
+  this->coarseStep     = coarseStep;
   this->chiSoughtValue = chiSoughtValue;
 
   minEigenVectorSize = 100;
 
-  // TODO: perhaps the user should have a bit more control over what these
-  // values should be? 99.607 (Chi-square df = 60 (number of bins in NNSD
-  // histogram), p-value = 0.001). What if user wants a p-value of 0.01?
-  nnsdHistogramBin       = 0.05;
-  chiSquareTestThreshold = 99.607;
-  minUnfoldingPace       = 10;
-  maxUnfoldingPace       = 41;
+  // By default, 99.607 (Chi-square df = 60 (number of bins in NNSD
+  // histogram), p-value = 0.001). The paces are tested from minPace to
+  // maxPace.
+  nnsdHistogramBin       = nnsdBin;
+  chiSquareTestThreshold = chiTest;
+  minUnfoldingPace       = minPace;
+  maxUnfoldingPace       = maxPace + 1;
+  this->fromSpectra      = fromSpectra;
+  spectraFile = NULL;
 
   finalTH  = 0.0;
   finalChi = 10000.0;
   minTH    = 1.0;
   minChi   = 10000.0;
   maxChi   = 0.0;
+
+  // Thresholds down to the floor are found in the edge index. Without an
+  // index file, the highest pairs are kept in memory once the histogram of
+  // the matrix is known.
+  edgeIndex = NULL;
+  geneMax = NULL;
+  cutEdges = 0;
+  cutSize = 0;
+  cutIndex = NULL;
+  cutMatrix = NULL;
+  this->edgeMemory = 0;
+  if (edgeFloor > 0) {
+    edgeIndex = new EdgeIndex(bin_dir, ematrix->getFilePrefix(), cmethod, reader, edgeFloor);
+  }
+  else {
+    this->edgeMemory = edgeMemory;
+  }
+
+  // By default, test as many thresholds at once as there are CPU cores.
+  this->window = window > 0 ? window : reader->getNumThreads();
+  this->windowMemory = windowMemory;
+  jobs = (rmt_job_t *) malloc(sizeof(rmt_job_t) * this->window);
+  // Share the CPU cores between the thresholds tested at the same time.
+  // Each threshold uses its cores to solve the components of its cut matrix
+  // at the same time, or for a multithreaded LAPACK if it has a single one.
+  int job_threads = reader->getNumThreads() / this->window;
+  // The eigenvalues of the components of recent cut matrices are shared by
+  // all thresholds.
+  spectra = spectrumMemory > 0 ? new SpectrumCache(spectrumMemory) : NULL;
+  for (int i = 0; i < this->window; i++) {
+    jobs[i].solver = new ComponentSolver(eigenMethod, job_threads, spectra);
+  }
+  EigenSolver::setNumThreads(job_threads);
+  // The cores of a threshold also test its unfolding paces.
+  nnsdThreads = job_threads > 0 ? job_threads : 1;
+  jobFirst = 0;
+  jobCount = 0;
+  jobBytes = 0;
+  lastBytes = 0;
 }
 
 /**
  *
  */
 RMTThreshold::~RMTThreshold() {
-
+  if (edgeIndex) {
+    delete edgeIndex;
+  }
+  if (geneMax) {
+    delete geneMax;
+  }
+  reset_cut_matrix();
+  for (int i = 0; i < window; i++) {
+    delete jobs[i].solver;
+  }
+  free(jobs);
+  if (spectra) {
+    delete spectra;
+  }
 }
 /*
  *
@@ -37,119 +96,91 @@ RMTThreshold::~RMTThreshold() {
  */
 double RMTThreshold::findThreshold() {
 
-  // A reduced expression matrix containing only gene-paris with
-  // correlations >= the test threshold.
-  float* newM;
-  // The size of newM.
+  // The size of the cut matrix of the threshold being tested.
   int size;
-  // File handles for the eigenvector and Chi-square output files.
-  //FILE *eigenF;
+  // File handle for the Chi-square output file.
   FILE *chiF;
   // The output file name
   char chi_filename[1024];
-  // The output file name
-  //char eigen_filename[1024];
+  // The eigenvalue spectra file name
+  char spectra_filename[1024];
   // The threshold currently being tested.
   float th = thresholdStart;
   // The current chi-square value for the threshold being tested.
   double chi;
-  // Array for eigenvalues.
-  float * E;
   // The output file prefix.
-  char * file_prefix = ematrix->getFilePrefix();
+  char * file_prefix = out_prefix;
   // The number of samples in the expression matrix.
   //int num_samples = ematrix->getNumSamples();
 
 
   // Open the output files and print the headers.
   sprintf(chi_filename, "%s.%s.chiVals.txt", file_prefix, cmethod);
-  //sprintf(eigen_filename, "%s.%s.eigenVals.txt", file_prefix, cmethod);
+  sprintf(spectra_filename, "%s.%s.spectra", file_prefix, cmethod);
 
+  // The eigenvalues are either read from the spectra of an earlier search
+  // or written to them.
+  spectraFile = new SpectraFile(spectra_filename, !fromSpectra);
+  if (fromSpectra) {
+    printf("  Using the %d spectra of: %s\n", spectraFile->getNumSpectra(), spectra_filename);
+  }
 
   chiF = fopen(chi_filename, "w");
-  //eigenF = fopen(eigen_filename, "w");
   fprintf(chiF, "Threshold\tChi-square\tCut Matrix Size\n");
 
   // Iterate through successively smaller threshold values until the following
   // conditions are met:
   // 1)  A Chi-square of
-  do {
-    printf("\n");
-    printf("  testing threshold: %f...\n", th);
-
-    newM = read_similarity_matrix_bin_file(th, &size);
-
-
-    printf("  found matrix of size n x n, n = %d...\n", size);
-    if (size >= minEigenVectorSize) {
-      printf("  calculating eigenvalues...\n");
-      E = calculateEigen(newM, size);
-      free(newM);
-
-      // print out eigenvalues to file
-//      fprintf(eigenF, "%f\t", th);
-//      for (int i = 0; i < size ; i++) {
-//        fprintf(eigenF, "%f\t", E[i]);
-//      }
-//      fprintf(eigenF,"\n");
-
-      printf("  testing similarity of NNSD with Poisson...\n");
-      chi = getNNSDChiSquare(E, size);
-      free(E);
-
-      // if the chi-square test did not fail (== -1) then set the values
-      // for the next iteration
-      if (chi != -1) {
-        fprintf(chiF, "%f\t%f\t%d\n", th, chi, size);
-        fflush(chiF);
-        printf("  chi = %f\n", chi);
-
-        if(chi < minChi){
-          minChi = chi;
-          minTH = th;
-        }
-        if (chi < chiSquareTestThreshold){
-          finalTH = th;
-          finalChi = chi;
-        }
-        if (finalChi < chiSquareTestThreshold && chi > finalChi && th < finalTH){
-          maxChi = chi;
-        }
-      }
-    }
-    else{
-      free(newM);
+  // With a coarse step, the thresholds are first tested at the coarse step.
+  // The search then starts again, at the requested step, from the coarse
+  // threshold above the last one that passed the test, with the values it
+  // had there.
+  int stride = (int) (coarseStep / thresholdStep + 0.5);
+  if (stride > 1) {
+    int resume = 0;
+    double saved[5] = {finalTH, finalChi, minTH, minChi, maxChi};
+    if (!sweep(chiF, 0, stride, &resume, saved)) {
+      // The rise of the Chi-square value fell between the coarse steps:
+      // search every step from the start.
+      resume = 0;
+      saved[0] = 0.0;
+      saved[1] = 10000.0;
+      saved[2] = 1.0;
+      saved[3] = 10000.0;
+      saved[4] = 0.0;
     }
-
-    // decrement the threshold using the step value and then retrieve the
-    // matrix that contains only the threshold and higher
-    th = th - thresholdStep;
+    finalTH  = saved[0];
+    finalChi = saved[1];
+    minTH    = saved[2];
+    minChi   = saved[3];
+    maxChi   = saved[4];
+    fprintf(chiF, "refining from %f\n", thresholdAt(resume));
+    sweep(chiF, resume, 1, NULL, NULL);
+  }
+  else {
+    sweep(chiF, 0, 1, NULL, NULL);
   }
-  while(maxChi < chiSoughtValue);
 
 
   // If finalChi is still greater than threshold, check the small scale
   if (finalChi > chiSquareTestThreshold) {
     fprintf(chiF, "checking small scale\n");
-    th = (float)minTH + 0.2;
+    float next = (float)minTH + 0.2;
+    int started = 0;
     for (int i = 0 ; i <= 40 ; i++) {
-      th = th - thresholdStep * i;
-      newM = read_similarity_matrix_bin_file(th, &size);
-
-      if (size >= 100) {
-        E = calculateEigen(newM, size);
-        free(newM);
+      while (started <= 40 && !windowFull()) {
+        next = next - thresholdStep * started;
+        startJob(next);
+        started++;
+      }
+      finishJob(&th, &size, &chi);
+      checkSpectrum(th, size);
 
-        // print out eigenvalues to file
-       /* fprintf(eigenF, "%f\t", th);
-        for (int j = 0 ; j < size ; j++) {
-          fprintf(eigenF, "%f\t", E[j]);
-        }
-        fprintf(eigenF, "\n");*/
-        chi = getNNSDChiSquare(E, size);
+      // Skip thresholds whose Chi-square test failed (== -1), as the sweep
+      // does.
+      if (size >= 100 && chi != -1) {
         fprintf(chiF, "%f\t%f\t%d\n", th, chi, size);
         fflush(chiF);
-        free(E);
 
         if (chi < minChi) {
           minChi = chi;
@@ -159,16 +190,19 @@ double RMTThreshold::findThreshold() {
           finalTH = th;
           finalChi = chi;
         }
-      } // end if size >= 100
-      else{
-        free(newM);
-      }
+      } // end if size >= 100 and tested
     } // end for 1 -> 40 loop
   } // end if finalChi > rmt...
 
-  // close the chi and eigen files now that results are written
+  if (spectra && spectra->getNumHits() + spectra->getNumMisses() > 0) {
+    printf("  Reused the eigenvalues of %lld of %lld components.\n",
+        spectra->getNumHits(), spectra->getNumHits() + spectra->getNumMisses());
+  }
+
+  // close the chi and spectra files now that results are written
   fclose(chiF);
-  //fclose(eigenF);
+  delete spectraFile;
+  spectraFile = NULL;
 
   // Set the Properties file according to success or failure
   if(finalChi < chiSquareTestThreshold){
@@ -187,6 +221,270 @@ double RMTThreshold::findThreshold() {
   }
 }
 
+/**
+ * Tests successively smaller thresholds until the Chi-square value sought
+ * is found below the last threshold that passed the test.
+ *
+ * @param FILE * chiF
+ *   The file the Chi-square values are written to.
+ * @param int first
+ *   The number of steps from the start threshold to the first threshold.
+ * @param int stride
+ *   The number of steps between the thresholds.
+ * @param int * resume
+ *   If not NULL, set to the number of steps to the threshold after the one
+ *   above the last threshold that passed the test.
+ * @param double * saved
+ *   If not NULL, set to finalTH, finalChi, minTH, minChi and maxChi as they
+ *   were before that threshold.
+ *
+ * @return int
+ *   1 if the search stopped, or 0 if a search with a stride of more than
+ *   one step went below zero, where every cut matrix is the same, first.
+ */
+int RMTThreshold::sweep(FILE * chiF, int first, int stride, int * resume, double * saved) {
+  // The threshold being tested, the size of its cut matrix and its
+  // chi-square value.
+  float th;
+  int size;
+  double chi;
+  // The steps to the next threshold to read and to the next one tested.
+  int next = first;
+  int k = first;
+
+  // The cut matrices of the next thresholds are read while the eigenvalues
+  // of the earlier ones are calculated.
+  do {
+    while (!windowFull()) {
+      startJob(thresholdAt(next));
+      next += stride;
+    }
+    double before[5] = {finalTH, finalChi, minTH, minChi, maxChi};
+    finishJob(&th, &size, &chi);
+    checkSpectrum(th, size);
+
+    if (size >= minEigenVectorSize) {
+      // if the chi-square test did not fail (== -1) then set the values
+      // for the next iteration
+      if (chi != -1) {
+        fprintf(chiF, "%f\t%f\t%d\n", th, chi, size);
+        fflush(chiF);
+        printf("  threshold %f: chi = %f\n", th, chi);
+
+        if(chi < minChi){
+          minChi = chi;
+          minTH = th;
+        }
+        if (chi < chiSquareTestThreshold){
+          finalTH = th;
+          finalChi = chi;
+          if (resume) {
+            *resume = k - stride + 1 > 0 ? k - stride + 1 : 0;
+            memcpy(saved, before, sizeof(before));
+          }
+        }
+        if (finalChi < chiSquareTestThreshold && chi > finalChi && th < finalTH){
+          maxChi = chi;
+        }
+      }
+    }
+    k += stride;
+  }
+  while(maxChi < chiSoughtValue && (stride == 1 || th >= 0));
+
+  // The thresholds tested past the last one are not needed.
+  int stopped = maxChi >= chiSoughtValue;
+  while (jobCount > 0) {
+    finishJob(&th, &size, &chi);
+  }
+  return stopped;
+}
+
+/**
+ * Stops the search if a threshold it needs is not in the spectra file it
+ * is repeated from.
+ *
+ * @param float th
+ * @param int size
+ *   The size of the cut matrix of the threshold, or -1 if it was not found.
+ */
+void RMTThreshold::checkSpectrum(float th, int size) {
+  if (size < 0) {
+    fprintf(stderr, "ERROR: threshold %f is not in the spectra file: '%s'. The search that\n", th, spectraFile->getFileName());
+    fprintf(stderr, "wrote it stopped above it, or used another --th or --step.\n");
+    exit(-1);
+  }
+}
+
+/**
+ * Retrieves the threshold a number of steps below the start threshold.  The
+ * steps are subtracted one by one, as the search always has.
+ *
+ * @param int steps
+ *
+ * @return float
+ */
+float RMTThreshold::thresholdAt(int steps) {
+  float th = thresholdStart;
+
+  for (int i = 0; i < steps; i++) {
+    th = th - thresholdStep;
+  }
+  return th;
+}
+
+/**
+ * Indicates if no other threshold can be tested until the first one is
+ * finished: the window is full, or the cut matrices would not fit in the
+ * memory for the window.  The next matrix is assumed to be as large as the
+ * last one.
+ *
+ * @return int
+ */
+int RMTThreshold::windowFull() {
+  if (jobCount == 0) {
+    return 0;
+  }
+  return jobCount >= window ||
+      jobBytes + lastBytes > (long long int) (windowMemory * 1024 * 1024);
+}
+
+/**
+ * Reads the cut matrix of a threshold and starts the thread that
+ * calculates its eigenvalues and Chi-square value.  No thread is started if
+ * the matrix is too small to be tested.
+ *
+ * @param float th
+ */
+void RMTThreshold::startJob(float th) {
+  rmt_job_t * job = &jobs[(jobFirst + jobCount) % window];
+
+  printf("\n");
+  printf("  testing threshold: %f...\n", th);
+  job->th = th;
+  job->chi = -1;
+  job->num_components = 0;
+  job->started = 0;
+  job->rmt = this;
+  // A threshold that is not in the spectra file has a size of -1.
+  if (fromSpectra) {
+    job->cutM = NULL;
+    job->genes = NULL;
+    if (!spectraFile->find(th, &job->size, &job->eigens)) {
+      job->size = -1;
+    }
+    lastBytes = (long long int) job->size * sizeof(float);
+  }
+  else {
+    job->cutM = read_similarity_matrix_bin_file(th, &job->size, &job->genes);
+    job->eigens = NULL;
+    lastBytes = (long long int) job->size * job->size * sizeof(float);
+  }
+  printf("  found matrix of size n x n, n = %d...\n", job->size);
+
+  if (job->size >= minEigenVectorSize && (job->cutM || job->eigens)) {
+    if (pthread_create(&job->thread, NULL, solveJob, job) != 0) {
+      fprintf(stderr, "ERROR: could not start the thread for threshold %f.\n", th);
+      exit(-1);
+    }
+    job->started = 1;
+    job->bytes = lastBytes;
+    jobBytes += lastBytes;
+  }
+  else {
+    free(job->cutM);
+    free(job->genes);
+    free(job->eigens);
+    job->eigens = NULL;
+  }
+  jobCount++;
+}
+
+/**
+ * Waits for the first threshold being tested to finish and retrieves its
+ * results.
+ *
+ * @param float * th
+ *   Set to the threshold.
+ * @param int * size
+ *   Set to the size of its cut matrix.
+ * @param double * chi
+ *   Set to its Chi-square value, or -1 if it was not tested.
+ */
+void RMTThreshold::finishJob(float * th, int * size, double * chi) {
+  rmt_job_t * job = &jobs[jobFirst];
+
+  if (job->started) {
+    pthread_join(job->thread, NULL);
+    jobBytes -= job->bytes;
+    if (!fromSpectra) {
+      printf("  threshold %f: %d connected components\n", job->th, job->num_components);
+    }
+  }
+  if (!fromSpectra && job->size >= 0) {
+    spectraFile->add(job->th, job->size, job->eigens, job->eigens ? job->size : 0);
+  }
+  free(job->eigens);
+  job->eigens = NULL;
+  *th = job->th;
+  *size = job->size;
+  *chi = job->chi;
+  jobFirst = (jobFirst + 1) % window;
+  jobCount--;
+}
+
+/**
+ * Calculates the eigenvalues and the Chi-square value of a threshold, or
+ * only the Chi-square value if the eigenvalues were read.  The thread of a
+ * rmt_job_t.
+ *
+ * @param void * arg
+ *   The rmt_job_t.
+ */
+void * RMTThreshold::solveJob(void * arg) {
+  rmt_job_t * job = (rmt_job_t *) arg;
+
+  if (!job->eigens) {
+    job->eigens = job->solver->solve(job->cutM, job->size, job->genes);
+    job->num_components = job->solver->getNumComponents();
+    free(job->cutM);
+    free(job->genes);
+    job->cutM = NULL;
+    job->genes = NULL;
+  }
+  job->chi = job->rmt->getNNSDChiSquare(job->eigens, job->size);
+  return NULL;
+}
+
+// The state of a scan of the similarity matrix for a cut matrix.
+typedef struct {
+  float th;
+  // The cut matrix, its size and the index of each gene in it.
+  float * cutM;
+  int used;
+  int * cutM_index;
+} cut_scan_t;
+
+/**
+ * Copies the values of a row above the threshold into the cut matrix.  Each
+ * pair has its own cell, so rows can be copied at the same time.
+ *
+ * @param int j
+ * @param float * rowj
+ * @param int thread
+ * @param void * arg
+ *   A cut_scan_t.
+ */
+static void cut_row(int j, float * rowj, int thread, void * arg) {
+  cut_scan_t * scan = (cut_scan_t *) arg;
+
+  for (int k = 0; k < j; k++) {
+    if (fabs(rowj[k]) > scan->th) {
+      scan->cutM[scan->cutM_index[k] + ((long long int) scan->used * scan->cutM_index[j])] = rowj[k];
+    }
+  }
+}
+
 /*
  * Parses the similarity matrix stored in the binary file format.
  *
@@ -194,112 +492,66 @@ double RMTThreshold::findThreshold() {
  *  The minimum threshold to search for.
  * @param int* size
  *  The size, n, of the cut n x n matrix. This value gets set by the function.
+ * @param int** genes
+ *  Set to a new array of the gene of each row of the cut matrix.
  *
  * @return
  *  A pointer to a floating point array.  The array is a correlation
  *  matrix containing only the genes that have at least one correlation value
  *  greater than the given threshold.
  */
-
-float * RMTThreshold::read_similarity_matrix_bin_file(float th, int * size) {
+float * RMTThreshold::read_similarity_matrix_bin_file(float th, int * size, int ** genes) {
 
   float * cutM;    // the resulting cut similarity matrix
-  float * rowj;    // holds the float value from row i in the bin file
-  int i;           // used to iterate through the bin files
-  int j;           // used to iterate through the rows of each bin file
-  int k;           // used to iterate through the cols of each bine file
-  int z;           // the number of binary files
+  int i;           // used to iterate through the genes
+  int j;           // used to iterate through the rows of the matrix
   int used;        // holds the number of genes (probesets) that have a greater thrshold
-  int limit;       // the maximum row in the current correlation bin file
-  int junk;        // a dummy variable
-  FILE* in;
-  char filename[1024]; // used for storing the bin file name
 
-  int file_num_genes;
-  int file_num_lines;
+  int file_num_genes = reader->getNumGenes();
 
-
-  // open the file and get the number of genes and the lines per file
-  // these data are the first two integers in the file
-  FILE* info;
-  sprintf(filename, "%s/%s.%s%d.bin", bin_dir, ematrix->getFilePrefix(), cmethod, 0);
-  // TODO: check that file exists before trying to open
-  info = fopen(filename, "rb");
-  fread(&file_num_genes, sizeof(int), 1, info);
-  fread(&file_num_lines, sizeof(int), 1, info);
-  fclose(info);
-
-  printf("  Genes: %d, Num lines per file: %d\n", file_num_genes, file_num_lines);
-
-  int num_genes = ematrix->getNumGenes();
-  int * usedFlag = (int *) malloc(num_genes * sizeof(int));
-  int * cutM_index = (int *) malloc(num_genes * sizeof(int));
-
-  memset(cutM_index, -1, sizeof(int) * (num_genes));
-  memset(usedFlag, 0, sizeof(int) * (num_genes));
-
-
-  rowj = (float *) malloc(sizeof(float) * file_num_genes);
+  // Use the edge index if it holds every pair above the threshold.
+  if (edgeIndex && th >= edgeIndex->getFloor()) {
+    return read_edge_index(th, size, genes);
+  }
+  reset_cut_matrix();
 
   // we need to know how many rows and columns we will have in our cut matrix.
   // the cut matrix is the matrix that only contains genes with a threshold
-  // value greater than the given value.  Therefore, we iterate through the
-  // file to find out how many genes we will have in the cut matrix, then
-  // we iterate again to build the cut matrix.
-
-  // TODO: we should save an index in the file for where these correlation
-  // values are stored rather than iterating through the file twice.
-
-  // ------------------------------
-  // Step #1: iterate through the binary correlation files to find out how many
-  // genes there will be in the cut matrix.
-  z = (file_num_genes - 1) / file_num_lines;
-  for (i = 0; i <= z; i++) {
-
-    sprintf(filename, "%s/%s.%s%d.bin", bin_dir, ematrix->getFilePrefix(), cmethod, i);
-    in = fopen(filename, "rb");
-    fread(&junk, sizeof(int), 1, in); // file_num_genes
-    fread(&junk, sizeof(int), 1, in); // file_num_lines
-    if (i != z) {
-      limit = (i + 1) * file_num_lines;
-    }
-    else{
-      limit = file_num_genes;
-    }
+  // value greater than the given value.  A gene is in the cut matrix exactly
+  // when its largest similarity is above the threshold. The largest
+  // similarity of every gene is found once, on the first read of the matrix,
+  // and kept next to it.
+  if (!geneMax) {
+    geneMax = new GeneMaxIndex(bin_dir, ematrix->getFilePrefix(), cmethod, reader);
+  }
 
-    // iterate through the rows and columns of the file and look for
-    // entries greater than the provided threshold.  When found, use
-    // the row and column indexes to set a '1' in the  array.
-    // this array indicates which genes have values we want to keep.
-    for (j = i * file_num_lines; j < limit; j++) {
-      fread(rowj, sizeof(float), j + 1, in);
-      for (k = 0; k < j + 1; k++) {
-        // if the correlation value is greater than the given threshold then
-        // flag the row/column indexes
-        if (k != j && fabs(rowj[k]) > th) {
-          usedFlag[k] = 1;
-          usedFlag[j] = 1;
-        }
+  // Keep the pairs down to the lowest floor that fits in the memory budget,
+  // and find the cut matrices of the following thresholds in memory.
+  if (edgeMemory > 0) {
+    long long int max_pairs = (long long int) (edgeMemory * 1024 * 1024 / sizeof(edge_index_edge_t));
+    long long int num_pairs;
+    float floor = geneMax->getFloor(max_pairs, &num_pairs);
+    edgeMemory = 0;
+    if (num_pairs > 0) {
+      edgeIndex = new EdgeIndex(reader, floor);
+      if (th >= floor) {
+        return read_edge_index(th, size, genes);
       }
     }
-    fclose(in);
   }
+  float * maxima = geneMax->getMaxima();
+  used = geneMax->countAbove(th);
 
-  // get the number of genes (or probe sets) that have a correlation value
-  // greater than the provided threshold value
-  used = 0;
+  // number the genes of the cut matrix in gene order.
+  int * cutM_index = (int *) malloc(file_num_genes * sizeof(int));
   j = 0;
   for (i = 0; i < file_num_genes; i++) {
-    if (usedFlag[i] == 1) {
-      used++;
-      cutM_index[i] = j;
-      j++;
-    }
+    cutM_index[i] = maxima[i] > th ? j++ : -1;
   }
 
   // now that we know how many genes have a threshold greater than the
   // given we can allocate memory for new cut matrix
-  cutM = (float *) calloc(used * used, sizeof(float));
+  cutM = (float *) calloc((long long int) used * used, sizeof(float));
   // initialize the diagonal to 1
   for (i = 0; i < used; i++) {
     cutM[i + i * used] = 1;
@@ -307,90 +559,140 @@ float * RMTThreshold::read_similarity_matrix_bin_file(float th, int * size) {
 
   // set the incoming size argument to be the size dimension of the cut matrix
   *size = used;
-
-  // ------------------------------
-  // Step #2: Now build the cut matrix by retrieving the correlation values
-  // for each of the genes identified previously.
-  for (i = 0; i <= z; i++) {
-
-    sprintf(filename, "%s/%s.%s%d.bin", bin_dir, ematrix->getFilePrefix(), cmethod, i);
-    in = fopen(filename, "rb");
-    fread(&junk, sizeof(int), 1, in); // file_num_genes
-    fread(&junk, sizeof(int), 1, in); // file_num_lines
-    if (i != z) {
-      limit = (i + 1) * file_num_lines;
-    }
-    else{
-      limit = file_num_genes;
-    }
-    // iterate through the rows of the bin file
-    for (j = i * file_num_lines; j < limit; j++) {
-      fread(rowj, sizeof(float), j + 1, in);
-      // iterate through the columns of row i
-      for (k = 0; k < j + 1; k++){
-        // if the correlation value is greater than the given then save the value
-        if (k != j && fabs(rowj[k]) > th){
-          cutM[cutM_index[k] + (used * cutM_index[j])] = rowj[k];
-        }
-      }
+  *genes = (int *) malloc(sizeof(int) * (used > 0 ? used : 1));
+  for (i = 0; i < file_num_genes; i++) {
+    if (cutM_index[i] >= 0) {
+      (*genes)[cutM_index[i]] = i;
     }
-    fclose(in);
   }
 
-  // print the cut matrix
-  for (i = 0; i < used; i++) {
-    for (j = 0; j < used; j++) {
-      //printf("%f ", cutM[i * used + j]);
-    }
-    //printf("\n");
-  }
+  // Build the cut matrix by retrieving the correlation values for each of
+  // the genes identified previously. The rows are read by several threads.
+  // Rows without a value above the threshold are skipped.
+  cut_scan_t scan;
+  scan.th = th;
+  scan.cutM = cutM;
+  scan.used = used;
+  scan.cutM_index = cutM_index;
+  reader->scanRows(th, cut_row, &scan);
 
-  // free memory
-  free(rowj);
   free(cutM_index);
-  free(usedFlag);
   return cutM;
 }
 
 /*
- * Calculates the eigenvalues of the given matrix.  This function is a wrapper
- * for the ssyev_ function of the LAPACK package.
+ * Builds the cut matrix from the pairs of the edge index.  The pairs above
+ * the threshold are the first ones of the index, so only the pairs that
+ * were not above the previous threshold are read from the file.
  *
- * @param float * smatrix
- *   A pointer to an array of floating point numbers representing the
- *   square n x n similarity matrix.
- * @param int size
- *   The size, n, of the n x n matrix.
+ * The cut matrix of the previous threshold is kept and only the new pairs
+ * are added to it.  When new genes join, the kept values are moved to the
+ * rows and columns of their genes in a larger matrix.  The genes stay in
+ * gene order, so the matrix is the one the similarity matrix gives.
+ *
+ * @param float th
+ *  The minimum threshold to search for. It must not be below the floor of
+ *  the index.
+ * @param int* size
+ *  The size, n, of the cut n x n matrix. This value gets set by the function.
+ * @param int** genes
+ *  Set to a new array of the gene of each row of the cut matrix.
  *
  * @return
- *   A pointer to an array of floating point numbers representing the
- *   array of eigenvalues
+ *  A copy of the upper triangle and diagonal of the cut matrix, in the
+ *  column-major order of LAPACK, which the eigenvalue solver may
+ *  overwrite.  The values below the diagonal are not set.
  */
+float * RMTThreshold::read_edge_index(float th, int * size, int ** genes) {
+  edge_index_edge_t * edges;
+  long long int num_edges = edgeIndex->getEdges(th, &edges);
+  int num_genes = reader->getNumGenes();
+
+  // A higher threshold than the last one starts over.
+  if (!cutIndex || num_edges < cutEdges) {
+    reset_cut_matrix();
+    cutIndex = (int *) malloc(num_genes * sizeof(int));
+    memset(cutIndex, -1, sizeof(int) * num_genes);
+  }
 
-float * RMTThreshold::calculateEigen(float * smatrix, int size) {
+  // Flag the genes that join the cut matrix.
+  int num_new = 0;
+  for (long long int e = cutEdges; e < num_edges; e++) {
+    if (cutIndex[edges[e].i] == -1) {
+      cutIndex[edges[e].i] = -2;
+      num_new++;
+    }
+    if (cutIndex[edges[e].j] == -1) {
+      cutIndex[edges[e].j] = -2;
+      num_new++;
+    }
+  }
 
-  char jobz = 'N';      // N means don't compute eigenvectors, just eigenvalues
-  char uplo = 'U';      // U means the upper matrix is stored
-  float * W;            // the array where eignvalues are stored
-  float * work;         // a working array. This will be 5 times the size of the final array
-  int lwork = 5 * size; // the size of the work array
-  int rc;               // indicates the success of the ssyev_ function
+  // Number the genes in gene order, as the rows of the similarity matrix
+  // would, and move the kept values to their new places.
+  if (num_new > 0) {
+    int used = cutSize + num_new;
+    int * moved = (int *) malloc(sizeof(int) * (cutSize > 0 ? cutSize : 1));
+    int n = 0;
+    for (int i = 0; i < num_genes; i++) {
+      if (cutIndex[i] >= 0) {
+        moved[cutIndex[i]] = n;
+      }
+      if (cutIndex[i] != -1) {
+        cutIndex[i] = n++;
+      }
+    }
 
-  // allocate the arrays
-  W    = (float *) malloc(sizeof(float) * size);
-  work = (float *) malloc(sizeof(float) * 5 * size);
+    float * grown = (float *) calloc((long long int) used * used, sizeof(float));
+    for (int i = 0; i < used; i++) {
+      grown[i + (long long int) i * used] = 1;
+    }
+    for (int c = 0; c < cutSize; c++) {
+      float * from = cutMatrix + (long long int) c * cutSize;
+      float * to = grown + (long long int) moved[c] * used;
+      for (int r = 0; r < c; r++) {
+        to[moved[r]] = from[r];
+      }
+    }
+    free(moved);
+    free(cutMatrix);
+    cutMatrix = grown;
+    cutSize = used;
+  }
 
-  ssyev_(&jobz, &uplo , &size, smatrix, &size, W, work, &lwork, &rc);
+  // Add the new pairs.
+  for (long long int e = cutEdges; e < num_edges; e++) {
+    cutMatrix[cutIndex[edges[e].j] + ((long long int) cutSize * cutIndex[edges[e].i])] = edges[e].score;
+  }
+  cutEdges = num_edges;
 
-  // report any errors
-  if (rc < 0) {
-    printf("\nERROR: During eigenvalue calculation, the %d argument had an illegal value. Continuing anyway...\n", rc);
+  // The eigenvalue solver overwrites its matrix and only reads the upper
+  // triangle, so only that is copied.
+  float * cutM = (float *) malloc(sizeof(float) * ((long long int) cutSize * cutSize > 0 ? (long long int) cutSize * cutSize : 1));
+  for (int c = 0; c < cutSize; c++) {
+    memcpy(cutM + (long long int) c * cutSize, cutMatrix + (long long int) c * cutSize, sizeof(float) * (c + 1));
   }
-  else if (rc > 0) {
-    printf("\nERROR: The eigenvalue algorithm failed to converge; %d off-diagonal elements of an intermediate tridiagonal form did not converge to zero. Continuing anyway...\n", rc);
+  *size = cutSize;
+  *genes = (int *) malloc(sizeof(int) * (cutSize > 0 ? cutSize : 1));
+  for (int i = 0; i < num_genes; i++) {
+    if (cutIndex[i] >= 0) {
+      (*genes)[cutIndex[i]] = i;
+    }
   }
-  free(work);
-  return W;
+  return cutM;
+}
+
+/*
+ * Frees the cut matrix kept from the last threshold found in the edge
+ * index.
+ */
+void RMTThreshold::reset_cut_matrix() {
+  free(cutIndex);
+  free(cutMatrix);
+  cutIndex = NULL;
+  cutMatrix = NULL;
+  cutEdges = 0;
+  cutSize = 0;
 }
 
 /**
@@ -401,12 +703,17 @@ float * RMTThreshold::calculateEigen(float * smatrix, int size) {
  *   The size of the eigenvalue array.
  * @param int m
  *  The pace.
+ * @param double* work
+ *  A work array of at least size + 2 * (size / m + 2) values.
+ * @param gsl_interp_accel* acc
+ *  The spline accelerator, which is reset first.
  *
  * @return
- *  Returned array will always be sorted and of length size-1
+ *  The nearest neighbor spacings, of length size-1, at the start of work.
+ *  They are not sorted.
  */
 
-double * RMTThreshold::unfolding(float * e, int size, int m) {
+double * RMTThreshold::unfolding(float * e, int size, int m, double * work, gsl_interp_accel * acc) {
   // Count equals 1 initially because of 2 lines following loop
   // which propagates the arrays.
   int count = 1;
@@ -421,8 +728,9 @@ double * RMTThreshold::unfolding(float * e, int size, int m) {
   }
 
   // Retrieve the 'count' number of points from the eigenvalue array.
-  double *oX = (double*) malloc(sizeof(double) * count);
-  double *oY = (double*) malloc(sizeof(double) * count);
+  double * yy = work;
+  double * oX = work + size;
+  double * oY = oX + count;
   for(i = 0; i < size - m; i += m){
     oX[j] = e[i];
     oY[j] = (i + 1.0) / (double) size;
@@ -442,31 +750,28 @@ double * RMTThreshold::unfolding(float * e, int size, int m) {
   // Initialize the spline function using a csspline. See gsl docs,
   // chapter 27: cspline is a natural spline.
   // Changed to akima spline (2/25/2016) -- spf
-  gsl_interp_accel *acc = gsl_interp_accel_alloc();
+  // The spline has the size of its points, so it cannot be reused for
+  // another pace.
+  gsl_interp_accel_reset(acc);
   gsl_spline *spline = gsl_spline_alloc(gsl_interp_akima, count);
   gsl_spline_init(spline, oX, oY, count);
 
   // Estimate new eigenvalues along the spline curve.  We provide the
   // eigenvalues and the interplolation function gives us new y values
   // in the range of 0 to 1.
-  double * yy = (double*) malloc(sizeof(double) * size);
   for (i = 0; i < size - 2; i++) {
     yy[i+1] = gsl_spline_eval(spline, e[i+1], acc);
   }
 
-  // Calculate the spacing array.
+  // Calculate the spacing array.  The histogram of the spacings does not
+  // need them sorted.
   yy[0] = 0.0;
   yy[size - 1] = 1.0;
   for (i = 0; i < size - 1; i++) {
     yy[i] = (yy[i+1] - yy[i]) * size;
   }
-  quickSortD(yy, size-1);
 
-  // Free up memory.
   gsl_spline_free(spline);
-  gsl_interp_accel_free(acc);
-  free(oX);
-  free(oY);
 
   // Return the nearest neighbor spacing array.
   return yy;
@@ -529,8 +834,61 @@ float * RMTThreshold::degenerate(float* eigens, int size, int* newSize) {
   return remDups;
 }
 
+// The state of the Chi-square tests of the paces of a set of eigenvalues.
+typedef struct {
+  RMTThreshold * rmt;
+  // The eigenvalues, with duplicates removed.
+  float * eigens;
+  int size;
+  // The Chi-square value of each pace, or -1 if it was skipped.
+  double * chis;
+  // The next pace to test.
+  int next_pace;
+  pthread_mutex_t lock;
+} nnsd_state_t;
+
+/**
+ * Tests paces until none are left.  Each thread has its own work arrays
+ * for all of its paces.
+ *
+ * @param void * arg
+ *   An nnsd_state_t.
+ */
+void * RMTThreshold::paceThread(void * arg) {
+  nnsd_state_t * s = (nnsd_state_t *) arg;
+  RMTThreshold * rmt = s->rmt;
+  int num_bins = (int) (3.0 / rmt->nnsdHistogramBin) + 1;
+  double * work = (double *) malloc(sizeof(double) * (s->size + 2 * (s->size / rmt->minUnfoldingPace + 2)));
+  int * counts = (int *) malloc(sizeof(int) * num_bins);
+  gsl_interp_accel * acc = gsl_interp_accel_alloc();
+
+  while (1) {
+    pthread_mutex_lock(&s->lock);
+    int m = s->next_pace++;
+    pthread_mutex_unlock(&s->lock);
+    if (m >= rmt->maxUnfoldingPace) {
+      break;
+    }
+
+    // If the size / pace is fewer than 5 then skip this test
+    if (s->size / m < 5) {
+      s->chis[m - rmt->minUnfoldingPace] = -1;
+      continue;
+    }
+    s->chis[m - rmt->minUnfoldingPace] = rmt->getNNSDPaceChiSquare(s->eigens,
+        s->size, rmt->nnsdHistogramBin, m, work, counts, acc);
+  }
+
+  gsl_interp_accel_free(acc);
+  free(counts);
+  free(work);
+  return NULL;
+}
+
 /*
  * Returns the averaged Chi-square test across a range of unfolding trials.
+ * The duplicates are removed once, and the paces are tested by several
+ * threads.  The values are averaged in the order of the paces.
  *
  * @param float* eigens
  *   An array of eigenvalues
@@ -542,41 +900,57 @@ float * RMTThreshold::degenerate(float* eigens, int size, int* newSize) {
  */
 
 double RMTThreshold::getNNSDChiSquare(float* eigens, int size) {
-  double chiTest = 0;
-  double avg_chiTest;
+  double avg_chiTest = 0;
   int i = 0;
-  int m;
-  // The new eigenvalue array after duplicates removed
-  float * newE;
   // The new size of the eigenvalue array after duplicates removed
   int newSize;
 
+  // Remove duplicates from the list of eigenvalues.
+  float * newE = degenerate(eigens, size, &newSize);
+
+  // Make sure our vector of eigenvalues is still large enough after
+  // duplicates have been removed. If not, return a -1.
+  if (newSize < minEigenVectorSize) {
+    free(newE);
+    return -1;
+  }
+
   // We want to generate an average Chi-square value across various levels of
   // unfolding. Therefore, we iterate through the min and max unfolding pace
   // and then average the Chi-square values returned
-  for (m = minUnfoldingPace; m < maxUnfoldingPace; m++) {
-
-    // Remove duplicates from the list of eigenvalues.
-    newE = degenerate(eigens, size, &newSize);
+  int num_paces = maxUnfoldingPace - minUnfoldingPace;
+  nnsd_state_t state;
+  state.rmt = this;
+  state.eigens = newE;
+  state.size = newSize;
+  state.chis = (double *) malloc(sizeof(double) * (num_paces > 0 ? num_paces : 1));
+  state.next_pace = minUnfoldingPace;
+  pthread_mutex_init(&state.lock, NULL);
+
+  int n = nnsdThreads < num_paces ? nnsdThreads : num_paces;
+  pthread_t * threads = (pthread_t *) malloc(sizeof(pthread_t) * (n > 0 ? n : 1));
+  for (int t = 1; t < n; t++) {
+    pthread_create(&threads[t], NULL, paceThread, &state);
+  }
+  paceThread(&state);
+  for (int t = 1; t < n; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&state.lock);
 
-    // Make sure our vector of eigenvalues is still large enough after
-    // duplicates have been removed. If not, return a -1.
-    if (newSize < minEigenVectorSize) {
-      //printf("    Chi-square test failed: eigenvalue array too small after duplicate removal. See the eigenvector output file.\n");
-      continue;
+  for (int p = 0; p < num_paces; p++) {
+    if (state.chis[p] != -1) {
+      avg_chiTest += state.chis[p];
+      i++;
     }
+  }
+  free(state.chis);
+  free(newE);
 
-    // If the size / pace is fewer than 5 then skip this test
-    if (newSize / m < 5) {
-      continue;
-    }
-
-    // Get the Chi-Square value
-    chiTest = getNNSDPaceChiSquare(newE, newSize, nnsdHistogramBin, m);
-    avg_chiTest += chiTest;
-    i++;
-
-    free(newE);
+  // The test fails if no pace could be used.
+  if (i == 0) {
+    return -1;
   }
 
   // return the average Chi-square value
@@ -595,27 +969,32 @@ double RMTThreshold::getNNSDChiSquare(float* eigens, int size) {
  *   The relative histogram bin size
  * @param int pace
  *   The unfolding pace
- * @param RMTParameters
- *
+ * @param double* work
+ *   The work array of unfolding()
+ * @param int* counts
+ *   The counts of the (3.0 / bin) + 1 histogram bins
+ * @param gsl_interp_accel* acc
+ *   The spline accelerator of unfolding()
  *
  * @return double
  *   A Chi-square value, or -1 on failure
  */
 
 double RMTThreshold::getNNSDPaceChiSquare(float* eigens,
-    int size, double bin, int pace) {
+    int size, double bin, int pace, double * work, int * counts,
+    gsl_interp_accel * acc) {
 
   // The nearest neighbor spacing array.
   double * edif;
   double obj;
   double expect;
   double chi = 0;
-  int i, j, count;
+  int i, j, k;
 
 
   // Unfolding will calculate the nearest neighbor spacing via estimation using
-  // a spline curve. It returns a new array of length size - 1
-  edif = unfolding(eigens, size, pace);
+  // a spline curve. It returns an array of length size - 1 in the work array.
+  edif = unfolding(eigens, size, pace, work, acc);
   size = size - 1;
 
   // Construct a histogram of (3.0/bin) + 1 bins.  If bin is 0.05 then the
@@ -625,16 +1004,30 @@ double RMTThreshold::getNNSDPaceChiSquare(float* eigens,
   // histogram, we just calculate the observed frequency and use that for
   // calculation of the Chi-square value.
   int n = (int) (3.0 / bin) + 1;
-  for (i = 0; i < n; i++) {
-    count = 0;
 
-    // Create the histogram (or NNSD).  We are only interested in the
-    // bins between 0 and 3.
-    for (j = 0; j < size; j++) {
-      if (edif[j] > i * bin && edif[j] < (i + 1) * bin) {
-        count++;
+  // Create the histogram (or NNSD) in one pass over the spacings.  We are
+  // only interested in the bins between 0 and 3.  A spacing is counted in
+  // bin i if it is strictly between i * bin and (i + 1) * bin, so one that
+  // falls on a bin edge is in no bin.  The bin found by division may be off
+  // by one from rounding, so its neighbours are tested the same way.
+  for (i = 0; i < n; i++) {
+    counts[i] = 0;
+  }
+  for (j = 0; j < size; j++) {
+    double s = edif[j];
+    if (!(s > 0 && s < n * bin)) {
+      continue;
+    }
+    int b = (int) floor(s / bin);
+    for (k = b - 1; k <= b + 1; k++) {
+      if (k >= 0 && k < n && s > k * bin && s < (k + 1) * bin) {
+        counts[k]++;
+        break;
       }
     }
+  }
+
+  for (i = 0; i < n; i++) {
 
     // https://books.google.com/books?id=Kp3Nx03_gMwC, pg 12.
     // The probability of s, p(s), from a poisson distribution is the integral
@@ -652,9 +1045,8 @@ double RMTThreshold::getNNSDPaceChiSquare(float* eigens,
 
     // Perform the summation used for calculating the Chi-square value.
     // When the looping completes we will have the final Chi-square value.
-    obj = (double) count;
+    obj = (double) counts[i];
     chi += (obj - expect) * (obj - expect) / expect;
   }
-  free(edif);
   return chi;
 }
@@ -11,17 +11,65 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <regex.h>
+#include <pthread.h>
 #include "../../general/vector.h"
+#include "../../similarity/EdgeIndex.h"
+#include "../../similarity/GeneMaxIndex.h"
+#include "ComponentSolver.h"
+#include "SpectraFile.h"
 
 
 #include "ThresholdMethod.h"
 
-// SSYEV prototype
-extern "C" void ssyev_(char* jobz, char* uplo, int* n, float* a, int* lda,
-                       float* w, float* work, int* lwork, int* info);
+class RMTThreshold;
+
+/**
+ * A threshold whose eigenvalues and Chi-square value are calculated by a
+ * thread of its own while the cut matrices of the following thresholds are
+ * read.
+ */
+typedef struct {
+  float th;
+  // The cut matrix, its size and the gene of each of its rows.  The thread
+  // frees them.
+  float * cutM;
+  int size;
+  int * genes;
+  // The eigenvalues, set by the thread, or read from a spectra file.
+  float * eigens;
+  // The Chi-square value, set by the thread.
+  double chi;
+  // Set to 1 if a thread was started for the threshold, and the bytes it
+  // holds.
+  int started;
+  long long int bytes;
+  pthread_t thread;
+  RMTThreshold * rmt;
+  // The number of connected components of the cut matrix.
+  int num_components;
+  // The eigenvalue solver of the job's place in the window, whose work
+  // arrays are kept from one threshold to the next.
+  ComponentSolver * solver;
+} rmt_job_t;
 
 /**
  * Implements Random Matrix Theory (RMT) Thresholding
+ *
+ * The thresholds of the search are tested in order, but the eigenvalues of
+ * a window of them are calculated at the same time, each by its own thread.
+ * The results are used in threshold order, so the search stops at the same
+ * threshold as one that tests them one by one, and the results of the
+ * thresholds tested past it are dropped.
+ *
+ * With a coarse step, the thresholds are first tested at the coarse step to
+ * find where the Chi-square value rises, and only the thresholds from the
+ * last coarse one that passed the test down are tested at the requested
+ * step.  The threshold found is then usually the one of the full search.
+ * If the coarse steps miss the rise altogether, every step is searched.
+ *
+ * The eigenvalues of every threshold tested are written to a spectra file.
+ * The search can be repeated from that file with other Chi-square test
+ * parameters, in which case only the Chi-square values are calculated.
  */
 
 class RMTThreshold : public ThresholdMethod {
@@ -30,6 +78,8 @@ class RMTThreshold : public ThresholdMethod {
     // Variables for RMT
     double thresholdStart;
     double thresholdStep;
+    // The step of the first pass of the search, or 0 for a single pass.
+    double coarseStep;
     double chiSoughtValue;
     int minEigenVectorSize;
     double finalTH;
@@ -43,20 +93,77 @@ class RMTThreshold : public ThresholdMethod {
     int minUnfoldingPace;
     int maxUnfoldingPace;
 
+    // The sorted index of the pairs above a floor, or NULL if the cut
+    // matrices are found by reading the whole similarity matrix.
+    EdgeIndex * edgeIndex;
+    // The memory, in MB, for keeping the highest pairs in memory when there
+    // is no edge index file. Set to 0 once they are loaded.
+    double edgeMemory;
+    // The largest similarity of every gene, loaded on the first read of the
+    // similarity matrix.
+    GeneMaxIndex * geneMax;
+    // The cut matrix of the last threshold found in the edge index, which
+    // the next, lower, threshold adds to: the number of pairs and genes in
+    // it, the index of each gene in it or -1, and the matrix.
+    long long int cutEdges;
+    int cutSize;
+    int * cutIndex;
+    float * cutMatrix;
+
+    // The thresholds being tested: at most window of them, whose cut
+    // matrices take at most windowMemory MB, unless a single one is larger.
+    // The jobs form a ring starting at jobFirst.
+    int window;
+    double windowMemory;
+    rmt_job_t * jobs;
+    int jobFirst;
+    int jobCount;
+    // The bytes of the cut matrices of the jobs, and of the last one read.
+    long long int jobBytes;
+    long long int lastBytes;
+    // The eigenvalues of the components of recent cut matrices, or NULL.
+    SpectrumCache * spectra;
+    // The number of threads that test the unfolding paces of a threshold.
+    int nnsdThreads;
+    // The eigenvalues of the thresholds tested. They are read from it
+    // instead of calculated if fromSpectra is set.
+    SpectraFile * spectraFile;
+    int fromSpectra;
+
     double getNNSDChiSquare(float* eigens, int size);
-    double getNNSDPaceChiSquare(float* eigens, int size, double bin, int pace);
-    // Calculates the eigenvalues of the given matrix.
-    float * calculateEigen(float * smatrix, int size);
-    //
-    double * unfolding(float * e, int size, int m);
+    double getNNSDPaceChiSquare(float* eigens, int size, double bin, int pace,
+        double * work, int * counts, gsl_interp_accel * acc);
+    static void * paceThread(void * arg);
+    // Calculates the nearest neighbor spacings of an unfolded spectrum.
+    double * unfolding(float * e, int size, int m, double * work, gsl_interp_accel * acc);
     // Removes duplicate eigenvalues from an array of eigenvalues.
     float * degenerate(float* eigens, int size, int* newSize);
 
-    float * read_similarity_matrix_bin_file(float th, int * size);
+    float * read_similarity_matrix_bin_file(float th, int * size, int ** genes);
+    float * read_edge_index(float th, int * size, int ** genes);
+    void reset_cut_matrix();
+
+    // Indicates if no other threshold can be tested until one is finished.
+    int windowFull();
+    // Reads the cut matrix of a threshold and starts its thread.
+    void startJob(float th);
+    // Waits for the first threshold being tested and retrieves its results.
+    void finishJob(float * th, int * size, double * chi);
+    static void * solveJob(void * arg);
+    // Tests successively smaller thresholds until the search stops.
+    int sweep(FILE * chiF, int first, int stride, int * resume, double * saved);
+    // Retrieves the threshold a number of steps below the start threshold.
+    float thresholdAt(int steps);
+    // Stops if a threshold that is needed is not in the spectra file.
+    void checkSpectrum(float th, int size);
 
   public:
-    RMTThreshold(EMatrix * ematrix, char * method,
-        double thresholdStart, double thresholdStep, double chiSoughtValue);
+    RMTThreshold(EMatrix * ematrix, char * method, char * group,
+        double thresholdStart, double thresholdStep, double chiSoughtValue,
+        double edgeFloor, double edgeMemory, int window, double windowMemory,
+        double coarseStep, int eigenMethod, double spectrumMemory,
+        double nnsdBin, double chiTest, int minPace, int maxPace,
+        int fromSpectra);
     ~RMTThreshold();
 
     double findThreshold();
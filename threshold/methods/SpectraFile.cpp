@@ -0,0 +1,193 @@
+#include "SpectraFile.h"
+
+/**
+ * Orders the spectra by threshold.
+ */
+static int compare_entries(const void * a, const void * b) {
+  float ta = ((spectra_entry_t *) a)->th;
+  float tb = ((spectra_entry_t *) b)->th;
+  return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+/**
+ * Constructor.
+ *
+ * @param char * filename
+ *   The name of the file.
+ * @param int writing
+ *   1 to create the file, or 0 to read the spectra of an earlier search.
+ */
+SpectraFile::SpectraFile(char * filename, int writing) {
+  spectra_header_t header;
+  spectra_record_t record;
+
+  strcpy(this->filename, filename);
+  this->writing = writing;
+  num_spectra = 0;
+  max_spectra = 0;
+  entries = NULL;
+
+  if (writing) {
+    f = fopen(filename, "wb+");
+    if (!f) {
+      fprintf(stderr, "ERROR: could not open spectra file: '%s'\n", filename);
+      exit(-1);
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SPECTRA_FILE_MAGIC, 8);
+    header.version = SPECTRA_FILE_VERSION;
+    fwrite(&header, sizeof(header), 1, f);
+    fflush(f);
+    return;
+  }
+
+  f = fopen(filename, "rb");
+  if (!f || fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, SPECTRA_FILE_MAGIC, 8) != 0 ||
+      header.version != SPECTRA_FILE_VERSION) {
+    fprintf(stderr, "ERROR: cannot read spectra file: '%s'\n", filename);
+    exit(-1);
+  }
+  max_spectra = header.num_spectra;
+  entries = (spectra_entry_t *) malloc(sizeof(spectra_entry_t) * (max_spectra > 0 ? max_spectra : 1));
+  for (int i = 0; i < header.num_spectra; i++) {
+    if (fread(&record, sizeof(record), 1, f) != 1) {
+      fprintf(stderr, "ERROR: cannot read spectra file: '%s'\n", filename);
+      exit(-1);
+    }
+    entries[i].th = record.th;
+    entries[i].size = record.size;
+    entries[i].num_values = record.num_values;
+    entries[i].offset = ftell(f);
+    fseek(f, (long) record.num_values * sizeof(float), SEEK_CUR);
+  }
+  num_spectra = header.num_spectra;
+  qsort(entries, num_spectra, sizeof(spectra_entry_t), compare_entries);
+}
+
+/**
+ * Destructor.
+ */
+SpectraFile::~SpectraFile() {
+  if (f) {
+    fclose(f);
+  }
+  free(entries);
+}
+
+/**
+ * Retrieves the index of the entry of a threshold.
+ *
+ * @param float th
+ *
+ * @return int
+ *   The index, or -1 if the threshold is not in the file.
+ */
+int SpectraFile::indexOf(float th) {
+  // The entries of a file being written are in the order of the search.
+  if (writing) {
+    for (int i = 0; i < num_spectra; i++) {
+      if (entries[i].th == th) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  int lo = 0;
+  int hi = num_spectra - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (entries[mid].th < th) {
+      lo = mid + 1;
+    }
+    else if (entries[mid].th > th) {
+      hi = mid - 1;
+    }
+    else {
+      return mid;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Adds the eigenvalues of a threshold to the end of the file, unless it
+ * is in the file already.
+ *
+ * @param float th
+ * @param int size
+ *   The size of the cut matrix.
+ * @param float * values
+ *   The eigenvalues, in ascending order, or NULL.
+ * @param int num_values
+ *   The number of eigenvalues: size, or 0 if the threshold was not tested.
+ */
+void SpectraFile::add(float th, int size, float * values, int num_values) {
+  spectra_header_t header;
+  spectra_record_t record;
+
+  if (indexOf(th) >= 0) {
+    return;
+  }
+  if (num_spectra == max_spectra) {
+    max_spectra = max_spectra > 0 ? max_spectra * 2 : 256;
+    entries = (spectra_entry_t *) realloc(entries, sizeof(spectra_entry_t) * max_spectra);
+  }
+
+  memset(&record, 0, sizeof(record));
+  record.th = th;
+  record.size = size;
+  record.num_values = num_values;
+  fseek(f, 0, SEEK_END);
+  if (fwrite(&record, sizeof(record), 1, f) != 1 ||
+      fwrite(values, sizeof(float), num_values, f) != (size_t) num_values) {
+    fprintf(stderr, "ERROR: could not write spectra file: '%s'\n", filename);
+    exit(-1);
+  }
+  entries[num_spectra].th = th;
+  entries[num_spectra].size = size;
+  entries[num_spectra].num_values = num_values;
+  entries[num_spectra].offset = 0;
+  num_spectra++;
+
+  // Count the new spectrum in the header.
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SPECTRA_FILE_MAGIC, 8);
+  header.version = SPECTRA_FILE_VERSION;
+  header.num_spectra = num_spectra;
+  fseek(f, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, f);
+  fflush(f);
+}
+
+/**
+ * Reads the spectrum of a threshold.
+ *
+ * @param float th
+ * @param int * size
+ *   Set to the size of the cut matrix.
+ * @param float ** values
+ *   Set to a new array of the eigenvalues, or NULL if the threshold was not
+ *   tested.
+ *
+ * @return int
+ *   1 if the threshold is in the file, or 0 if not.
+ */
+int SpectraFile::find(float th, int * size, float ** values) {
+  int i = indexOf(th);
+
+  *values = NULL;
+  if (i < 0) {
+    return 0;
+  }
+  *size = entries[i].size;
+  if (entries[i].num_values > 0) {
+    *values = (float *) malloc(sizeof(float) * entries[i].num_values);
+    fseek(f, entries[i].offset, SEEK_SET);
+    if (fread(*values, sizeof(float), entries[i].num_values, f) != (size_t) entries[i].num_values) {
+      fprintf(stderr, "ERROR: cannot read spectra file: '%s'\n", filename);
+      exit(-1);
+    }
+  }
+  return 1;
+}
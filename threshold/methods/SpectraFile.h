@@ -0,0 +1,90 @@
+#ifndef _SPECTRAFILE_
+#define _SPECTRAFILE_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The magic string at the start of a spectra file.
+#define SPECTRA_FILE_MAGIC "RMTSPECT"
+// The version of the spectra format.
+#define SPECTRA_FILE_VERSION 1
+
+/**
+ * The header of a spectra file.
+ */
+typedef struct {
+  // SPECTRA_FILE_MAGIC, without a terminating NUL.
+  char magic[8];
+  int version;
+  // The number of spectra in the file.
+  int num_spectra;
+  // Unused. Set to zero.
+  long long int reserved[3];
+} spectra_header_t;
+
+/**
+ * The record before the eigenvalues of a threshold.
+ */
+typedef struct {
+  float th;
+  // The size of the cut matrix.
+  int size;
+  // The number of eigenvalues that follow: size, or 0 if the cut matrix
+  // was too small to be tested.
+  int num_values;
+  // Unused. Set to zero.
+  int reserved;
+} spectra_record_t;
+
+/**
+ * Where the spectrum of a threshold is in a spectra file.
+ */
+typedef struct {
+  float th;
+  int size;
+  int num_values;
+  long long int offset;
+} spectra_entry_t;
+
+/**
+ * The eigenvalues of the thresholds of a search, kept for re-analysis.
+ *
+ * The file <prefix>.<method>.spectra holds, for each threshold tested, the
+ * size of its cut matrix and its eigenvalues in ascending order, as float
+ * values.  Each threshold is only written once.  The header is rewritten
+ * after every threshold, so the file of an interrupted search can be read
+ * as well.
+ *
+ * A file that is read is indexed by threshold, and the eigenvalues of a
+ * threshold are read from it when they are needed.  The thresholds must
+ * match exactly, as they do for the same start threshold and step.
+ */
+class SpectraFile {
+
+  private:
+    // The name of the file.
+    char filename[1024];
+    FILE * f;
+    // Indicates if the file is being written.
+    int writing;
+    // The thresholds in the file, sorted by threshold when reading.
+    spectra_entry_t * entries;
+    int num_spectra;
+    int max_spectra;
+
+    int indexOf(float th);
+
+  public:
+    SpectraFile(char * filename, int writing);
+    ~SpectraFile();
+
+    // Adds the eigenvalues of a threshold, unless it is in the file already.
+    void add(float th, int size, float * values, int num_values);
+    // Reads the size of a threshold and a new array of its eigenvalues.
+    int find(float th, int * size, float ** values);
+    int getNumSpectra() { return num_spectra; }
+    char * getFileName() { return filename; }
+};
+
+#endif
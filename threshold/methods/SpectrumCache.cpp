@@ -0,0 +1,138 @@
+#include "SpectrumCache.h"
+
+/**
+ * Constructor.
+ *
+ * @param double memory
+ *   The memory, in MB, for the eigenvalues.
+ */
+SpectrumCache::SpectrumCache(double memory) {
+  buckets = (spectrum_entry_t **) calloc(SPECTRUM_CACHE_BUCKETS, sizeof(spectrum_entry_t *));
+  num_values = 0;
+  max_values = (long long int) (memory * 1024 * 1024 / sizeof(float));
+  tick = 0;
+  num_hits = 0;
+  num_misses = 0;
+  pthread_mutex_init(&lock, NULL);
+}
+
+/**
+ * Destructor.
+ */
+SpectrumCache::~SpectrumCache() {
+  evict(tick + 1);
+  free(buckets);
+  pthread_mutex_destroy(&lock);
+}
+
+/**
+ * Drops the entries last used before a tick.  The lock must be held.
+ *
+ * @param int oldest
+ *   The oldest tick whose entries are kept.
+ */
+void SpectrumCache::evict(int oldest) {
+  for (int b = 0; b < SPECTRUM_CACHE_BUCKETS; b++) {
+    spectrum_entry_t ** link = &buckets[b];
+    while (*link) {
+      spectrum_entry_t * entry = *link;
+      if (entry->last_use >= oldest) {
+        link = &entry->next;
+        continue;
+      }
+      *link = entry->next;
+      num_values -= entry->size;
+      free(entry->values);
+      free(entry);
+    }
+  }
+}
+
+/**
+ * Takes the tick of a new cut matrix.  Ticks grow in the order the cut
+ * matrices are read.
+ *
+ * @return int
+ */
+int SpectrumCache::nextTick() {
+  pthread_mutex_lock(&lock);
+  int t = ++tick;
+  pthread_mutex_unlock(&lock);
+  return t;
+}
+
+/**
+ * Copies the eigenvalues of a component, if they are kept, and marks them
+ * as used by a cut matrix.
+ *
+ * @param unsigned long long key
+ *   The fingerprint of the component.
+ * @param int size
+ *   The number of genes of the component.
+ * @param int tick
+ *   The tick of the cut matrix.
+ * @param float * values
+ *   Receives the size eigenvalues.
+ *
+ * @return int
+ *   1 if the eigenvalues were found, 0 if not.
+ */
+int SpectrumCache::get(unsigned long long key, int size, int tick, float * values) {
+  int found = 0;
+
+  pthread_mutex_lock(&lock);
+  for (spectrum_entry_t * entry = buckets[key % SPECTRUM_CACHE_BUCKETS]; entry; entry = entry->next) {
+    if (entry->key == key && entry->size == size) {
+      memcpy(values, entry->values, sizeof(float) * size);
+      if (tick > entry->last_use) {
+        entry->last_use = tick;
+      }
+      found = 1;
+      break;
+    }
+  }
+  if (found) {
+    num_hits++;
+  }
+  else {
+    num_misses++;
+  }
+  pthread_mutex_unlock(&lock);
+  return found;
+}
+
+/**
+ * Keeps the eigenvalues of a component.  If the cache is full, the entries
+ * that the two newest cut matrices did not use are dropped first, and the
+ * eigenvalues are not kept if there still is no room.
+ *
+ * @param unsigned long long key
+ * @param int size
+ * @param int tick
+ * @param float * values
+ */
+void SpectrumCache::put(unsigned long long key, int size, int tick, float * values) {
+  pthread_mutex_lock(&lock);
+  // Another cut matrix may have kept the same component meanwhile.
+  for (spectrum_entry_t * entry = buckets[key % SPECTRUM_CACHE_BUCKETS]; entry; entry = entry->next) {
+    if (entry->key == key && entry->size == size) {
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+  }
+  if (num_values + size > max_values) {
+    evict(this->tick - 1);
+  }
+  if (num_values + size <= max_values) {
+    spectrum_entry_t * entry = (spectrum_entry_t *) malloc(sizeof(spectrum_entry_t));
+    entry->key = key;
+    entry->size = size;
+    entry->last_use = tick;
+    entry->values = (float *) malloc(sizeof(float) * size);
+    memcpy(entry->values, values, sizeof(float) * size);
+    entry->next = buckets[key % SPECTRUM_CACHE_BUCKETS];
+    buckets[key % SPECTRUM_CACHE_BUCKETS] = entry;
+    num_values += size;
+  }
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,67 @@
+#ifndef _SPECTRUMCACHE_
+#define _SPECTRUMCACHE_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// The number of hash buckets of a spectrum cache.
+#define SPECTRUM_CACHE_BUCKETS 65536
+
+/**
+ * The eigenvalues of a component, and the cut matrix that last used them.
+ */
+typedef struct spectrum_entry {
+  unsigned long long key;
+  int size;
+  int last_use;
+  float * values;
+  struct spectrum_entry * next;
+} spectrum_entry_t;
+
+/**
+ * Keeps the eigenvalues of the connected components of recent cut matrices.
+ *
+ * Between two close thresholds, most components of the cut matrix do not
+ * change, so their eigenvalues are looked up by a fingerprint of the genes
+ * and values of the component instead of being calculated again.  Each cut
+ * matrix that is solved takes a number, its tick, from the cache, and the
+ * entries remember the last tick that used them.  When the cache is full,
+ * the entries that neither of the two newest cut matrices used are dropped.
+ *
+ * The cache may be used by several threads at the same time.
+ */
+class SpectrumCache {
+
+  private:
+    // The entries, chained by bucket.
+    spectrum_entry_t ** buckets;
+    // The number of eigenvalues kept, and the maximum.
+    long long int num_values;
+    long long int max_values;
+    // The tick of the newest cut matrix.
+    int tick;
+    // The number of components found and not found.
+    long long int num_hits;
+    long long int num_misses;
+    pthread_mutex_t lock;
+
+    void evict(int oldest);
+
+  public:
+    SpectrumCache(double memory);
+    ~SpectrumCache();
+
+    // Takes the tick of a new cut matrix.
+    int nextTick();
+    // Copies the eigenvalues of a component into values, if they are kept.
+    int get(unsigned long long key, int size, int tick, float * values);
+    // Keeps the eigenvalues of a component.
+    void put(unsigned long long key, int size, int tick, float * values);
+
+    long long int getNumHits() { return num_hits; }
+    long long int getNumMisses() { return num_misses; }
+};
+
+#endif
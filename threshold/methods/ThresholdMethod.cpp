@@ -5,14 +5,24 @@
 /**
  * DRArgs constructor.
  */
-ThresholdMethod::ThresholdMethod(EMatrix *ematrix, char * cmethod) {
+ThresholdMethod::ThresholdMethod(EMatrix *ematrix, char * cmethod, char * group) {
 
   this->ematrix = ematrix;
   this->cmethod = cmethod;
-
+  this->group = group;
+
+  // The matrix of a sample group is in a subdirectory named after the group
+  // and its results are named after it as well.
+  int group_len = group ? strlen(group) : 0;
+  char * prefix = ematrix->getFilePrefix();
+  out_prefix = (char *) malloc(sizeof(char) * (strlen(prefix) + group_len + 2));
+  strcpy(out_prefix, prefix);
+  if (group) {
+    sprintf(out_prefix, "%s.%s", prefix, group);
+  }
 
   // For the binary file format:
-  bin_dir = (char *) malloc(sizeof(char) * strlen(ematrix->getInfileName()));
+  bin_dir = (char *) malloc(sizeof(char) * (strlen("Spearman") + group_len + 2));
   if (strcmp(cmethod, "mi") == 0) {
     strcpy(bin_dir, "MI");
   }
@@ -22,12 +32,27 @@ ThresholdMethod::ThresholdMethod(EMatrix *ematrix, char * cmethod) {
   else if (strcmp(cmethod, "sc") == 0) {
     strcpy(bin_dir, "Spearman");
   }
+  else if (strcmp(cmethod, "kc") == 0) {
+    strcpy(bin_dir, "Kendall");
+  }
+  else if (strcmp(cmethod, "bc") == 0) {
+    strcpy(bin_dir, "Bicor");
+  }
+  if (group) {
+    strcat(bin_dir, "/");
+    strcat(bin_dir, group);
+  }
+
+  reader = new SimMatrixReader(bin_dir, prefix, cmethod);
+  reader->checkGenes(ematrix->getGenes(), ematrix->getNumGenes());
 }
 
 /**
  * DRArgs destructor.
  */
 ThresholdMethod::~ThresholdMethod() {
+  delete reader;
   free(bin_dir);
+  free(out_prefix);
 }
 
@@ -4,6 +4,7 @@
 #include <getopt.h>
 
 #include "../../ematrix/EMatrix.h"
+#include "../../similarity/SimMatrixReader.h"
 
 void print_threshold_usage();
 
@@ -21,14 +22,20 @@ class ThresholdMethod {
     EMatrix * ematrix;
     // The directory where the expression matrix is found
     char * bin_dir;
-    // Specifies the correlation method that was used: pc, mi, sc
+    // Specifies the correlation method that was used: pc, mi, sc, kc, bc
     char * cmethod;
+    // The sample group of the similarity matrix or NULL.
+    char * group;
+    // The prefix for output files. It includes the sample group, if any.
+    char * out_prefix;
+    // The similarity matrix.
+    SimMatrixReader * reader;
 
     float ** parseScores(char * scores_str);
 
 
   public:
-    ThresholdMethod(EMatrix *ematrix, char * cmethod);
+    ThresholdMethod(EMatrix *ematrix, char * cmethod, char * group);
     ~ThresholdMethod();
 
 